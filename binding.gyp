@@ -1,27 +1,66 @@
 {
   "targets": [
     {
-      "target_name": "binding",
+      "target_name": "memcache",
+      "type": "static_library",
       "sources": [
-        "src/binding.cc",
         "src/memcache.cc",
-        "src/bson.cc"
+        "src/shared_cache.cc",
+        "src/queue.cc"
       ],
-      "include_dirs": [
-        "<!(node -e \"require('nan')\")"
+      "cflags": [
+        "-fPIC"
       ],
+      "direct_dependent_settings": {
+        "include_dirs": [
+          "src"
+        ]
+      },
       "conditions": [
         [
           "OS==\"linux\"",
           {
             "link_settings": {
               "libraries": [
-                "-lrt"
+                "-lrt",
+                "-lpthread"
               ]
             }
           }
         ]
       ]
+    },
+    {
+      "target_name": "binding",
+      "sources": [
+        "src/binding.cc",
+        "src/bson.cc"
+      ],
+      "dependencies": [
+        "memcache"
+      ],
+      "include_dirs": [
+        "<!(node -e \"require('nan')\")"
+      ]
     }
+  ],
+  "conditions": [
+    [
+      "OS!=\"win\"",
+      {
+        "targets": [
+          {
+            "target_name": "benchmark",
+            "type": "executable",
+            "sources": [
+              "test/benchmark.cc"
+            ],
+            "dependencies": [
+              "memcache"
+            ]
+          }
+        ]
+      }
+    ]
   ]
 }
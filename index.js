@@ -1,5 +1,7 @@
 process.dlopen(module, require.resolve('./build/Release/binding.node'));
 
+var stream = require('stream');
+
 exports.SIZE_DEFAULT = 6;
 exports.SIZE_64 = 6;
 exports.SIZE_128 = 7;
@@ -11,6 +13,97 @@ exports.SIZE_4K = 12;
 exports.SIZE_8K = 13;
 exports.SIZE_16K = 14;
 
+exports.POLICY_LRU = 0;
+exports.POLICY_TINYLFU = 1;
+
+exports.PRIORITY_NORMAL = 0;
+exports.PRIORITY_LOW = 1;
+exports.PRIORITY_PINNED = 2;
+
+// methods running on the threadpool return promises
+function promisify(method) {
+	return function() {
+		var args = Array.prototype.slice.call(arguments);
+		return new Promise(function(resolve, reject) {
+			args.push(function(err, value) {
+				err ? reject(err) : resolve(value);
+			});
+			method.apply(null, args);
+		});
+	};
+}
+
+exports.getAsync = promisify(exports.getAsync);
+exports.fastGetAsync = promisify(exports.fastGetAsync);
+exports.setAsync = promisify(exports.setAsync);
+exports.dumpAsync = promisify(exports.dumpAsync);
+exports.popAsync = promisify(exports.popAsync);
+exports.popManyAsync = promisify(exports.popManyAsync);
+
+// streams records of the change log of a cache, which is opened with changeLog, from options.cursor,
+// or from a snapshot of the cache unless options.snapshot is false. New records are polled every
+// options.interval ms until the stream is destroyed. If records are overwritten before they are
+// read, a new snapshot is taken, or the stream fails without snapshots
+exports.exportStream = function(instance, options) {
+	options = options || {};
+	var snapshot = options.snapshot !== false;
+	var cursor = options.cursor;
+	var timer = null;
+	var readable = new stream.Readable({
+		read: function() {
+			if(timer) return;
+			var part = cursor === undefined && snapshot ? exports.snapshot(instance) : exports.readLog(instance, cursor);
+			if(!part) {
+				if(!snapshot) return this.destroy(new Error('records of the change log are overwritten'));
+				part = exports.snapshot(instance);
+			}
+			cursor = part.cursor;
+			if(part.records.length) {
+				this.push(part.records);
+			} else {
+				timer = setTimeout(function() {
+					timer = null;
+					readable._read();
+				}, options.interval || 100);
+			}
+		},
+		destroy: function(err, callback) {
+			clearTimeout(timer);
+			callback(err);
+		}
+	});
+	return readable;
+};
+
+// applies records written by exportStream to a cache, as they come in from a socket or a pipe
+exports.importStream = function(instance) {
+	var pending = null; // a record cut between chunks
+	return new stream.Writable({
+		write: function(chunk, encoding, callback) {
+			var records = pending ? Buffer.concat([pending, chunk]) : chunk;
+			try {
+				var applied = exports.applyLog(instance, records);
+			} catch(e) {
+				return callback(e);
+			}
+			pending = applied < records.length ? records.slice(applied) : null;
+			callback();
+		}
+	});
+};
+
 if(process.mainModule === module && process.argv[2] === 'release') {
 	process.argv.slice(3).forEach(exports.release);
+} else if(process.mainModule === module && process.argv[2] === 'stats') {
+	process.argv.slice(3).forEach(function(name) {
+		var stats = exports.stats(new exports.Cache(name, 0));
+		stats.hitRatio = stats.gets ? stats.hits / stats.gets : 0;
+		stats.meanProbes = stats.lookups ? stats.probes / stats.lookups : 0;
+		console.log(name + ': ' + JSON.stringify(stats, null, 2));
+	});
+} else if(process.mainModule === module && process.argv[2] === 'latency') {
+	// latency <name> [on|off]
+	var action = process.argv[4];
+	var latency = exports.latency(new exports.Cache(process.argv[3], 0), action && action === 'on');
+	console.log(process.argv[3] + ': ' + JSON.stringify(latency, null, 2));
 }
\ No newline at end of file
@@ -1,28 +1,28 @@
 #include<nan.h>
-#include<sys/types.h>
-#include<sys/stat.h>
-#include<fcntl.h>
 #include<errno.h>
 #include<string.h>
+#include<map>
+#include<list>
+#include<vector>
 #include "memcache.h"
+#include "shared_cache.h"
+#include "queue.h"
 #include "bson.h"
 
-#ifndef _WIN32
-#include<unistd.h>
-#include<sys/mman.h>
-#endif
-
-#ifdef _WIN32
-#include <Windows.h>
-#endif
-
+using namespace v8;
 
-#define CACHE_HEADER_IN_WORDS   131080
+// templates belong to an isolate. Worker threads have isolates of their own, which are
+// bound to their threads, so templates are kept per thread
+typedef struct templates_s {
+    Nan::Persistent<ObjectTemplate>     instance;
+    Nan::Persistent<FunctionTemplate>   key;
+    Nan::Persistent<FunctionTemplate>   queue;
+} templates_t;
 
-using namespace v8;
+static thread_local templates_t* templates;
 
 #define FATALIF(expr, n, method)    if((expr) == n) {\
-    char sbuf[64];\
+    char sbuf[128];\
     sprintf(sbuf, __FILE__ ":%d: `%s' failed with code %d", __LINE__, #method, errno);\
     return Nan::ThrowError(sbuf);\
 }
@@ -35,22 +35,238 @@ using namespace v8;
     HANDLE fd = reinterpret_cast<HANDLE>(holder->GetInternalField(1)->IntegerValue())
 #endif
 
-#define PROPERTY_SCOPE(property, holder, ptr, fd, keyLen, keyBuf) int keyLen = property->Length();\
-    if(keyLen > 256) {\
+// scope of methods which operate on the namespace of the instance
+#define NS_SCOPE(holder, ptr, fd, ns) METHOD_SCOPE(holder, ptr, fd);\
+    uint32_t ns = holder->GetInternalField(2)->Uint32Value()
+
+#define CHECK_KEY_LENGTH(ptr, keyLen) if(keyLen > 256) {\
         return Nan::ThrowError("length of property name should not be greater than 256");\
     }\
-    METHOD_SCOPE(holder, ptr, fd);\
     if((keyLen << 1) + 32 > 1 << static_cast<uint16_t*>(ptr)[CACHE_HEADER_IN_WORDS]) {\
         return Nan::ThrowError("length of property name should not be greater than (block size - 32) / 2");\
-    }\
+    }
+
+#define PROPERTY_SCOPE(property, holder, ptr, fd, ns, keyLen, keyBuf) int keyLen = property->Length();\
+    NS_SCOPE(holder, ptr, fd, ns);\
+    CHECK_KEY_LENGTH(ptr, keyLen);\
     uint16_t keyBuf[256];\
     property->Write(keyBuf)
 
+// a key prepared by key(), kept in a buffer held by the handle object
+typedef struct key_handle_s {
+    void*           ptr; // the cache and namespace the key is prepared for
+    uint32_t        ns;
+    uint32_t        keyLen;
+    cache::handle_t handle;
+    uint16_t        key[256];
+} key_handle_t;
+
+// key is either a string, or a handle returned by key()
+#define KEY_SCOPE(arg, holder, ptr, fd, ns, keyLen, keyBuf, handle) NS_SCOPE(holder, ptr, fd, ns);\
+    cache::handle_t* handle = NULL;\
+    int keyLen;\
+    const uint16_t* keyBuf;\
+    uint16_t keyStore[256];\
+    if(Nan::New(templates->key)->HasInstance(arg)) {\
+        key_handle_t* keyHandle = static_cast<key_handle_t*>(Nan::GetInternalFieldPointer(Local<Object>::Cast(arg), 0));\
+        if(keyHandle->ptr != ptr || keyHandle->ns != ns) {\
+            return Nan::ThrowError("key handle is prepared for another cache instance");\
+        }\
+        handle = &keyHandle->handle;\
+        keyLen = keyHandle->keyLen;\
+        keyBuf = keyHandle->key;\
+    } else {\
+        Local<String> property = arg->ToString();\
+        keyLen = property->Length();\
+        CHECK_KEY_LENGTH(ptr, keyLen);\
+        property->Write(keyStore);\
+        keyBuf = keyStore;\
+    }
+
+// options of methods: {timeout: ms}
+static inline uint32_t timeoutOf(const Nan::FunctionCallbackInfo<Value>& info, int index) {
+    if(info.Length() > index && info[index]->IsObject()) {
+        Local<Value> timeout = info[index]->ToObject()->Get(Nan::New("timeout").ToLocalChecked());
+        if(!timeout->IsUndefined()) {
+            return timeout->Uint32Value();
+        }
+    }
+    return TIMEOUT_INFINITE;
+}
+
+// options of set: {priority: PRIORITY_x, pinned: true}. Entries keep their priority if none is given
+static inline uint32_t priorityOf(const Nan::FunctionCallbackInfo<Value>& info, int index) {
+    if(info.Length() > index && info[index]->IsObject()) {
+        Local<Object> options = info[index]->ToObject();
+        if(options->Get(Nan::New("pinned").ToLocalChecked())->BooleanValue()) {
+            return cache::PRIORITY_PINNED;
+        }
+        Local<Value> priority = options->Get(Nan::New("priority").ToLocalChecked());
+        if(!priority->IsUndefined()) {
+            return priority->Uint32Value();
+        }
+    }
+    return cache::PRIORITY_KEEP;
+}
+
+// thrown when the lock is not acquired in time, so that the caller can fall back
+static void ThrowTimeout() {
+    Local<Value> error = Nan::Error("lock timeout");
+    error->ToObject()->Set(Nan::New("code").ToLocalChecked(), Nan::New("ETIMEDOUT").ToLocalChecked());
+    Nan::ThrowError(error);
+}
+
+// keeps parsed values of recently read keys in this process. An entry is used as
+// long as the generation of its key is unchanged, and the least recently used
+// entry is dropped when there are more than `capacity' entries.
+class NearCache {
+    typedef std::vector<uint16_t> key_t; // namespace followed by the key
+    struct entry_t;
+    typedef std::map<key_t, entry_t*> map_t;
+    typedef std::list<map_t::iterator> lru_t;
+
+    struct entry_t {
+        uint64_t generation;
+        Nan::Persistent<Value> value;
+        lru_t::iterator lru;
+    };
+
+    map_t entries;
+    lru_t lru; // most recently used first
+    size_t capacity;
+    key_t probe;
+
+    inline const key_t& keyOf(uint32_t ns, const uint16_t* key, size_t keyLen) {
+        probe.resize(keyLen + 1);
+        probe[0] = ns;
+        memcpy(&probe[1], key, keyLen << 1);
+        return probe;
+    }
+
+    inline void drop(map_t::iterator it) {
+        entry_t* entry = it->second;
+        lru.erase(entry->lru);
+        entry->value.Reset();
+        delete entry;
+        entries.erase(it);
+    }
+
+public:
+    explicit NearCache(size_t capacity) : capacity(capacity) {}
+
+    ~NearCache() {
+        while(!entries.empty()) {
+            drop(entries.begin());
+        }
+    }
+
+    // returns an empty handle if the key is not cached, or has changed
+    Local<Value> get(uint32_t ns, const uint16_t* key, size_t keyLen, uint64_t generation) {
+        map_t::iterator it = entries.find(keyOf(ns, key, keyLen));
+        if(it == entries.end()) {
+            return Local<Value>();
+        }
+        entry_t* entry = it->second;
+        if(entry->generation != generation) {
+            drop(it);
+            return Local<Value>();
+        }
+        lru.splice(lru.begin(), lru, entry->lru);
+        return Nan::New(entry->value);
+    }
+
+    void set(uint32_t ns, const uint16_t* key, size_t keyLen, uint64_t generation, Local<Value> value) {
+        map_t::iterator it = entries.find(keyOf(ns, key, keyLen));
+        entry_t* entry;
+        if(it == entries.end()) {
+            entry = new entry_t;
+            it = entries.insert(map_t::value_type(probe, entry)).first;
+            lru.push_front(it);
+            entry->lru = lru.begin();
+            if(entries.size() > capacity) {
+                drop(lru.back());
+            }
+        } else {
+            entry = it->second;
+            lru.splice(lru.begin(), lru, entry->lru);
+        }
+        entry->generation = generation;
+        entry->value.Reset(value);
+    }
+};
+
+// times a step of an operation into a latency histogram, if latency recording is enabled
+class LatencyTimer {
+    void* ptr;
+    uint32_t histogram;
+    uint64_t begin;
+
+public:
+    inline LatencyTimer(void* ptr, uint32_t histogram) : ptr(ptr), histogram(histogram),
+        begin(cache::latency_enabled(ptr) ? cache::latency_clock() : 0) {}
+
+    inline void stop() {
+        if(begin) {
+            cache::latency_record(ptr, histogram, cache::latency_clock() - begin);
+        }
+    }
+};
+
+static inline Local<Value> parse(void* ptr, bson::BSONParser& parser) {
+    LatencyTimer timer(ptr, cache::LATENCY_PARSE);
+    Local<Value> value = parser.parse();
+    timer.stop();
+    return value;
+}
+
+#define FORMAT(holder) holder->GetInternalField(4)->Uint32Value()
+
+#define SERIALIZE(holder, ptr, bsonValue, value) LatencyTimer serializeTimer(ptr, cache::LATENCY_SERIALIZE);\
+    bson::BSONValue bsonValue(value, FORMAT(holder));\
+    serializeTimer.stop()
+
+#define NEAR_CACHE(holder) static_cast<NearCache*>(Nan::GetInternalFieldPointer(holder, 3))
+
+// reads a key through the near cache of the instance, if there is one
+#define NEAR_GET(holder, ptr, ns, keyLen, keyBuf, handle, parser, read) NearCache* nearCache = NEAR_CACHE(holder);\
+    uint64_t generation = 0;\
+    if(nearCache) {\
+        generation = cache::generation(ptr, ns, keyBuf, keyLen, handle);\
+        Local<Value> cached = nearCache->get(ns, keyBuf, keyLen, generation);\
+        if(!cached.IsEmpty()) {\
+            return info.GetReturnValue().Set(cached);\
+        }\
+    }\
+    bson::BSONParser parser;\
+    if((read) == -1) {\
+        return ThrowTimeout();\
+    }\
+    if(parser.val) {\
+        Local<Value> value = parse(ptr, parser);\
+        if(nearCache) {\
+            nearCache->set(ns, keyBuf, keyLen, generation, value);\
+        }\
+        info.GetReturnValue().Set(value);\
+    }
+
+
+// the mapping of a Cache instance, which is closed when the instance is collected. Namespaces
+// and key handles keep the instance they are created from
+typedef struct mapping_s {
+    Nan::Persistent<Object> holder;
+    shared_cache_t          cache;
+    NearCache*              nearCache;
+} mapping_t;
+
+static void collected(const Nan::WeakCallbackInfo<mapping_t>& data) {
+    mapping_t* mapping = data.GetParameter();
+    delete mapping->nearCache;
+    shared_cache_close(&mapping->cache);
+    delete mapping;
+}
 
 static NAN_METHOD(release) {
-#ifndef _WIN32
-    FATALIF(shm_unlink(*String::Utf8Value(info[0])), -1, shm_unlink);
-#endif
+    FATALIF(shared_cache_release(*String::Utf8Value(info[0])), -1, shm_unlink);
 }
 
 static NAN_METHOD(create) {
@@ -65,7 +281,9 @@ static NAN_METHOD(create) {
     uint32_t blocks = size >> (5 + block_size_shift) << 5; // 32 aligned
     size = blocks << block_size_shift;
 
-    if(block_size_shift < 6) {
+    if(!info[1]->Uint32Value()) {
+        // attaches to an existing cache
+    } else if(block_size_shift < 6) {
         return Nan::ThrowError("block size should not be smaller than 64 bytes");
     } else if(block_size_shift > 14) {
         return Nan::ThrowError("block size should not be larger than 16 KB");
@@ -73,84 +291,69 @@ static NAN_METHOD(create) {
         return Nan::ThrowError("total_size should be larger than 512 KB");
     }
 
-    // fprintf(stderr, "allocating %d bytes memory\n", size);
-
-    HANDLE fd;
-    void* ptr;
-    bool forced = false;
-    Nan::Utf8String name(info[0]);
+    shared_cache_options_t options = {cache::POLICY_LRU, 0, 0, 0};
+    uint32_t nearCacheSize = 0;
+    uint32_t format = bson::FORMAT_DEFAULT;
+    if(info.Length() > 3 && info[3]->IsObject()) {
+        Local<Object> opts = info[3]->ToObject();
+        Local<Value> policy = opts->Get(Nan::New("policy").ToLocalChecked());
+        if(!policy->IsUndefined()) {
+            options.policy = policy->Uint32Value();
+        }
+        nearCacheSize = opts->Get(Nan::New("nearCache").ToLocalChecked())->Uint32Value();
+        options.small_slots = opts->Get(Nan::New("smallSlots").ToLocalChecked())->Uint32Value();
+        options.slabs = opts->Get(Nan::New("slabs").ToLocalChecked())->BooleanValue();
+        options.change_log = opts->Get(Nan::New("changeLog").ToLocalChecked())->Uint32Value();
+        if(opts->Get(Nan::New("indexed").ToLocalChecked())->BooleanValue()) {
+            format |= bson::FORMAT_INDEXED;
+        }
+        if(opts->Get(Nan::New("shapes").ToLocalChecked())->BooleanValue()) {
+            format |= bson::FORMAT_SHAPES;
+        }
+    }
+    if(options.policy > cache::POLICY_TINYLFU) {
+        return Nan::ThrowError("unknown eviction policy");
+    }
 
-#ifndef _WIN32
-    FATALIF(fd = shm_open(*name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR), -1, shm_open);
-    struct stat stat;
-    FATALIF(fstat(fd, &stat), -1, fstat);
+    // fprintf(stderr, "allocating %d bytes memory\n", size);
 
-    if(stat.st_size == 0) {
-        FATALIF(ftruncate(fd, size), -1, ftruncate);        
-    } else if(stat.st_size != size) {
+    shared_cache_t cache;
+    int ret = shared_cache_open_options(&cache, *Nan::Utf8String(info[0]), size, block_size_shift, &options);
+    if(ret == SHARED_CACHE_ESIZE) {
         return Nan::ThrowError("cache initialized with different size");
+    } else if(ret == SHARED_CACHE_ELAYOUT) {
+        return Nan::ThrowError("cache initialization failed, maybe it has been initialized with different block size, policy, small slots, slabs or change log");
+    } else if(ret == SHARED_CACHE_ERROR && !size && errno == ENOENT) {
+        return Nan::ThrowError("cache not found");
     }
+    FATALIF(ret, SHARED_CACHE_ERROR, shared_cache_open);
 
-    FATALIF(ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0), MAP_FAILED, mmap);
-    forced = stat.st_size == 0;
-#else
-    // create/open the file mapping
-    HANDLE hnd = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, *name);
-    if (!hnd) {
-        FATALIF(hnd = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, *name), NULL, CreateFileMapping);
-        forced = true;
-    }
-
-    // map the memory
-    FATALIF(ptr = MapViewOfFile(hnd, FILE_MAP_ALL_ACCESS, 0, 0, size), NULL, MapViewOfFile);
-
-    // create a mutex for synchronization
-    char mutexName[64];
-    sprintf(mutexName, "mutex:%s", *name);
-    fd = CreateMutex(NULL, FALSE, mutexName);
-    if (!fd) {
-        if (GetLastError() == ERROR_ALREADY_EXISTS) {
-            FATALIF(fd = OpenMutex(SYNCHRONIZE, FALSE, mutexName), NULL, OpenMutex);
-        } else {
-            Nan::ThrowError("can't create mutex");
-        }
-    }
-#endif
+    mapping_t* mapping = new mapping_t;
+    mapping->cache = cache;
+    mapping->nearCache = nearCacheSize ? new NearCache(nearCacheSize) : NULL;
+    mapping->holder.Reset(info.Holder());
+    mapping->holder.SetWeak(mapping, collected, Nan::WeakCallbackType::kParameter);
 
-    if (cache::init(ptr, blocks, block_size_shift, forced)) {
-        Nan::SetInternalFieldPointer(info.Holder(), 0, ptr);
-#ifdef __MACH__
-        char sbuf[64];
-        sprintf(sbuf, "/tmp/shared_cache_%s", *name);
-        FATALIF(fd = open(sbuf, O_CREAT | O_RDONLY, 0400), -1, open);
-#endif
-
-        info.Holder()->SetInternalField(1, Nan::New(fd));
-    }
-    else {
-        Nan::ThrowError("cache initialization failed, maybe it has been initialized with different block size");
-    }
+    Nan::SetInternalFieldPointer(info.Holder(), 0, cache.ptr);
+    info.Holder()->SetInternalField(1, Nan::New(cache.fd));
+    info.Holder()->SetInternalField(2, Nan::New(0)); // default namespace
+    Nan::SetInternalFieldPointer(info.Holder(), 3, mapping->nearCache);
+    info.Holder()->SetInternalField(4, Nan::New(format));
+    info.Holder()->SetInternalField(5, info.Holder());
 }
 
 static NAN_PROPERTY_GETTER(getter) {
-    PROPERTY_SCOPE(property, info.Holder(), ptr, fd, keyLen, keyBuf);
-
-    bson::BSONParser parser;
-
-    cache::get(ptr, fd, keyBuf, keyLen, parser.val, parser.valLen);
-
-    if(parser.val) {
-        info.GetReturnValue().Set(parser.parse());
-    }
+    PROPERTY_SCOPE(property, info.Holder(), ptr, fd, ns, keyLen, keyBuf);
 
+    NEAR_GET(info.Holder(), ptr, ns, keyLen, keyBuf, NULL, parser, cache::get(ptr, fd, ns, keyBuf, keyLen, parser.val, parser.valLen));
 }
 
 static NAN_PROPERTY_SETTER(setter) {
-    PROPERTY_SCOPE(property, info.Holder(), ptr, fd, keyLen, keyBuf);
+    PROPERTY_SCOPE(property, info.Holder(), ptr, fd, ns, keyLen, keyBuf);
 
-    bson::BSONValue bsonValue(value);
+    SERIALIZE(info.Holder(), ptr, bsonValue, value);
 
-    FATALIF(cache::set(ptr, fd, keyBuf, keyLen, bsonValue.Data(), bsonValue.Length()), -1, cache::set);
+    FATALIF(cache::set(ptr, fd, ns, keyBuf, keyLen, bsonValue.Data(), bsonValue.Length()), -1, cache::set);
     info.GetReturnValue().Set(value);
 }
 
@@ -167,73 +370,434 @@ public:
 };
 
 static NAN_PROPERTY_ENUMERATOR(enumerator) {
-    METHOD_SCOPE(info.Holder(), ptr, fd);
+    NS_SCOPE(info.Holder(), ptr, fd, ns);
     // fprintf(stderr, "enumerating properties %x\n", ptr);
 
     KeysEnumerator enumerator;
-    cache::enumerate(ptr, fd, &enumerator, KeysEnumerator::next);
+    cache::enumerate(ptr, fd, ns, &enumerator, KeysEnumerator::next);
 
     info.GetReturnValue().Set(enumerator.keys);
 }
 
 static NAN_PROPERTY_DELETER(deleter) {
-    PROPERTY_SCOPE(property, info.Holder(), ptr, fd, keyLen, keyBuf);
+    PROPERTY_SCOPE(property, info.Holder(), ptr, fd, ns, keyLen, keyBuf);
 
-    info.GetReturnValue().Set(cache::unset(ptr, fd, keyBuf, keyLen));
+    info.GetReturnValue().Set(cache::unset(ptr, fd, ns, keyBuf, keyLen));
 }
 
 static NAN_PROPERTY_QUERY(querier) {
-    PROPERTY_SCOPE(property, info.Holder(), ptr, fd, keyLen, keyBuf);
-    if(cache::contains(ptr, fd, keyBuf, keyLen)) {
+    PROPERTY_SCOPE(property, info.Holder(), ptr, fd, ns, keyLen, keyBuf);
+    if(cache::contains(ptr, fd, ns, keyBuf, keyLen)) {
         info.GetReturnValue().Set(0);
     }
 }
 
+// get(instance, key, [options])
+// same as instance[key], without going through the property interceptor
+static NAN_METHOD(get) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
+    uint32_t timeout = timeoutOf(info, 2);
+
+    NEAR_GET(holder, ptr, ns, keyLen, keyBuf, handle, parser, cache::get(ptr, fd, ns, keyBuf, keyLen, parser.val, parser.valLen, handle, timeout));
+}
+
+// set(instance, key, val, [options])
+// same as instance[key] = val, without going through the property interceptor
+static NAN_METHOD(set) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
+    uint32_t timeout = timeoutOf(info, 3);
+    uint32_t priority = priorityOf(info, 3);
+    if(priority > cache::PRIORITY_PINNED && priority != cache::PRIORITY_KEEP) {
+        return Nan::ThrowError("unknown priority");
+    }
+
+    SERIALIZE(holder, ptr, bsonValue, info[2]);
+
+    int ret = cache::set(ptr, fd, ns, keyBuf, keyLen, bsonValue.Data(), bsonValue.Length(), NULL, NULL, handle, timeout, priority);
+    if(ret == -1 && errno == ETIMEDOUT) {
+        return ThrowTimeout();
+    }
+    if(ret == -1 && errno == ENOSPC) {
+        return Nan::ThrowError("pinned entries should not take more than half of the cache");
+    }
+    FATALIF(ret, -1, cache::set);
+}
+
 // increase(holder, key, [by])
 static NAN_METHOD(increase) {
     Local<Object> holder = Local<Object>::Cast(info[0]);
-    PROPERTY_SCOPE(info[1]->ToString(), holder, ptr, fd, keyLen, keyBuf);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
     uint32_t increase_by = info.Length() > 2 ? info[2]->Uint32Value() : 1;
-    info.GetReturnValue().Set(cache::increase(ptr, fd, keyBuf, keyLen, increase_by));
+    info.GetReturnValue().Set(cache::increase(ptr, fd, ns, keyBuf, keyLen, increase_by, handle));
+}
+
+// names of fields are strings of any length
+#define FIELD_SCOPE(arg, field) Local<String> field##Name = arg->ToString();\
+    std::vector<uint16_t> field(field##Name->Length() + 1);\
+    field##Name->Write(&field[0])
+
+// throws the error of a hash method
+static void ThrowFieldError(const char* method) {
+    if(errno == ETIMEDOUT) {
+        return ThrowTimeout();
+    }
+    if(errno == EINVAL) {
+        return Nan::ThrowTypeError("value of the key is not a hash");
+    }
+    char sbuf[64];
+    sprintf(sbuf, "`%s' failed with code %d", method, errno);
+    Nan::ThrowError(sbuf);
+}
+
+// hset(instance, key, field, val, [options])
+// sets a field of a hash, which is created if the key is absent. Returns true if the field is added
+static NAN_METHOD(hset) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
+    FIELD_SCOPE(info[2], field);
+    uint32_t timeout = timeoutOf(info, 4);
+
+    SERIALIZE(holder, ptr, bsonValue, info[3]);
+
+    int ret = cache::hset(ptr, fd, ns, keyBuf, keyLen, &field[0], field.size() - 1, bsonValue.Data(), bsonValue.Length(), handle, timeout);
+    if(ret == -1) {
+        return ThrowFieldError("cache::hset");
+    }
+    info.GetReturnValue().Set(Nan::New<Boolean>(ret == 1));
+}
+
+// hget(instance, key, field, [options])
+// returns a field of a hash, without reading other fields
+static NAN_METHOD(hget) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
+    FIELD_SCOPE(info[2], field);
+    uint32_t timeout = timeoutOf(info, 3);
+
+    bson::BSONParser parser;
+    int ret = cache::hget(ptr, fd, ns, keyBuf, keyLen, &field[0], field.size() - 1, parser.val, parser.valLen, handle, timeout);
+    if(ret == -1) {
+        return ThrowFieldError("cache::hget");
+    }
+    if(ret) {
+        info.GetReturnValue().Set(parse(ptr, parser));
+    }
+}
+
+// hdel(instance, key, field, [options])
+// deletes a field of a hash, and returns true if it is deleted
+static NAN_METHOD(hdel) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
+    FIELD_SCOPE(info[2], field);
+    uint32_t timeout = timeoutOf(info, 3);
+
+    int ret = cache::hdel(ptr, fd, ns, keyBuf, keyLen, &field[0], field.size() - 1, handle, timeout);
+    if(ret == -1) {
+        return ThrowFieldError("cache::hdel");
+    }
+    info.GetReturnValue().Set(Nan::New<Boolean>(ret == 1));
+}
+
+// hgetall(instance, key, [options])
+// returns all fields of a hash as an object
+static NAN_METHOD(hgetall) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
+    uint32_t timeout = timeoutOf(info, 2);
+
+    bson::BSONParser parser;
+    if(cache::get(ptr, fd, ns, keyBuf, keyLen, parser.val, parser.valLen, handle, timeout) == -1) {
+        return ThrowTimeout();
+    }
+    if(!parser.val) {
+        return info.GetReturnValue().Set(Nan::New<Object>());
+    }
+    if(parser.val[0] != bson::Fields) {
+        return Nan::ThrowTypeError("value of the key is not a hash");
+    }
+    info.GetReturnValue().Set(parse(ptr, parser));
+}
+
+// hincr(instance, key, field, [by], [options])
+// increases an integer field of a hash, which is set to `by' if absent or not an integer
+static NAN_METHOD(hincr) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
+    FIELD_SCOPE(info[2], field);
+    int32_t increase_by = info.Length() > 3 && !info[3]->IsUndefined() ? info[3]->Int32Value() : 1;
+    uint32_t timeout = timeoutOf(info, 4);
+
+    int32_t result;
+    if(cache::hincr(ptr, fd, ns, keyBuf, keyLen, &field[0], field.size() - 1, increase_by, result, handle, timeout) == -1) {
+        return ThrowFieldError("cache::hincr");
+    }
+    info.GetReturnValue().Set(result);
+}
+
+// values serialized for a transaction, which are freed when it is done
+class Serialized {
+    std::vector<bson::BSONValue*> values;
+
+public:
+    ~Serialized() {
+        for(size_t i = 0; i < values.size(); i++) {
+            delete values[i];
+        }
+    }
+
+    bson::BSONValue* add(Local<Value> value, uint32_t format) {
+        values.push_back(new bson::BSONValue(value, format));
+        return values.back();
+    }
+};
+
+// transaction(instance, ops, [options])
+// ops is an array of ['get', key], ['set', key, val], ['unset', key], ['increase', key, [by]] and
+// ['check', key, [val]], which are applied together, or not at all if a check fails. Returns the
+// results of the ops, or null if a check failed
+static NAN_METHOD(transaction) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    NS_SCOPE(holder, ptr, fd, ns);
+    if(!info[1]->IsArray()) {
+        return Nan::ThrowTypeError("ops should be an array");
+    }
+    Local<Array> arr = Local<Array>::Cast(info[1]);
+    uint32_t count = arr->Length();
+    uint32_t timeout = timeoutOf(info, 2);
+
+    std::vector<cache::op_t> ops(count);
+    std::vector<uint16_t> keys(count * 256 + 1);
+    Serialized values;
+    LatencyTimer timer(ptr, cache::LATENCY_SERIALIZE);
+    for(uint32_t i = 0; i < count; i++) {
+        Local<Value> item = Nan::Get(arr, i).ToLocalChecked();
+        if(!item->IsArray() || Local<Array>::Cast(item)->Length() < 2) {
+            return Nan::ThrowTypeError("an op should be an array of its name and key");
+        }
+        Local<Array> args = Local<Array>::Cast(item);
+        uint32_t argc = args->Length();
+        cache::op_t& op = ops[i];
+        memset(&op, 0, sizeof(op));
+
+        Nan::Utf8String name(Nan::Get(args, 0).ToLocalChecked());
+        if(!strcmp(*name, "get")) {
+            op.type = cache::OP_GET;
+        } else if(!strcmp(*name, "set") && argc > 2) {
+            op.type = cache::OP_SET;
+        } else if(!strcmp(*name, "unset")) {
+            op.type = cache::OP_UNSET;
+        } else if(!strcmp(*name, "increase")) {
+            op.type = cache::OP_INCREASE;
+            op.increase_by = argc > 2 ? Nan::Get(args, 2).ToLocalChecked()->Int32Value() : 1;
+        } else if(!strcmp(*name, "check")) {
+            op.type = cache::OP_CHECK;
+        } else {
+            return Nan::ThrowTypeError("unknown op, or missing value of set");
+        }
+
+        Local<String> key = Nan::Get(args, 1).ToLocalChecked()->ToString();
+        int keyLen = key->Length();
+        CHECK_KEY_LENGTH(ptr, keyLen);
+        key->Write(&keys[i * 256]);
+        op.key = &keys[i * 256];
+        op.keyLen = keyLen;
+
+        if((op.type == cache::OP_SET || op.type == cache::OP_CHECK) && argc > 2) {
+            bson::BSONValue* value = values.add(Nan::Get(args, 2).ToLocalChecked(), FORMAT(holder));
+            op.val = value->Data();
+            op.valLen = value->Length();
+        }
+    }
+    timer.stop();
+
+    int ret = count ? cache::transaction(ptr, fd, ns, &ops[0], count, timeout) : 1;
+    if(ret == -1 && errno == ETIMEDOUT) {
+        return ThrowTimeout();
+    }
+    FATALIF(ret, -1, cache::transaction);
+    if(!ret) {
+        return info.GetReturnValue().Set(Nan::Null());
+    }
+
+    Local<Array> results = Nan::New<Array>(count);
+    for(uint32_t i = 0; i < count; i++) {
+        cache::op_t& op = ops[i];
+        switch(op.type) {
+        case cache::OP_GET:
+            if(op.retval) {
+                Nan::Set(results, i, bson::parse(op.retval));
+                delete[] op.retval;
+            } else {
+                Nan::Set(results, i, Nan::Undefined());
+            }
+            break;
+        case cache::OP_UNSET:
+            Nan::Set(results, i, Nan::New<Boolean>(op.result));
+            break;
+        case cache::OP_INCREASE:
+            Nan::Set(results, i, Nan::New(op.result));
+            break;
+        default:
+            Nan::Set(results, i, Nan::True());
+        }
+    }
+    info.GetReturnValue().Set(results);
 }
 
 // exchange(holder, key, val)
 // exchanges current key with new value, the old value is returned
 static NAN_METHOD(exchange) {
     Local<Object> holder = Local<Object>::Cast(info[0]);
-    PROPERTY_SCOPE(info[1]->ToString(), holder, ptr, fd, keyLen, keyBuf);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
 
-    bson::BSONValue bsonValue(info[2]);
+    SERIALIZE(holder, ptr, bsonValue, info[2]);
 
     bson::BSONParser parser;
-    FATALIF(cache::set(ptr, fd, keyBuf, keyLen, bsonValue.Data(), bsonValue.Length(), &parser.val, &parser.valLen), -1, cache::exchange);
+    FATALIF(cache::set(ptr, fd, ns, keyBuf, keyLen, bsonValue.Data(), bsonValue.Length(), &parser.val, &parser.valLen, handle), -1, cache::exchange);
 
     if(parser.val) {
-        info.GetReturnValue().Set(parser.parse());
+        info.GetReturnValue().Set(parse(ptr, parser));
     }
 }
 
-// fastGet(instance, key)
+// fastGet(instance, key, [options])
 static NAN_METHOD(fastGet) {
     Local<Object> holder = Local<Object>::Cast(info[0]);
-    PROPERTY_SCOPE(info[1]->ToString(), holder, ptr, fd, keyLen, keyBuf);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
+    uint32_t timeout = timeoutOf(info, 2);
 
-    bson::BSONParser parser;
+    NEAR_GET(holder, ptr, ns, keyLen, keyBuf, handle, parser, cache::fast_get(ptr, fd, ns, keyBuf, keyLen, parser.val, parser.valLen, handle, timeout));
+}
 
-    cache::fast_get(ptr, fd, keyBuf, keyLen, parser.val, parser.valLen);
+// getOrLock(instance, key, [leaseMs])
+// returns the value of the key. If the key is absent, undefined is returned and the calling
+// thread holds a lease on the key until it is set or deleted, or until the lease expires.
+// Other threads and processes calling getOrLock meanwhile wait for the value.
+static NAN_METHOD(getOrLock) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
+    uint32_t leaseMs = info.Length() > 2 && !info[2]->IsUndefined() ? info[2]->Uint32Value() : 5000;
+
+    bson::BSONParser parser;
+    uint32_t seq, wait;
+    int ret;
+    while((ret = cache::get_or_lock(ptr, fd, ns, keyBuf, keyLen, leaseMs, parser.val, parser.valLen, seq, wait, handle)) == cache::LEASE_BUSY) {
+        cache::lease_wait(ptr, seq, wait);
+    }
+    FATALIF(ret, -1, cache::getOrLock);
 
     if(parser.val) {
-        info.GetReturnValue().Set(parser.parse());
+        info.GetReturnValue().Set(parse(ptr, parser));
     }
 }
 
+// copies the part of a value addressed by a path, while the value is read in place
+class PathReader {
+public:
+    const std::vector<bson::path_t>& path;
+    bson::location_t location;
+    int found;
+    std::vector<uint8_t> part;
+
+    static size_t read(void* value, size_t offset, uint8_t* dst, size_t len) {
+        return cache::read_value(*static_cast<const cache::value_t*>(value), offset, dst, len);
+    }
+
+    static void visit(PathReader* self, const cache::value_t& value) {
+        self->found = bson::seek(const_cast<cache::value_t*>(&value), read, value.length, self->path.data(), self->path.size(), self->location);
+        if(self->found != bson::SEEK_ABSENT) {
+            self->part.resize(self->location.length);
+            cache::read_value(value, self->location.offset, self->part.data(), self->location.length);
+        }
+    }
+
+    inline PathReader(const std::vector<bson::path_t>& path) : path(path), found(bson::SEEK_ABSENT) {}
+};
+
+// walks the rest of a path through parsed values
+static Local<Value> walk(Local<Value> value, Local<Array> path, uint32_t from) {
+    for(uint32_t i = from, len = path->Length(); i < len; i++) {
+        if(value->IsUndefined() || value->IsNull()) {
+            return Nan::Undefined();
+        }
+        value = value->ToObject()->Get(path->Get(i));
+    }
+    return value;
+}
+
+// getPath(instance, key, path, [options])
+// returns instance[key][path[0]][path[1]]..., without parsing the rest of the value if it is
+// written with the `indexed' option. Parts which are not indexed are parsed as a whole
+static NAN_METHOD(getPath) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
+    if(!info[2]->IsArray()) {
+        return Nan::ThrowTypeError("path should be an array");
+    }
+    Local<Array> steps = Local<Array>::Cast(info[2]);
+    uint32_t timeout = timeoutOf(info, 3);
+
+    std::vector<bson::path_t> path(steps->Length());
+    for(uint32_t i = 0; i < path.size(); i++) {
+        Local<Value> step = steps->Get(i);
+        bson::path_t& p = path[i];
+        p.isIndex = step->IsUint32();
+        p.index = p.isIndex ? step->Uint32Value() : 0;
+        Local<String> name = step->ToString();
+        p.name.resize(name->Length());
+        name->Write(p.name.data(), 0, p.name.size());
+        if(!p.isIndex && !p.name.empty() && p.name.size() <= 10 && (p.name[0] != '0' || p.name.size() == 1)) {
+            // names of indexes, such as '3'
+            uint64_t index = 0;
+            size_t j = 0;
+            for(; j < p.name.size() && p.name[j] >= '0' && p.name[j] <= '9'; j++) {
+                index = index * 10 + p.name[j] - '0';
+            }
+            if(j == p.name.size() && index < 0xffffffff) {
+                p.isIndex = true;
+                p.index = index;
+            }
+        }
+    }
+
+    PathReader reader(path);
+    int ret = cache::peek(ptr, fd, ns, keyBuf, keyLen, &reader, PathReader::visit, handle, timeout);
+    if(ret == -1) {
+        return ThrowTimeout();
+    }
+    if(reader.found == bson::SEEK_ABSENT) {
+        return;
+    }
+
+    LatencyTimer timer(ptr, cache::LATENCY_PARSE);
+    bool resolved;
+    Local<Value> value = bson::parse(reader.part.data(), reader.location.objects, &resolved);
+    timer.stop();
+    if(!resolved) {
+        // refers to objects out of the part, so the whole value is parsed
+        bson::BSONParser parser;
+        if(cache::fast_get(ptr, fd, ns, keyBuf, keyLen, parser.val, parser.valLen, handle, timeout) == -1) {
+            return ThrowTimeout();
+        }
+        if(!parser.val) {
+            return;
+        }
+        info.GetReturnValue().Set(walk(parse(ptr, parser), steps, 0));
+        return;
+    }
+    info.GetReturnValue().Set(reader.found == bson::SEEK_PARTIAL ? walk(value, steps, reader.location.depth) : value);
+}
+
 class EntriesDumper {
 public:
     Local<Object> entries;
     uint16_t key[256];
     size_t keyLen;
 
-    static void next(EntriesDumper* self, uint16_t* key, size_t keyLen, uint8_t* val) {
+    static void next(EntriesDumper* self, uint16_t* key, size_t keyLen, uint8_t* val, size_t valLen) {
         if(self->keyLen) {
             if(self->keyLen > keyLen || memcmp(self->key, key, self->keyLen << 1)) return;
         }
@@ -245,7 +809,7 @@ public:
 
 static NAN_METHOD(dump) {
     Local<Object> holder = Local<Object>::Cast(info[0]);
-    METHOD_SCOPE(holder, ptr, fd);
+    NS_SCOPE(holder, ptr, fd, ns);
     EntriesDumper dumper;
 
     if(info.Length() > 1 && info[1]->BooleanValue()) {
@@ -261,31 +825,711 @@ static NAN_METHOD(dump) {
     }
 
 
-    cache::dump(ptr, fd, &dumper, EntriesDumper::next);
+    cache::dump(ptr, fd, ns, &dumper, EntriesDumper::next);
     info.GetReturnValue().Set(dumper.entries);
 }
 
+// an operation run on the threadpool, so that the event loop never waits for other processes
+// holding the lock. Values are converted from and to V8 objects on the main thread
+class CacheWorker : public Nan::AsyncWorker {
+protected:
+    void* ptr;
+    HANDLE fd;
+    uint32_t ns;
+    uint16_t key[256];
+    size_t keyLen;
+    cache::handle_t handle; // a copy, as the handle may be used by the main thread meanwhile
+    cache::handle_t* pHandle;
+
+    // the holder is kept until the operation completes
+    CacheWorker(Nan::Callback* callback, Local<Object> holder, void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const cache::handle_t* handle) :
+        Nan::AsyncWorker(callback), ptr(ptr), fd(fd), ns(ns), keyLen(keyLen), pHandle(handle ? &this->handle : NULL) {
+        SaveToPersistent("holder", holder);
+        memcpy(this->key, key, keyLen << 1);
+        if(handle) {
+            this->handle = *handle;
+        }
+    }
+
+    void SetErrno(const char* method) {
+        char sbuf[64];
+        sprintf(sbuf, "`%s' failed with code %d", method, errno);
+        SetErrorMessage(sbuf);
+    }
+};
+
+class GetWorker : public CacheWorker {
+    bool fast;
+    NearCache* nearCache;
+    uint64_t generation;
+    bson::BSONParser parser;
+
+public:
+    GetWorker(Nan::Callback* callback, Local<Object> holder, void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const cache::handle_t* handle, bool fast, NearCache* nearCache, uint64_t generation) :
+        CacheWorker(callback, holder, ptr, fd, ns, key, keyLen, handle), fast(fast), nearCache(nearCache), generation(generation) {}
+
+    void Execute() {
+        if(fast) {
+            cache::fast_get(ptr, fd, ns, key, keyLen, parser.val, parser.valLen, pHandle);
+        } else {
+            cache::get(ptr, fd, ns, key, keyLen, parser.val, parser.valLen, pHandle);
+        }
+    }
+
+    void HandleOKCallback() {
+        Nan::HandleScope scope;
+        Local<Value> argv[] = {Nan::Null(), Nan::Undefined()};
+        if(parser.val) {
+            argv[1] = parse(ptr, parser);
+            if(nearCache) {
+                nearCache->set(ns, key, keyLen, generation, argv[1]);
+            }
+        }
+        callback->Call(2, argv);
+    }
+};
+
+class SetWorker : public CacheWorker {
+    bson::BSONValue* value;
+
+public:
+    SetWorker(Nan::Callback* callback, Local<Object> holder, void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const cache::handle_t* handle, bson::BSONValue* value) :
+        CacheWorker(callback, holder, ptr, fd, ns, key, keyLen, handle), value(value) {}
+
+    ~SetWorker() {
+        delete value;
+    }
+
+    void Execute() {
+        if(cache::set(ptr, fd, ns, key, keyLen, value->Data(), value->Length(), NULL, NULL, pHandle) == -1) {
+            SetErrno("cache::set");
+        }
+    }
+};
+
+class DumpWorker : public CacheWorker {
+    typedef std::pair<std::vector<uint16_t>, std::vector<uint8_t> > entry_t;
+    std::vector<entry_t> entries;
+
+    static void next(DumpWorker* self, uint16_t* key, size_t keyLen, uint8_t* val, size_t valLen) {
+        if(self->keyLen) {
+            if(self->keyLen > keyLen || memcmp(self->key, key, self->keyLen << 1)) return;
+        }
+        self->entries.push_back(entry_t(std::vector<uint16_t>(key, key + keyLen), std::vector<uint8_t>(val, val + valLen)));
+    }
+
+public:
+    // key is the prefix
+    DumpWorker(Nan::Callback* callback, Local<Object> holder, void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen) :
+        CacheWorker(callback, holder, ptr, fd, ns, key, keyLen, NULL) {}
+
+    void Execute() {
+        cache::dump(ptr, fd, ns, this, next);
+    }
+
+    void HandleOKCallback() {
+        Nan::HandleScope scope;
+        Local<Object> ret = Nan::New<Object>();
+        for(size_t i = 0; i < entries.size(); i++) {
+            const entry_t& entry = entries[i];
+            ret->Set(Nan::New<String>(entry.first.data(), entry.first.size()).ToLocalChecked(), bson::parse(&entry.second[0]));
+        }
+        Local<Value> argv[] = {Nan::Null(), ret};
+        callback->Call(2, argv);
+    }
+};
+
+#define ASYNC_CALLBACK(callback) if(!info[info.Length() - 1]->IsFunction()) {\
+        return Nan::ThrowTypeError("callback should be a function");\
+    }\
+    Nan::Callback* callback = new Nan::Callback(Local<Function>::Cast(info[info.Length() - 1]))
+
+// getAsync(instance, key, callback), fastGetAsync(instance, key, callback)
+// callback is called with an error, and the value
+static void queueGet(const Nan::FunctionCallbackInfo<Value>& info, bool fast) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
+    ASYNC_CALLBACK(callback);
+
+    // values kept in the near cache are returned without going to the threadpool
+    NearCache* nearCache = NEAR_CACHE(holder);
+    uint64_t generation = 0;
+    if(nearCache) {
+        generation = cache::generation(ptr, ns, keyBuf, keyLen, handle);
+        Local<Value> cached = nearCache->get(ns, keyBuf, keyLen, generation);
+        if(!cached.IsEmpty()) {
+            Local<Value> argv[] = {Nan::Null(), cached};
+            callback->Call(2, argv);
+            delete callback;
+            return;
+        }
+    }
+
+    Nan::AsyncQueueWorker(new GetWorker(callback, holder, ptr, fd, ns, keyBuf, keyLen, handle, fast, nearCache, generation));
+}
+
+static NAN_METHOD(getAsync) {
+    queueGet(info, false);
+}
+
+static NAN_METHOD(fastGetAsync) {
+    queueGet(info, true);
+}
+
+// setAsync(instance, key, val, callback)
+static NAN_METHOD(setAsync) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    KEY_SCOPE(info[1], holder, ptr, fd, ns, keyLen, keyBuf, handle);
+    ASYNC_CALLBACK(callback);
+
+    LatencyTimer timer(ptr, cache::LATENCY_SERIALIZE);
+    bson::BSONValue* value = new bson::BSONValue(info[2], FORMAT(holder));
+    timer.stop();
+    Nan::AsyncQueueWorker(new SetWorker(callback, holder, ptr, fd, ns, keyBuf, keyLen, handle, value));
+}
+
+// dumpAsync(instance, [prefix], callback)
+static NAN_METHOD(dumpAsync) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    NS_SCOPE(holder, ptr, fd, ns);
+    ASYNC_CALLBACK(callback);
+
+    uint16_t prefix[256];
+    int prefixLen = 0;
+    if(info.Length() > 2 && info[1]->BooleanValue()) {
+        Local<String> str = info[1]->ToString();
+        prefixLen = str->Length();
+        if(prefixLen > 256) { // nothing matches
+            Local<Value> argv[] = {Nan::Null(), Nan::New<Object>()};
+            callback->Call(2, argv);
+            delete callback;
+            return;
+        }
+        str->Write(prefix);
+    }
+    Nan::AsyncQueueWorker(new DumpWorker(callback, holder, ptr, fd, ns, prefix, prefixLen));
+}
+
+// namespace(holder, name, [quota])
+// returns an instance which accesses keys of the namespace
+static NAN_METHOD(namespace_) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    METHOD_SCOPE(holder, ptr, fd);
+
+    Local<String> name = info[1]->ToString();
+    int nameLen = name->Length();
+    if(!nameLen || nameLen > NAMESPACE_NAME_MAX) {
+        return Nan::ThrowError("length of namespace name should be between 1 and 32");
+    }
+    uint16_t nameBuf[NAMESPACE_NAME_MAX];
+    name->Write(nameBuf, 0, nameLen);
+
+    uint32_t quota;
+    bool hasQuota = info.Length() > 2 && !info[2]->IsUndefined();
+    if(hasQuota) {
+        quota = info[2]->Uint32Value();
+    }
+
+    int id;
+    FATALIF(id = cache::namespace_open(ptr, fd, nameBuf, nameLen, hasQuota ? &quota : NULL), -1, cache::namespace_open);
+
+    Local<Object> instance = Nan::NewInstance(Nan::New(templates->instance)).ToLocalChecked();
+    Nan::SetInternalFieldPointer(instance, 0, ptr);
+    instance->SetInternalField(1, holder->GetInternalField(1));
+    instance->SetInternalField(2, Nan::New(id));
+    Nan::SetInternalFieldPointer(instance, 3, NEAR_CACHE(holder));
+    instance->SetInternalField(4, holder->GetInternalField(4));
+    instance->SetInternalField(5, holder->GetInternalField(5));
+    info.GetReturnValue().Set(instance);
+}
+
+// key(holder, name)
+// returns a handle of the key, which can be passed to methods instead of the name
+static NAN_METHOD(key) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    // keys are prepared without the lock
+    Local<String> property = info[1]->ToString();
+    int keyLen = property->Length();
+    void* ptr = Nan::GetInternalFieldPointer(holder, 0);
+    uint32_t ns = holder->GetInternalField(2)->Uint32Value();
+    CHECK_KEY_LENGTH(ptr, keyLen);
+    uint16_t keyBuf[256];
+    property->Write(keyBuf);
+
+    Local<Object> buffer = Nan::NewBuffer(sizeof(key_handle_t)).ToLocalChecked();
+    key_handle_t& keyHandle = *reinterpret_cast<key_handle_t*>(node::Buffer::Data(buffer));
+    keyHandle.ptr = ptr;
+    keyHandle.ns = ns;
+    keyHandle.keyLen = keyLen;
+    memcpy(keyHandle.key, keyBuf, keyLen << 1);
+    cache::make_handle(ptr, ns, keyBuf, keyLen, keyHandle.handle);
+
+    Local<Object> instance = Nan::NewInstance(Nan::New(templates->key)->InstanceTemplate()).ToLocalChecked();
+    Nan::SetInternalFieldPointer(instance, 0, &keyHandle);
+    instance->SetInternalField(1, buffer);
+    instance->SetInternalField(2, holder->GetInternalField(5));
+    info.GetReturnValue().Set(instance);
+}
+
 static NAN_METHOD(clear) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    NS_SCOPE(holder, ptr, fd, ns);
+    cache::clear(ptr, fd, ns);
+}
+
+// stats(holder)
+// returns counters of the whole cache, which are shared by all namespaces
+static NAN_METHOD(stats) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    METHOD_SCOPE(holder, ptr, fd);
+
+    cache::stats_t stats;
+    cache::stats(ptr, fd, stats);
+    const cache::counters_t& counters = stats.counters;
+
+    Local<Object> ret = Nan::New<Object>();
+#define SET_STAT(name, value) Nan::Set(ret, Nan::New(name).ToLocalChecked(), Nan::New<Number>(double(value)))
+    SET_STAT("gets", counters.gets);
+    SET_STAT("hits", counters.hits);
+    SET_STAT("misses", counters.misses);
+    SET_STAT("sets", counters.sets);
+    SET_STAT("deletes", counters.deletes);
+    SET_STAT("evictions", counters.evictions);
+    SET_STAT("evictedBytes", counters.evicted_bytes);
+    SET_STAT("allocatedBlocks", counters.allocated_blocks);
+    SET_STAT("allocationScans", counters.allocation_scans);
+    SET_STAT("allocationWraps", counters.allocation_wraps);
+    SET_STAT("lookups", counters.lookups);
+    SET_STAT("probes", counters.probes);
+    SET_STAT("lockTimeouts", counters.lock_timeouts);
+    SET_STAT("compactions", counters.compactions);
+    SET_STAT("blockSize", stats.block_size);
+    SET_STAT("blocksAvailable", stats.blocks_available);
+    SET_STAT("blocksUsed", stats.blocks_used);
+    SET_STAT("smallSlots", stats.small_slots);
+    SET_STAT("smallUsed", stats.small_used);
+    SET_STAT("slabClasses", stats.slab_classes);
+    SET_STAT("slabPages", stats.slab_pages);
+    SET_STAT("slabPagesFree", stats.slab_pages_free);
+    SET_STAT("pinnedBlocks", stats.pinned_blocks);
+    SET_STAT("changeLog", stats.log_size);
+    SET_STAT("logPosition", stats.log_position);
+#undef SET_STAT
+    info.GetReturnValue().Set(ret);
+}
+
+// fragmentation(holder)
+// returns the number of values in blocks, of those chained, and of those whose blocks are not in a row
+static NAN_METHOD(fragmentation) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    METHOD_SCOPE(holder, ptr, fd);
+
+    cache::fragmentation_t fragmentation;
+    cache::fragmentation(ptr, fd, fragmentation);
+
+    Local<Object> ret = Nan::New<Object>();
+    Nan::Set(ret, Nan::New("values").ToLocalChecked(), Nan::New<Number>(fragmentation.values));
+    Nan::Set(ret, Nan::New("chained").ToLocalChecked(), Nan::New<Number>(fragmentation.chained));
+    Nan::Set(ret, Nan::New("fragmented").ToLocalChecked(), Nan::New<Number>(fragmentation.fragmented));
+    info.GetReturnValue().Set(ret);
+}
+
+// compact(holder, [budget])
+// moves fragmented values into blocks in a row for at most `budget' milliseconds, and returns
+// the number of values moved
+static NAN_METHOD(compact) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    METHOD_SCOPE(holder, ptr, fd);
+
+    uint32_t budget = info.Length() > 1 && !info[1]->IsUndefined() ? info[1]->Uint32Value() : 10;
+    info.GetReturnValue().Set(Nan::New<Number>(cache::compact(ptr, fd, budget)));
+}
+
+static Local<Object> logPart(uint64_t cursor, const std::vector<uint8_t>& records, size_t len) {
+    Local<Object> ret = Nan::New<Object>();
+    Nan::Set(ret, Nan::New("cursor").ToLocalChecked(), Nan::New<Number>(double(cursor)));
+    Nan::Set(ret, Nan::New("records").ToLocalChecked(), Nan::CopyBuffer(len ? reinterpret_cast<const char*>(&records[0]) : "", len).ToLocalChecked());
+    return ret;
+}
+
+// readLog(instance, [cursor], [maxBytes])
+// returns {cursor, records} with records of the change log appended from cursor, and the cursor to
+// read from next. Without a cursor, reading starts from the current position. Returns null if
+// records after cursor are overwritten, in which case the cache should be taken a snapshot of again
+static NAN_METHOD(readLog) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    METHOD_SCOPE(holder, ptr, fd);
+
+    std::vector<uint8_t> records;
+    uint64_t cursor;
+    if(info.Length() < 2 || info[1]->IsUndefined()) {
+        cache::stats_t stats;
+        cache::stats(ptr, fd, stats);
+        if(!stats.log_size) {
+            return Nan::ThrowError("the cache has no change log");
+        }
+        return info.GetReturnValue().Set(logPart(stats.log_position, records, 0));
+    }
+    cursor = info[1]->NumberValue();
+    records.resize(info.Length() > 2 && !info[2]->IsUndefined() ? info[2]->Uint32Value() : 1048576);
+    long ret;
+    while((ret = cache::log_read(ptr, fd, cursor, records.empty() ? NULL : &records[0], records.size())) == -1 && errno == ENOBUFS) {
+        records.resize(records.size() ? records.size() << 1 : 1024); // a single record is larger
+    }
+    if(ret == -1 && errno == ERANGE) {
+        return info.GetReturnValue().Set(Nan::Null());
+    } else if(ret == -1 && errno == ENOTSUP) {
+        return Nan::ThrowError("the cache has no change log");
+    }
+    FATALIF(ret, -1, cache::log_read);
+    info.GetReturnValue().Set(logPart(cursor, records, ret));
+}
+
+static void appendRecord(std::vector<uint8_t>* records, const uint8_t* record, size_t len) {
+    records->insert(records->end(), record, record + len);
+}
+
+// snapshot(instance)
+// returns {cursor, records} with records which clear a cache and set all entries of this one, as
+// they are stored, and the cursor which the change log is read from after them
+static NAN_METHOD(snapshot) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    METHOD_SCOPE(holder, ptr, fd);
+
+    std::vector<uint8_t> records;
+    uint64_t cursor = cache::snapshot(ptr, fd, &records, appendRecord);
+    info.GetReturnValue().Set(logPart(cursor, records, records.size()));
+}
+
+// applyLog(instance, records, [options])
+// applies records read from a change log or a snapshot, and returns the number of bytes applied,
+// which is less than the length of records if the last one is cut
+static NAN_METHOD(applyLog) {
+    Local<Object> holder = Local<Object>::Cast(info[0]);
+    METHOD_SCOPE(holder, ptr, fd);
+    if(!node::Buffer::HasInstance(info[1])) {
+        return Nan::ThrowTypeError("records should be a buffer");
+    }
+    long ret = cache::log_apply(ptr, fd, reinterpret_cast<const uint8_t*>(node::Buffer::Data(info[1])), node::Buffer::Length(info[1]), timeoutOf(info, 2));
+    if(ret == -1 && errno == ETIMEDOUT) {
+        return ThrowTimeout();
+    } else if(ret == -1 && errno == EINVAL) {
+        return Nan::ThrowError("malformed record of change log");
+    }
+    FATALIF(ret, -1, cache::log_apply);
+    info.GetReturnValue().Set(Nan::New<Number>(double(ret)));
+}
+
+static Local<Object> latencyOf(const cache::latency_t& histogram) {
+    static const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+    static const char* names[] = {"p50", "p90", "p99", "p999"};
+
+    Local<Object> ret = Nan::New<Object>();
+    Nan::Set(ret, Nan::New("count").ToLocalChecked(), Nan::New<Number>(double(histogram.count)));
+    Nan::Set(ret, Nan::New("mean").ToLocalChecked(), Nan::New<Number>(histogram.count ? histogram.sum / 1e3 / histogram.count : 0));
+
+    // other processes may record while the histograms are copied, so buckets may not add up to the count
+    uint64_t seen = 0, max = 0;
+    uint32_t p = 0;
+    for(uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        if(!histogram.buckets[i]) continue;
+        seen += histogram.buckets[i];
+        max = cache::latency_value(i);
+        for(; p < 4 && seen > uint64_t(histogram.count * percentiles[p]); p++) {
+            Nan::Set(ret, Nan::New(names[p]).ToLocalChecked(), Nan::New<Number>(max / 1e3));
+        }
+    }
+    for(; p < 4; p++) {
+        Nan::Set(ret, Nan::New(names[p]).ToLocalChecked(), Nan::New<Number>(max / 1e3));
+    }
+    Nan::Set(ret, Nan::New("max").ToLocalChecked(), Nan::New<Number>(max / 1e3));
+    return ret;
+}
+
+// latency(holder, [enabled])
+// returns latency histograms of the cache in microseconds. Recording is switched for all
+// processes if `enabled' is given
+static NAN_METHOD(latency) {
     Local<Object> holder = Local<Object>::Cast(info[0]);
     METHOD_SCOPE(holder, ptr, fd);
-    cache::clear(ptr, fd);
+
+    if(info.Length() > 1 && !info[1]->IsUndefined()) {
+        cache::latency_enable(ptr, fd, info[1]->BooleanValue());
+    }
+
+    static const char* ops[] = {"get", "fastGet", "set", "delete", "scan"};
+    std::vector<cache::latency_t> histograms(cache::LATENCY_HISTOGRAMS);
+    cache::latency(ptr, fd, &histograms[0]);
+
+    Local<Object> ret = Nan::New<Object>();
+    Nan::Set(ret, Nan::New("enabled").ToLocalChecked(), Nan::New<Boolean>(cache::latency_enabled(ptr)));
+    for(uint32_t i = 0; i < cache::LATENCY_OPS; i++) {
+        Local<Object> op = Nan::New<Object>();
+        Nan::Set(op, Nan::New("lock").ToLocalChecked(), latencyOf(histograms[(i << 1) + cache::LATENCY_LOCK]));
+        Nan::Set(op, Nan::New("hold").ToLocalChecked(), latencyOf(histograms[(i << 1) + cache::LATENCY_HOLD]));
+        Nan::Set(ret, Nan::New(ops[i]).ToLocalChecked(), op);
+    }
+    Nan::Set(ret, Nan::New("serialize").ToLocalChecked(), latencyOf(histograms[cache::LATENCY_SERIALIZE]));
+    Nan::Set(ret, Nan::New("parse").ToLocalChecked(), latencyOf(histograms[cache::LATENCY_PARSE]));
+    info.GetReturnValue().Set(ret);
+}
+
+// new Queue(name, capacity, [messageSize])
+// opens the queue named `name', which is created if absent. If capacity is 0, an existing queue is opened
+static NAN_METHOD(createQueue) {
+    if(!info.IsConstructCall()) {
+        return Nan::ThrowError("Illegal constructor");
+    }
+
+    uint32_t capacity = info[1]->Uint32Value();
+    uint32_t messageSize = info.Length() > 2 && !info[2]->IsUndefined() ? info[2]->Uint32Value() : 256;
+    if(capacity && !queue::size_of(capacity, messageSize)) {
+        return Nan::ThrowError("capacity and message size should be between 1 and 16M, and the queue should not be larger than 4GB");
+    }
+
+    shared_queue_t queue;
+    int ret = shared_queue_open(&queue, *Nan::Utf8String(info[0]), capacity, messageSize);
+    if(ret == SHARED_CACHE_ESIZE) {
+        return Nan::ThrowError("queue initialized with different capacity or message size");
+    } else if(ret == SHARED_CACHE_ELAYOUT) {
+        return Nan::ThrowError("queue initialization failed, maybe it has been initialized with different message size");
+    } else if(ret == SHARED_CACHE_ERROR && !capacity && errno == ENOENT) {
+        return Nan::ThrowError("queue not found");
+    }
+    FATALIF(ret, SHARED_CACHE_ERROR, shared_queue_open);
+
+    Nan::SetInternalFieldPointer(info.Holder(), 0, queue.ptr);
+}
+
+#define QUEUE_SCOPE(holder, ptr) if(!Nan::New(templates->queue)->HasInstance(holder)) {\
+        return Nan::ThrowTypeError("first argument should be a queue");\
+    }\
+    void* ptr = Nan::GetInternalFieldPointer(Local<Object>::Cast(holder), 0)
+
+// messages popped from a queue, which are copied out of their cells and parsed afterwards
+class Messages {
+    std::vector<std::vector<uint8_t> > messages;
+
+public:
+    static void next(Messages* self, const uint8_t* val, size_t valLen) {
+        self->messages.push_back(std::vector<uint8_t>(val, val + valLen));
+    }
+
+    uint32_t pop(void* ptr, uint32_t max, uint32_t timeout) {
+        return queue::pop(ptr, max, timeout, this, next);
+    }
+
+    Local<Array> parse() {
+        Local<Array> ret = Nan::New<Array>(messages.size());
+        for(size_t i = 0; i < messages.size(); i++) {
+            Nan::Set(ret, i, bson::parse(&messages[i][0]));
+        }
+        return ret;
+    }
+};
+
+static int pushValues(void* ptr, Local<Value>* values, uint32_t count) {
+    std::vector<bson::BSONValue*> serialized(count);
+    std::vector<const uint8_t*> vals(count);
+    std::vector<size_t> lens(count);
+    for(uint32_t i = 0; i < count; i++) {
+        serialized[i] = new bson::BSONValue(values[i]);
+        vals[i] = serialized[i]->Data();
+        lens[i] = serialized[i]->Length();
+    }
+    int ret = queue::push(ptr, &vals[0], &lens[0], count);
+    for(uint32_t i = 0; i < count; i++) {
+        delete serialized[i];
+    }
+    return ret;
+}
+
+// push(queue, value)
+// returns false if the queue is full
+static NAN_METHOD(push) {
+    QUEUE_SCOPE(info[0], ptr);
+    Local<Value> value = info[1];
+    int ret = pushValues(ptr, &value, 1);
+    if(ret == -1) {
+        return Nan::ThrowRangeError("message is larger than the message size of the queue");
+    }
+    info.GetReturnValue().Set(Nan::New<Boolean>(ret == 1));
+}
+
+// pushMany(queue, values)
+// pushes values in order, and returns the number pushed, which is less than values.length if the queue is full
+static NAN_METHOD(pushMany) {
+    QUEUE_SCOPE(info[0], ptr);
+    if(!info[1]->IsArray()) {
+        return Nan::ThrowTypeError("values should be an array");
+    }
+    Local<Array> arr = Local<Array>::Cast(info[1]);
+    uint32_t count = arr->Length();
+    if(!count) {
+        return info.GetReturnValue().Set(Nan::New<Number>(0));
+    }
+    std::vector<Local<Value> > values(count);
+    for(uint32_t i = 0; i < count; i++) {
+        values[i] = Nan::Get(arr, i).ToLocalChecked();
+    }
+    int ret = pushValues(ptr, &values[0], count);
+    if(ret == -1) {
+        return Nan::ThrowRangeError("message is larger than the message size of the queue");
+    }
+    info.GetReturnValue().Set(Nan::New<Number>(ret));
+}
+
+static inline uint32_t popTimeout(const Nan::FunctionCallbackInfo<Value>& info, int index) {
+    return info.Length() > index && !info[index]->IsUndefined() && !info[index]->IsFunction() ? info[index]->Uint32Value() : 0;
+}
+
+// pop(queue, [timeout])
+// returns the first message, or undefined if the queue is still empty after `timeout' milliseconds
+static NAN_METHOD(pop) {
+    QUEUE_SCOPE(info[0], ptr);
+    Messages messages;
+    if(messages.pop(ptr, 1, popTimeout(info, 1))) {
+        info.GetReturnValue().Set(Nan::Get(messages.parse(), 0).ToLocalChecked());
+    }
+}
+
+// popMany(queue, max, [timeout])
+// returns at most `max' messages, which is empty if the queue is still empty after `timeout' milliseconds
+static NAN_METHOD(popMany) {
+    QUEUE_SCOPE(info[0], ptr);
+    Messages messages;
+    messages.pop(ptr, info[1]->Uint32Value(), popTimeout(info, 2));
+    info.GetReturnValue().Set(messages.parse());
+}
+
+// waits for messages on the threadpool, so that the event loop is not blocked
+class PopWorker : public Nan::AsyncWorker {
+    void* ptr;
+    uint32_t max;
+    uint32_t timeout;
+    bool many;
+    Messages messages;
+
+public:
+    PopWorker(Nan::Callback* callback, Local<Object> holder, void* ptr, uint32_t max, uint32_t timeout, bool many) :
+        Nan::AsyncWorker(callback), ptr(ptr), max(max), timeout(timeout), many(many) {
+        SaveToPersistent("holder", holder);
+    }
+
+    void Execute() {
+        messages.pop(ptr, max, timeout);
+    }
+
+    void HandleOKCallback() {
+        Nan::HandleScope scope;
+        Local<Array> popped = messages.parse();
+        Local<Value> argv[] = {Nan::Null(), many ? Local<Value>(popped) : popped->Length() ? Nan::Get(popped, 0).ToLocalChecked() : Local<Value>(Nan::Undefined())};
+        callback->Call(2, argv);
+    }
+};
+
+// popAsync(queue, [timeout], callback)
+// callback is called with an error, and the first message, or undefined if the queue is still
+// empty after `timeout' milliseconds, which is forever by default
+static NAN_METHOD(popAsync) {
+    QUEUE_SCOPE(info[0], ptr);
+    ASYNC_CALLBACK(callback);
+    uint32_t timeout = info.Length() > 2 ? popTimeout(info, 1) : TIMEOUT_INFINITE;
+    Nan::AsyncQueueWorker(new PopWorker(callback, Local<Object>::Cast(info[0]), ptr, 1, timeout, false));
+}
+
+// popManyAsync(queue, max, [timeout], callback)
+static NAN_METHOD(popManyAsync) {
+    QUEUE_SCOPE(info[0], ptr);
+    ASYNC_CALLBACK(callback);
+    uint32_t timeout = info.Length() > 3 ? popTimeout(info, 2) : TIMEOUT_INFINITE;
+    Nan::AsyncQueueWorker(new PopWorker(callback, Local<Object>::Cast(info[0]), ptr, info[1]->Uint32Value(), timeout, true));
+}
+
+// queueStats(queue)
+static NAN_METHOD(queueStats) {
+    QUEUE_SCOPE(info[0], ptr);
+    queue::stats_t stats;
+    queue::stats(ptr, stats);
+
+    Local<Object> ret = Nan::New<Object>();
+#define SET_STAT(name, value) Nan::Set(ret, Nan::New(name).ToLocalChecked(), Nan::New<Number>(double(value)))
+    SET_STAT("capacity", stats.capacity);
+    SET_STAT("messageSize", stats.message_size);
+    SET_STAT("pushed", stats.pushed);
+    SET_STAT("popped", stats.popped);
+    SET_STAT("length", stats.pushed - stats.popped);
+    SET_STAT("waiters", stats.waiters);
+#undef SET_STAT
+    info.GetReturnValue().Set(ret);
 }
 
 void init(Handle<Object> exports) {
+    templates = new templates_t;
 
     Local<FunctionTemplate> constructor = Nan::New<FunctionTemplate>(create);
     Local<ObjectTemplate> inst = constructor->InstanceTemplate();
-    inst->SetInternalFieldCount(2); // ptr, fd (synchronization object)
+    inst->SetInternalFieldCount(6); // ptr, fd (synchronization object), namespace, near cache, format, Cache instance
     Nan::SetNamedPropertyHandler(inst, getter, setter, querier, deleter, enumerator);
+    templates->instance.Reset(inst);
+
+    Local<FunctionTemplate> keyConstructor = Nan::New<FunctionTemplate>();
+    keyConstructor->SetClassName(Nan::New("Key").ToLocalChecked());
+    keyConstructor->InstanceTemplate()->SetInternalFieldCount(3); // key_handle_t, the buffer holding it, and the Cache instance
+    templates->key.Reset(keyConstructor);
+
+    Local<FunctionTemplate> queueConstructor = Nan::New<FunctionTemplate>(createQueue);
+    queueConstructor->SetClassName(Nan::New("Queue").ToLocalChecked());
+    queueConstructor->InstanceTemplate()->SetInternalFieldCount(1); // ptr
+    templates->queue.Reset(queueConstructor);
     
     Nan::Set(exports, Nan::New("Cache").ToLocalChecked(), constructor->GetFunction());
     Nan::SetMethod(exports, "release", release);
+    Nan::SetMethod(exports, "get", get);
+    Nan::SetMethod(exports, "set", set);
     Nan::SetMethod(exports, "increase", increase);
     Nan::SetMethod(exports, "exchange", exchange);
     Nan::SetMethod(exports, "fastGet", fastGet);
+    Nan::SetMethod(exports, "getOrLock", getOrLock);
+    Nan::SetMethod(exports, "getPath", getPath);
+    Nan::SetMethod(exports, "hset", hset);
+    Nan::SetMethod(exports, "hget", hget);
+    Nan::SetMethod(exports, "hdel", hdel);
+    Nan::SetMethod(exports, "hgetall", hgetall);
+    Nan::SetMethod(exports, "hincr", hincr);
+    Nan::SetMethod(exports, "transaction", transaction);
     Nan::SetMethod(exports, "clear", clear);
     Nan::SetMethod(exports, "dump", dump);
+    Nan::SetMethod(exports, "namespace", namespace_);
+    Nan::SetMethod(exports, "key", key);
+    Nan::SetMethod(exports, "stats", stats);
+    Nan::SetMethod(exports, "latency", latency);
+    Nan::SetMethod(exports, "fragmentation", fragmentation);
+    Nan::SetMethod(exports, "compact", compact);
+    Nan::SetMethod(exports, "readLog", readLog);
+    Nan::SetMethod(exports, "snapshot", snapshot);
+    Nan::SetMethod(exports, "applyLog", applyLog);
+    Nan::SetMethod(exports, "getAsync", getAsync);
+    Nan::SetMethod(exports, "fastGetAsync", fastGetAsync);
+    Nan::SetMethod(exports, "setAsync", setAsync);
+    Nan::SetMethod(exports, "dumpAsync", dumpAsync);
+
+    Nan::Set(exports, Nan::New("Queue").ToLocalChecked(), queueConstructor->GetFunction());
+    Nan::SetMethod(exports, "push", push);
+    Nan::SetMethod(exports, "pushMany", pushMany);
+    Nan::SetMethod(exports, "pop", pop);
+    Nan::SetMethod(exports, "popMany", popMany);
+    Nan::SetMethod(exports, "popAsync", popAsync);
+    Nan::SetMethod(exports, "popManyAsync", popManyAsync);
+    Nan::SetMethod(exports, "queueStats", queueStats);
 }
 
 
+#ifdef NODE_MODULE_INIT
+// context aware, so that worker threads can load the module
+NODE_MODULE_INIT() {
+    init(exports);
+}
+#else
 NODE_MODULE(binding, init)
+#endif
@@ -2,27 +2,70 @@
 
 #include<nan.h>
 #include<string.h>
+#include<map>
+#include<vector>
+
+// typed arrays, Map and Set are serialized since node 6, and BigInt since V8 6.8 (node 10.4).
+// Other versions write them as plain objects, and undefined respectively
+#if (NODE_MODULE_VERSION >= NODE_6_0_MODULE_VERSION)
+#define EXTENDED_TYPES
+#endif
+#if (V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 8))
+#define BIGINT_TYPE
+#endif
 
 typedef struct object_wrapper_s {
     v8::Handle<v8::Object> object;
     uint32_t index;
     object_wrapper_s* next;
 
-    object_wrapper_s(v8::Handle<v8::Object> obj, object_wrapper_s* curr) :
-        object(obj), index(curr ? curr->index + 1 : 0), next(curr) {}
+    object_wrapper_s(v8::Handle<v8::Object> obj, object_wrapper_s* curr, uint32_t first = 0) :
+        object(obj), index(curr ? curr->index + 1 : first), next(curr) {}
 } object_wrapper_t;
 
+// objects parsed so far, which are numbered from `first', and keys of the shape table
+typedef struct objects_s {
+    object_wrapper_t* head;
+    uint32_t first;
+    bool resolved; // false if a reference to an object before `first', or a missing shape is met
+    std::vector<std::vector<v8::Local<v8::Value> > > shapes;
+
+    inline objects_s(uint32_t first) : head(NULL), first(first), resolved(true) {}
+
+    inline ~objects_s() {
+        while(head) {
+            object_wrapper_t* next = head->next;
+            delete head;
+            head = next;
+        }
+    }
+
+    inline void add(v8::Handle<v8::Object> obj) {
+        head = new object_wrapper_t(obj, head, first);
+    }
+} objects_t;
+
 typedef struct writer_s {
     bool deleteOld;
     size_t capacity;
     size_t used;
     uint8_t* current;
+    uint8_t* begin;
+    uint32_t format;
 
     object_wrapper_t* objects;
 
+    // keys of every shape, as written in the table, and the shape table
+    std::map<std::vector<uint8_t>, uint32_t> shapeIds;
+    std::vector<uint8_t> shapeKeys;
+    std::vector<uint8_t> shapeTable;
+    // names of the last shape, which is usually the shape of the next object in arrays of records
+    std::vector<v8::Local<v8::Value> > lastNames;
+    uint32_t lastShape;
 
-    inline writer_s(bson::BSONValue& value) :
-        deleteOld(false), capacity(sizeof(value.cache)), used(0), current(value.cache), objects(NULL) {}
+
+    inline writer_s(bson::BSONValue& value, uint32_t format) :
+        deleteOld(false), capacity(sizeof(value.cache)), used(0), current(value.cache), begin(value.cache), format(format), objects(NULL), lastShape(0) {}
 
     inline void ensureCapacity(size_t required) {
         required += used;
@@ -47,11 +90,119 @@ typedef struct writer_s {
         else deleteOld = true;
 
         current = new_pointer + used;
+        begin = new_pointer;
 
         // set used to required + used
         used = required;
     }
 
+    inline void writeLength(size_t len) {
+        ensureCapacity(sizeof(uint32_t));
+        *reinterpret_cast<uint32_t*>(current) = len;
+        current += sizeof(uint32_t);
+    }
+
+    // writes a value whose objects are shaped, followed by the shape table
+    void writeShaped(v8::Handle<v8::Value> value) {
+        ensureCapacity(1);
+        *(current++) = bson::Shapes;
+        ensureCapacity(sizeof(uint32_t));
+        size_t header = current - begin;
+        current += sizeof(uint32_t);
+        size_t first = current - begin;
+        write(value);
+        *reinterpret_cast<uint32_t*>(begin + header) = current - begin - first;
+        writeLength(shapeIds.size());
+        ensureCapacity(shapeTable.size());
+        memcpy(current, shapeTable.data(), shapeTable.size());
+        current += shapeTable.size();
+    }
+
+    // returns the shape of keys, which is added to the table if absent
+    inline uint32_t shapeOf(v8::Local<v8::Array> names, uint32_t len) {
+        using namespace v8;
+        uint32_t i = 0;
+        if(len && lastNames.size() == len) {
+            for(; i < len && names->Get(i)->StrictEquals(lastNames[i]); i++);
+            if(i == len) {
+                return lastShape;
+            }
+        }
+        lastNames.resize(len);
+        shapeKeys.clear();
+        for(i = 0; i < len; i++) {
+            Local<Value> name = lastNames[i] = names->Get(i);
+            size_t pos = shapeKeys.size();
+            if(name->IsInt32()) {
+                shapeKeys.resize(pos + 1 + sizeof(int32_t));
+                shapeKeys[pos] = bson::Int32;
+                *reinterpret_cast<int32_t*>(&shapeKeys[pos + 1]) = name->Int32Value();
+            } else {
+                Local<String> str = name->ToString();
+                size_t strLen = str->Length() << 1;
+                shapeKeys.resize(pos + 1 + sizeof(uint32_t) + strLen);
+                shapeKeys[pos] = bson::String;
+                *reinterpret_cast<uint32_t*>(&shapeKeys[pos + 1]) = strLen;
+                str->Write(reinterpret_cast<uint16_t*>(&shapeKeys[pos + 1 + sizeof(uint32_t)]));
+            }
+        }
+        std::map<std::vector<uint8_t>, uint32_t>::iterator it = shapeIds.find(shapeKeys);
+        if(it != shapeIds.end()) {
+            return lastShape = it->second;
+        }
+        lastShape = shapeIds.size();
+        shapeIds.insert(std::make_pair(shapeKeys, lastShape));
+        size_t pos = shapeTable.size();
+        shapeTable.resize(pos + sizeof(uint32_t));
+        *reinterpret_cast<uint32_t*>(&shapeTable[pos]) = len;
+        shapeTable.insert(shapeTable.end(), shapeKeys.begin(), shapeKeys.end());
+        return lastShape;
+    }
+
+    // reserves the index of `len' elements, and returns its position
+    inline size_t writeIndex(uint32_t len) {
+        writeLength(len);
+        size_t size = sizeof(uint32_t) + len * sizeof(bson::index_t);
+        ensureCapacity(size);
+        size_t index = current - begin;
+        current += size;
+        return index;
+    }
+
+    // fills the index entry of the element to be written next
+    inline void indexElement(size_t index, size_t first, uint32_t i) {
+        bson::index_t* entry = reinterpret_cast<bson::index_t*>(begin + index + sizeof(uint32_t)) + i;
+        entry->offset = current - begin - first;
+        entry->objects = objects ? objects->index + 1 : 0;
+    }
+
+#ifdef EXTENDED_TYPES
+    static inline uint8_t viewType(v8::Local<v8::ArrayBufferView> view) {
+        if(view->IsUint8Array()) {
+            return isBuffer(view) ? bson::VIEW_BUFFER : bson::VIEW_UINT8;
+        }
+        if(view->IsFloat64Array()) return bson::VIEW_FLOAT64;
+        if(view->IsInt32Array()) return bson::VIEW_INT32;
+        if(view->IsUint32Array()) return bson::VIEW_UINT32;
+        if(view->IsFloat32Array()) return bson::VIEW_FLOAT32;
+        if(view->IsInt16Array()) return bson::VIEW_INT16;
+        if(view->IsUint16Array()) return bson::VIEW_UINT16;
+        if(view->IsInt8Array()) return bson::VIEW_INT8;
+        if(view->IsUint8ClampedArray()) return bson::VIEW_UINT8_CLAMPED;
+#ifdef BIGINT_TYPE
+        if(view->IsBigInt64Array()) return bson::VIEW_BIGINT64;
+        if(view->IsBigUint64Array()) return bson::VIEW_BIGUINT64;
+#endif
+        return bson::VIEW_DATAVIEW;
+    }
+
+    // Buffers are Uint8Arrays with the prototype of Buffer
+    static inline bool isBuffer(v8::Local<v8::ArrayBufferView> view) {
+        v8::String::Utf8Value name(view->GetConstructorName());
+        return name.length() && strcmp(*name, "Buffer") == 0;
+    }
+#endif
+
     inline ~writer_s() {
         object_wrapper_t* curr = objects;
         while(curr) {
@@ -103,7 +254,18 @@ typedef struct writer_s {
             }
             // curr is null
             objects = new object_wrapper_t(obj, objects);
-            if(value->IsArray()) {
+            if(value->IsArray() && format & bson::FORMAT_INDEXED) {
+                *(current++) = bson::IndexedArray;
+                Handle<Array> arr = obj.As<Array>();
+                uint32_t len = arr->Length();
+                size_t index = writeIndex(len);
+                size_t first = current - begin;
+                for(uint32_t i = 0; i < len; i++) {
+                    indexElement(index, first, i);
+                    write(arr->Get(i));
+                }
+                *reinterpret_cast<uint32_t*>(begin + index) = current - begin - first;
+            } else if(value->IsArray()) {
                 *(current++) = bson::Array;
                 Handle<Array> arr = obj.As<Array>();
                 uint32_t len = arr->Length();
@@ -114,7 +276,70 @@ typedef struct writer_s {
                     // fprintf(stderr, "write array[%d] (len=%d)\n", i, len);
                     write(arr->Get(i));
                 }
-            } else { // TODO: support for other object types
+            } else if(value->IsDate()) {
+                *(current++) = bson::Date;
+                ensureCapacity(sizeof(double));
+                *reinterpret_cast<double*>(current) = obj.As<Date>()->ValueOf();
+                current += sizeof(double);
+#ifdef EXTENDED_TYPES
+            } else if(value->IsArrayBufferView()) {
+                // the contents are copied at once, whatever the element type is
+                *(current++) = bson::ArrayBufferView;
+                Local<ArrayBufferView> view = obj.As<ArrayBufferView>();
+                size_t len = view->ByteLength();
+                ensureCapacity(1);
+                *(current++) = viewType(view);
+                writeLength(len);
+                ensureCapacity(len);
+                view->CopyContents(current, len);
+                current += len;
+            } else if(value->IsArrayBuffer()) {
+                *(current++) = bson::ArrayBuffer;
+                Local<ArrayBuffer> buffer = obj.As<ArrayBuffer>();
+                size_t len = buffer->ByteLength();
+                writeLength(len);
+                ensureCapacity(len);
+                memcpy(current, buffer->GetContents().Data(), len);
+                current += len;
+            } else if(value->IsMap()) {
+                *(current++) = bson::Map;
+                Local<Array> entries = obj.As<Map>()->AsArray(); // [key, value, key, value...]
+                uint32_t len = entries->Length();
+                writeLength(len >> 1);
+                for(uint32_t i = 0; i < len; i++) {
+                    write(entries->Get(i));
+                }
+            } else if(value->IsSet()) {
+                *(current++) = bson::Set;
+                Local<Array> values = obj.As<Set>()->AsArray();
+                uint32_t len = values->Length();
+                writeLength(len);
+                for(uint32_t i = 0; i < len; i++) {
+                    write(values->Get(i));
+                }
+#endif
+            } else if(format & bson::FORMAT_SHAPES) {
+                *(current++) = bson::ShapedObject;
+                Local<Array> names = obj->GetOwnPropertyNames();
+                uint32_t len = names->Length();
+                writeLength(shapeOf(names, len));
+                for(uint32_t i = 0; i < len; i++) {
+                    write(obj->Get(names->Get(i)));
+                }
+            } else if(format & bson::FORMAT_INDEXED) {
+                *(current++) = bson::IndexedObject;
+                Local<Array> names = obj->GetOwnPropertyNames();
+                uint32_t len = names->Length();
+                size_t index = writeIndex(len);
+                size_t first = current - begin;
+                for(uint32_t i = 0; i < len; i++) {
+                    indexElement(index, first, i);
+                    Local<Value> name = names->Get(i);
+                    write(name);
+                    write(obj->Get(name));
+                }
+                *reinterpret_cast<uint32_t*>(begin + index) = current - begin - first;
+            } else {
                 *(current++) = bson::Object;
                 Local<Array> names = obj->GetOwnPropertyNames();
                 uint32_t len = names->Length();
@@ -127,6 +352,18 @@ typedef struct writer_s {
                     write(obj->Get(name));
                 }
             }
+#ifdef BIGINT_TYPE
+        } else if(value->IsBigInt()) {
+            *(current++) = bson::BigInt;
+            Local<BigInt> big = value.As<BigInt>();
+            int words = big->WordCount();
+            int sign;
+            ensureCapacity(1 + sizeof(uint32_t) + words * sizeof(uint64_t));
+            big->ToWordsArray(&sign, &words, reinterpret_cast<uint64_t*>(current + 1 + sizeof(uint32_t)));
+            *(current++) = sign;
+            *reinterpret_cast<uint32_t*>(current) = words;
+            current += sizeof(uint32_t) + words * sizeof(uint64_t);
+#endif
         } else {
             *(current++) = bson::Undefined;
         }
@@ -134,10 +371,31 @@ typedef struct writer_s {
 
 } writer_t;
 
-bson::BSONValue::BSONValue(v8::Handle<v8::Value> value) {
-    
-    writer_t writer(*this);
-    writer.write(value);
+bson::BSONValue::BSONValue(v8::Handle<v8::Value> value, uint32_t format) {
+    // numbers are written directly, without setting up a writer
+    if(value->IsInt32()) {
+        cache[0] = bson::Int32;
+        *reinterpret_cast<int32_t*>(cache + 1) = value->Int32Value();
+        pointer = cache;
+        length = 1 + sizeof(int32_t);
+        return;
+    } else if(value->IsNumber()) {
+        cache[0] = bson::Number;
+        *reinterpret_cast<double*>(cache + 1) = value->NumberValue();
+        pointer = cache;
+        length = 1 + sizeof(double);
+        return;
+    }
+
+    if(format & bson::FORMAT_INDEXED) { // indexed objects keep their keys, so that they can be sought
+        format &= ~bson::FORMAT_SHAPES;
+    }
+    writer_t writer(*this, format);
+    if(format & bson::FORMAT_SHAPES && value->IsObject()) {
+        writer.writeShaped(value);
+    } else {
+        writer.write(value);
+    }
     // fprintf(stderr, "%d bytes used writing %s\n", writer.used, *Nan::Utf8String(value));
 
     pointer = writer.current - writer.used;
@@ -151,7 +409,25 @@ bson::BSONValue::~BSONValue() {
     }    
 }
 
-static v8::Local<v8::Value> parse(const uint8_t*& data, object_wrapper_t*& objects) {
+// parses a key of the shape table
+static v8::Local<v8::Value> parseKey(const uint8_t*& data) {
+    using namespace v8;
+    const uint8_t* tmp = data + 1;
+    if(*data == bson::Int32) {
+        data += 1 + sizeof(int32_t);
+        return Nan::New<Integer>(*reinterpret_cast<const int32_t*>(tmp));
+    }
+    uint32_t len = *reinterpret_cast<const uint32_t*>(tmp);
+    tmp += sizeof(uint32_t);
+    data = tmp + len;
+#if (NODE_MODULE_VERSION > NODE_0_10_MODULE_VERSION)
+    return v8::String::NewFromTwoByte(Isolate::GetCurrent(), reinterpret_cast<const uint16_t*>(tmp), v8::String::kInternalizedString, len >> 1);
+#else
+    return v8::String::New(reinterpret_cast<const uint16_t*>(tmp), len >> 1);
+#endif
+}
+
+static v8::Local<v8::Value> parse(const uint8_t*& data, objects_t& objects) {
     using namespace v8;
     uint32_t len;
     const uint8_t* tmp;
@@ -181,24 +457,34 @@ static v8::Local<v8::Value> parse(const uint8_t*& data, object_wrapper_t*& objec
 #else
         return v8::String::New(reinterpret_cast<const uint16_t*>(tmp), len >> 1);
 #endif
+    case bson::IndexedArray: // the index is not used
+        len = *reinterpret_cast<const uint32_t*>(data);
+        data += sizeof(uint32_t) * 2 + len * sizeof(bson::index_t);
+        goto array;
     case bson::Array:
         len = *reinterpret_cast<const uint32_t*>(data);
         data += sizeof(uint32_t);
+    array:
         {
             Local<Array> arr = Nan::New<Array>(len);
-            objects = new object_wrapper_t(arr, objects);
+            objects.add(arr);
 
             for(uint32_t i = 0; i < len; i++) {
                 arr->Set(i, parse(data, objects));
             }
             return arr;
         }
+    case bson::IndexedObject:
+        len = *reinterpret_cast<const uint32_t*>(data);
+        data += sizeof(uint32_t) * 2 + len * sizeof(bson::index_t);
+        goto object;
     case bson::Object:
         len = *reinterpret_cast<const uint32_t*>(data);
         data += sizeof(uint32_t);
+    object:
         {
             Local<Object> obj = Nan::New<Object>();
-            objects = new object_wrapper_t(obj, objects);
+            objects.add(obj);
 
             for(uint32_t i = 0; i < len; i++) {
                 Handle<Value> name = parse(data, objects);
@@ -206,14 +492,170 @@ static v8::Local<v8::Value> parse(const uint8_t*& data, object_wrapper_t*& objec
             }
             return obj;
         }
+    case bson::Date:
+        tmp = data;
+        data += sizeof(double);
+        {
+            Local<Object> date = Nan::New<Date>(*reinterpret_cast<const double*>(tmp)).ToLocalChecked().As<Object>();
+            objects.add(date);
+            return date;
+        }
+#ifdef EXTENDED_TYPES
+    case bson::ArrayBuffer:
+        len = *reinterpret_cast<const uint32_t*>(data);
+        tmp = data += sizeof(uint32_t);
+        data += len;
+        {
+            Local<ArrayBuffer> buffer = ArrayBuffer::New(Isolate::GetCurrent(), len);
+            memcpy(buffer->GetContents().Data(), tmp, len);
+            objects.add(buffer);
+            return buffer;
+        }
+    case bson::ArrayBufferView:
+        {
+            uint8_t type = *(data++);
+            len = *reinterpret_cast<const uint32_t*>(data);
+            tmp = data += sizeof(uint32_t);
+            data += len;
+
+            Local<Object> view;
+            if(type == bson::VIEW_BUFFER) {
+                view = Nan::CopyBuffer(reinterpret_cast<const char*>(tmp), len).ToLocalChecked();
+            } else {
+                Local<ArrayBuffer> buffer = ArrayBuffer::New(Isolate::GetCurrent(), len);
+                memcpy(buffer->GetContents().Data(), tmp, len);
+                switch(type) {
+                case bson::VIEW_INT8: view = Int8Array::New(buffer, 0, len); break;
+                case bson::VIEW_UINT8: view = Uint8Array::New(buffer, 0, len); break;
+                case bson::VIEW_UINT8_CLAMPED: view = Uint8ClampedArray::New(buffer, 0, len); break;
+                case bson::VIEW_INT16: view = Int16Array::New(buffer, 0, len >> 1); break;
+                case bson::VIEW_UINT16: view = Uint16Array::New(buffer, 0, len >> 1); break;
+                case bson::VIEW_INT32: view = Int32Array::New(buffer, 0, len >> 2); break;
+                case bson::VIEW_UINT32: view = Uint32Array::New(buffer, 0, len >> 2); break;
+                case bson::VIEW_FLOAT32: view = Float32Array::New(buffer, 0, len >> 2); break;
+                case bson::VIEW_FLOAT64: view = Float64Array::New(buffer, 0, len >> 3); break;
+#ifdef BIGINT_TYPE
+                case bson::VIEW_BIGINT64: view = BigInt64Array::New(buffer, 0, len >> 3); break;
+                case bson::VIEW_BIGUINT64: view = BigUint64Array::New(buffer, 0, len >> 3); break;
+#endif
+                default: view = DataView::New(buffer, 0, len);
+                }
+            }
+            objects.add(view);
+            return view;
+        }
+    case bson::Map:
+        len = *reinterpret_cast<const uint32_t*>(data);
+        data += sizeof(uint32_t);
+        {
+            Isolate* isolate = Isolate::GetCurrent();
+            Local<Context> context = isolate->GetCurrentContext();
+            Local<Map> map = Map::New(isolate);
+            objects.add(map);
+
+            for(uint32_t i = 0; i < len; i++) {
+                Local<Value> key = parse(data, objects);
+                map->Set(context, key, parse(data, objects)).ToLocalChecked();
+            }
+            return map;
+        }
+    case bson::Set:
+        len = *reinterpret_cast<const uint32_t*>(data);
+        data += sizeof(uint32_t);
+        {
+            Isolate* isolate = Isolate::GetCurrent();
+            Local<Context> context = isolate->GetCurrentContext();
+            Local<Set> set = Set::New(isolate);
+            objects.add(set);
+
+            for(uint32_t i = 0; i < len; i++) {
+                set->Add(context, parse(data, objects)).ToLocalChecked();
+            }
+            return set;
+        }
+#endif
+#ifdef BIGINT_TYPE
+    case bson::BigInt:
+        {
+            int sign = *(data++);
+            len = *reinterpret_cast<const uint32_t*>(data);
+            data += sizeof(uint32_t);
+            // the words may be unaligned in the value
+            std::vector<uint64_t> words(len);
+            if(len) memcpy(&words[0], data, len * sizeof(uint64_t));
+            data += len * sizeof(uint64_t);
+            return BigInt::NewFromWords(Isolate::GetCurrent()->GetCurrentContext(), sign, len, len ? &words[0] : NULL).ToLocalChecked();
+        }
+#endif
+    case bson::Shapes:
+        len = *reinterpret_cast<const uint32_t*>(data);
+        data += sizeof(uint32_t);
+        {
+            // keys are read from the table first, and made internalized strings once
+            const uint8_t* table = data + len;
+            uint32_t count = *reinterpret_cast<const uint32_t*>(table);
+            table += sizeof(uint32_t);
+            objects.shapes.resize(count);
+            for(uint32_t i = 0; i < count; i++) {
+                std::vector<Local<Value> >& keys = objects.shapes[i];
+                keys.resize(*reinterpret_cast<const uint32_t*>(table));
+                table += sizeof(uint32_t);
+                for(size_t j = 0; j < keys.size(); j++) {
+                    keys[j] = parseKey(table);
+                }
+            }
+            Local<Value> ret = parse(data, objects);
+            data = table;
+            return ret;
+        }
+    case bson::ShapedObject:
+        len = *reinterpret_cast<const uint32_t*>(data);
+        data += sizeof(uint32_t);
+        {
+            Local<Object> obj = Nan::New<Object>();
+            objects.add(obj);
+            if(len >= objects.shapes.size()) { // the table is out of the part being parsed
+                objects.resolved = false;
+                return Nan::Undefined();
+            }
+            const std::vector<Local<Value> >& keys = objects.shapes[len];
+            for(size_t i = 0; i < keys.size(); i++) {
+                obj->Set(keys[i], parse(data, objects));
+            }
+            return obj;
+        }
+    case bson::Fields:
+        len = *reinterpret_cast<const uint32_t*>(data);
+        data += sizeof(uint32_t);
+        {
+            Local<Object> obj = Nan::New<Object>();
+            for(uint32_t i = 0; i < len; i++) {
+                uint32_t nameLen = *reinterpret_cast<const uint32_t*>(data);
+#if (NODE_MODULE_VERSION > NODE_0_10_MODULE_VERSION)
+                Local<String> name = v8::String::NewFromTwoByte(Isolate::GetCurrent(), reinterpret_cast<const uint16_t*>(data + sizeof(uint32_t)), v8::String::kInternalizedString, nameLen >> 1);
+#else
+                Local<String> name = v8::String::New(reinterpret_cast<const uint16_t*>(data + sizeof(uint32_t)), nameLen >> 1);
+#endif
+                data += sizeof(uint32_t) + nameLen;
+                uint32_t valLen = *reinterpret_cast<const uint32_t*>(data);
+                data += sizeof(uint32_t);
+                obj->Set(name, bson::parse(data));
+                data += valLen;
+            }
+            return obj;
+        }
     case bson::ObjectRef:
         len = *reinterpret_cast<const uint32_t*>(data);
         data += sizeof(uint32_t);
         {
-            object_wrapper_t* curr = objects;
-            while(curr->index != len) {
+            object_wrapper_t* curr = objects.head;
+            while(curr && curr->index != len) {
                 curr = curr->next;
             }
+            if(!curr) { // written before the part being parsed
+                objects.resolved = false;
+                return Nan::Undefined();
+            }
             return curr->object;
         }
     }
@@ -221,14 +663,101 @@ static v8::Local<v8::Value> parse(const uint8_t*& data, object_wrapper_t*& objec
     return Local<Value>();
 }
 
-v8::Local<v8::Value> bson::parse(const uint8_t* data) {
-    object_wrapper_t* objects = NULL;
+v8::Local<v8::Value> bson::parse(const uint8_t* data, uint32_t first, bool* resolved) {
+    objects_t objects(first);
     v8::Local<v8::Value> ret = ::parse(data, objects);
-    while(objects) {
-        object_wrapper_t* next = objects->next;
-        delete objects;
-        objects = next;
+    if(resolved) {
+        *resolved = objects.resolved;
     }
-
     return ret;
 }
+
+int bson::seek(void* context, reader_t read, size_t length, const path_t* path, size_t depth, location_t& location) {
+    location.offset = 0;
+    location.length = length;
+    location.objects = 0;
+    for(location.depth = 0; location.depth < depth; location.depth++) {
+        const path_t& step = path[location.depth];
+        uint8_t header[1 + sizeof(uint32_t) * 2];
+        size_t headerLen = read(context, location.offset, header, sizeof(header));
+        if(!headerLen) {
+            return SEEK_ABSENT;
+        }
+        uint8_t tag = header[0];
+        if(tag == bson::Fields) { // fields are skipped over by their lengths
+            uint32_t count = *reinterpret_cast<uint32_t*>(header + 1);
+            size_t offset = location.offset + 1 + sizeof(uint32_t);
+            uint16_t name[256];
+            uint32_t i, nameLen, valLen;
+            for(i = 0; i < count; i++) {
+                read(context, offset, reinterpret_cast<uint8_t*>(&nameLen), sizeof(uint32_t));
+                read(context, offset + sizeof(uint32_t) + nameLen, reinterpret_cast<uint8_t*>(&valLen), sizeof(uint32_t));
+                if(nameLen == step.name.size() << 1 && nameLen <= sizeof(name)) {
+                    read(context, offset + sizeof(uint32_t), reinterpret_cast<uint8_t*>(name), nameLen);
+                    if(!memcmp(name, &step.name[0], nameLen)) break;
+                }
+                offset += 2 * sizeof(uint32_t) + nameLen + valLen;
+            }
+            if(i == count) {
+                return SEEK_ABSENT;
+            }
+            location.offset = offset + 2 * sizeof(uint32_t) + nameLen;
+            location.length = valLen;
+            location.objects = 0; // values of fields are written on their own
+            continue;
+        }
+        if(tag != bson::IndexedArray && tag != bson::IndexedObject) { // walked through by the caller
+            location.length = length - location.offset;
+            return SEEK_PARTIAL;
+        }
+        uint32_t len = *reinterpret_cast<uint32_t*>(header + 1);
+        uint32_t bytes = *reinterpret_cast<uint32_t*>(header + 1 + sizeof(uint32_t));
+        size_t index = location.offset + sizeof(header);
+        size_t first = index + len * sizeof(index_t);
+
+        index_t entries[2]; // of the element, and the next one
+        uint32_t i;
+        size_t skip = 0; // length of the key before the value
+        if(tag == bson::IndexedArray) {
+            if(!step.isIndex) { // such as `length'
+                location.length = length - location.offset;
+                return SEEK_PARTIAL;
+            }
+            if(step.index >= len) {
+                return SEEK_ABSENT;
+            }
+            i = step.index;
+            read(context, index + i * sizeof(index_t), reinterpret_cast<uint8_t*>(entries), sizeof(index_t));
+        } else {
+            // keys are compared in place, which are either strings, or integers
+            uint16_t name[256];
+            for(i = 0; i < len; i++) {
+                read(context, index + i * sizeof(index_t), reinterpret_cast<uint8_t*>(entries), sizeof(index_t));
+                uint8_t key[1 + sizeof(uint32_t)];
+                read(context, first + entries[0].offset, key, sizeof(key));
+                uint32_t keyLen = *reinterpret_cast<uint32_t*>(key + 1);
+                if(key[0] == bson::Int32) {
+                    skip = sizeof(key);
+                    if(step.isIndex && keyLen == step.index) break;
+                } else if(key[0] == bson::String) {
+                    skip = sizeof(key) + keyLen;
+                    if(keyLen != step.name.size() << 1 || keyLen > sizeof(name)) continue;
+                    read(context, first + entries[0].offset + sizeof(key), reinterpret_cast<uint8_t*>(name), keyLen);
+                    if(!memcmp(name, &step.name[0], keyLen)) break;
+                }
+            }
+            if(i == len) {
+                return SEEK_ABSENT;
+            }
+        }
+        size_t end = bytes;
+        if(i + 1 < len) {
+            read(context, index + (i + 1) * sizeof(index_t), reinterpret_cast<uint8_t*>(entries + 1), sizeof(index_t));
+            end = entries[1].offset;
+        }
+        location.offset = first + entries[0].offset + skip;
+        location.length = first + end - location.offset;
+        location.objects = entries[0].objects;
+    }
+    return SEEK_FOUND;
+}
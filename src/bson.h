@@ -2,20 +2,16 @@
 #define BSON_H_
 
 #include<v8.h>
+#include<vector>
+#include "bson_types.h"
 
 namespace bson {
-    typedef enum {
-        Null,
-        Undefined,
-        True,
-        False,
-        Int32,
-        Number,
-        String,
-        Array,
-        Object,
-        ObjectRef
-    } TYPES;
+    // formats of serialized values. Values of any format are parsed the same
+    enum {
+        FORMAT_DEFAULT = 0,
+        FORMAT_INDEXED = 1, // arrays and objects are written with indexes, for seek
+        FORMAT_SHAPES = 2 // key lists of objects are written once, unless objects are indexed
+    };
 
     class BSONValue {
     private:
@@ -23,13 +19,43 @@ namespace bson {
         uint8_t*pointer;
     public:
         uint8_t cache[32];
-        BSONValue(v8::Handle<v8::Value> value);
+        BSONValue(v8::Handle<v8::Value> value, uint32_t format = FORMAT_DEFAULT);
         ~BSONValue();
         inline const uint8_t* Data() { return pointer; }
         inline size_t Length () { return length; }
     };
 
-    v8::Local<v8::Value> parse(const uint8_t* data);
+    // parses a value, or a part of it whose objects are numbered from `first'. Undefined is
+    // returned in place of references to objects before that, with *resolved set to false
+    v8::Local<v8::Value> parse(const uint8_t* data, uint32_t first = 0, bool* resolved = NULL);
+
+    // a step of a path into a value: a property name, which may be an array index
+    typedef struct path_s {
+        std::vector<uint16_t> name;
+        bool     isIndex;
+        uint32_t index;
+    } path_t;
+
+    // part of a value found by seek
+    typedef struct location_s {
+        size_t   offset;
+        size_t   length;
+        uint32_t objects; // number of the first object of the part, to be passed to parse
+        size_t   depth; // steps of the path walked through
+    } location_t;
+
+    // copies at most len bytes of a value at offset, and returns the number of bytes copied
+    typedef size_t (*reader_t)(void* context, size_t offset, uint8_t* dst, size_t len);
+
+    enum {
+        SEEK_ABSENT,
+        SEEK_FOUND,
+        SEEK_PARTIAL // a part which is not indexed is reached, it spans to the end of the value
+    };
+
+    // walks a path through indexed arrays and objects of a value of `length' bytes, which is read
+    // in parts by `read', and returns the location of the addressed part
+    int seek(void* context, reader_t read, size_t length, const path_t* path, size_t depth, location_t& location);
 
 
     class BSONParser {
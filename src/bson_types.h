@@ -0,0 +1,80 @@
+#ifndef BSON_TYPES_H_
+#define BSON_TYPES_H_
+
+#include <stdint.h>
+
+// type tags of serialized values. Every value starts with one of them, followed by:
+//   Int32: int32_t
+//   Number: double
+//   String: uint32_t byte length, followed by UTF-16 code units
+//   Array: uint32_t length, followed by the elements
+//   Object: uint32_t length, followed by pairs of String key and value
+//   ObjectRef: uint32_t index of an object already read (of any type below), in order of appearance
+//   Date: double milliseconds since the epoch
+//   ArrayBuffer: uint32_t byte length, followed by the bytes
+//   ArrayBufferView: uint8_t VIEW_TYPES, uint32_t byte length, followed by the bytes of the view
+//   Map: uint32_t size, followed by pairs of key and value
+//   Set: uint32_t size, followed by the values
+//   BigInt: uint8_t sign (1 if negative), uint32_t number of words, followed by uint64_t words,
+//           least significant first
+//   IndexedArray, IndexedObject: same as Array and Object, with an index between the length and
+//           the elements: uint32_t byte length of the elements, followed by an index_t for every
+//           element (or pair of key and value). They are written in FORMAT_INDEXED, so that parts
+//           of a value can be read without parsing the rest
+//   Shapes: uint32_t byte length of the value that follows, which is followed by the shape table:
+//           uint32_t number of shapes, followed by every shape: uint32_t number of keys, followed by
+//           the keys (String, or Int32). Written in FORMAT_SHAPES, in place of objects at the top
+//   ShapedObject: uint32_t index of a shape in the table, followed by the values of its keys
+//   Fields: uint32_t number of fields, followed by every field: uint32_t byte length of its name,
+//           the name in UTF-16 code units, uint32_t byte length of its value, and the value, which is
+//           written on its own, so that its objects are numbered from 0. Written by hset, so that
+//           fields are read and updated by the cache engine without parsing the rest of the value
+namespace bson {
+    typedef enum {
+        Null,
+        Undefined,
+        True,
+        False,
+        Int32,
+        Number,
+        String,
+        Array,
+        Object,
+        ObjectRef,
+        Date,
+        ArrayBuffer,
+        ArrayBufferView,
+        Map,
+        Set,
+        BigInt,
+        IndexedArray,
+        IndexedObject,
+        Shapes,
+        ShapedObject,
+        Fields
+    } TYPES;
+
+    // index entry of an element
+    typedef struct index_s {
+        uint32_t offset; // from the first element
+        uint32_t objects; // number of objects written before the element, which is the index of its first object
+    } index_t;
+
+    typedef enum {
+        VIEW_INT8,
+        VIEW_UINT8,
+        VIEW_UINT8_CLAMPED,
+        VIEW_INT16,
+        VIEW_UINT16,
+        VIEW_INT32,
+        VIEW_UINT32,
+        VIEW_FLOAT32,
+        VIEW_FLOAT64,
+        VIEW_BIGINT64,
+        VIEW_BIGUINT64,
+        VIEW_DATAVIEW,
+        VIEW_BUFFER // node Buffer
+    } VIEW_TYPES;
+}
+
+#endif
@@ -2,11 +2,17 @@
 #include<string.h> // memset
 #include<errno.h> // errno
 #include <stdint.h> // uint32_t
+#include <vector>
 #include "memcache.h"
-#include "bson.h"
+#include "bson_types.h"
 
 #ifndef _WIN32
 #include <sys/file.h> // flock
+#include <pthread.h>
+#include <map>
+#include <time.h> // clock_gettime
+#include <unistd.h> // getpid
+#include <signal.h> // kill
 #else
 #define LOCK_SH 1
 #define LOCK_EX 2
@@ -17,6 +23,11 @@
 #include <intrin.h>
 #endif
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
 #ifdef _WIN32
 static uint32_t __inline __builtin_clz(uint32_t x)
 {
@@ -24,38 +35,198 @@ static uint32_t __inline __builtin_clz(uint32_t x)
     _BitScanReverse(&idx, x);
     return 31 - idx;
 }
+
+static uint32_t __inline __builtin_clzll(uint64_t x)
+{
+    unsigned long idx = 0;
+    _BitScanReverse64(&idx, x);
+    return 63 - idx;
+}
 #endif
 
-#define MAGIC 0xdeadbeef
+#define MAGIC 0xdeadbefc // changes whenever the layout of the segment changes
 
 namespace cache {
 
+// milliseconds of a monotonic clock, which is shared by processes
+static inline uint64_t now() {
+#ifdef _WIN32
+    return GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+// nanoseconds of a monotonic clock, only read when latency recording is enabled
+static inline uint64_t clock_ns() {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    if(!frequency.QuadPart) QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return uint64_t(counter.QuadPart / frequency.QuadPart) * 1000000000 +
+        uint64_t(counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
 #ifndef _WIN32
 #define LOCK(fd, ACT) while(flock(fd, ACT))
 #else
 #define LOCK(fd, ACT) if (ACT == LOCK_UN) ReleaseMutex(fd); else WaitForSingleObject(fd, INFINITE)
 #endif
 
+#ifndef _WIN32
+// flock locks are held by the open file, which is shared by all threads of the process, so
+// threads are serialized by a lock of the process, and readers of a cache share its file lock.
+// Caches are spread over the locks by fd. Windows mutexes are owned by threads, and need none
+// of this.
+#define THREAD_LOCKS 64
+
+typedef struct thread_lock_s {
+    pthread_rwlock_t            rwlock;
+    pthread_mutex_t             readers_lock;
+    std::map<HANDLE, uint32_t>  readers; // threads reading each cache
+
+    thread_lock_s() {
+        pthread_rwlock_init(&rwlock, NULL);
+        pthread_mutex_init(&readers_lock, NULL);
+    }
+} thread_lock_t;
+
+static thread_lock_t thread_locks[THREAD_LOCKS];
+
+// retries a non-blocking lock with a backoff from 16us to 1ms until the deadline
+#define ATTEMPT(locked, deadline, failed) for(uint32_t delay = 16; !(locked); delay = delay < 1000 ? delay << 1 : delay) {\
+        if(now() >= deadline) {\
+            failed;\
+            return false;\
+        }\
+        usleep(delay);\
+    }
+#endif
+
+static inline bool lock_shared(HANDLE fd, uint32_t timeout) {
+#ifndef _WIN32
+    thread_lock_t& lock = thread_locks[fd % THREAD_LOCKS];
+    if(timeout == TIMEOUT_INFINITE) {
+        pthread_rwlock_rdlock(&lock.rwlock);
+        pthread_mutex_lock(&lock.readers_lock);
+        if(!lock.readers[fd]++) {
+            LOCK(fd, LOCK_SH);
+        }
+        pthread_mutex_unlock(&lock.readers_lock);
+        return true;
+    }
+    uint64_t deadline = now() + timeout;
+    ATTEMPT(!pthread_rwlock_tryrdlock(&lock.rwlock), deadline, );
+    pthread_mutex_lock(&lock.readers_lock);
+    uint32_t& count = lock.readers[fd];
+    if(!count) {
+        ATTEMPT(!flock(fd, LOCK_SH | LOCK_NB), deadline, pthread_mutex_unlock(&lock.readers_lock); pthread_rwlock_unlock(&lock.rwlock));
+    }
+    count++;
+    pthread_mutex_unlock(&lock.readers_lock);
+    return true;
+#else
+    DWORD ret = WaitForSingleObject(fd, timeout);
+    return ret == WAIT_OBJECT_0 || ret == WAIT_ABANDONED;
+#endif
+}
+
+static inline void unlock_shared(HANDLE fd) {
+#ifndef _WIN32
+    thread_lock_t& lock = thread_locks[fd % THREAD_LOCKS];
+    pthread_mutex_lock(&lock.readers_lock);
+    if(!--lock.readers[fd]) {
+        LOCK(fd, LOCK_UN);
+    }
+    pthread_mutex_unlock(&lock.readers_lock);
+    pthread_rwlock_unlock(&lock.rwlock);
+#else
+    LOCK(fd, LOCK_UN);
+#endif
+}
+
+static inline bool lock_exclusive(HANDLE fd, uint32_t timeout) {
+#ifndef _WIN32
+    thread_lock_t& lock = thread_locks[fd % THREAD_LOCKS];
+    if(timeout == TIMEOUT_INFINITE) {
+        pthread_rwlock_wrlock(&lock.rwlock);
+        LOCK(fd, LOCK_EX);
+        return true;
+    }
+    uint64_t deadline = now() + timeout;
+    ATTEMPT(!pthread_rwlock_trywrlock(&lock.rwlock), deadline, );
+    ATTEMPT(!flock(fd, LOCK_EX | LOCK_NB), deadline, pthread_rwlock_unlock(&lock.rwlock));
+    return true;
+#else
+    DWORD ret = WaitForSingleObject(fd, timeout);
+    return ret == WAIT_OBJECT_0 || ret == WAIT_ABANDONED;
+#endif
+}
+
+static inline void unlock_exclusive(HANDLE fd) {
+    LOCK(fd, LOCK_UN);
+#ifndef _WIN32
+    pthread_rwlock_unlock(&thread_locks[fd % THREAD_LOCKS].rwlock);
+#endif
+}
+#undef LOCK
+#undef ATTEMPT
+
 typedef struct read_lock_s {
     HANDLE fd;
-    inline read_lock_s(HANDLE fd) : fd(fd) {
-        LOCK(fd, LOCK_SH);
-    }
+    bool locked;
+    inline read_lock_s(HANDLE fd, uint32_t timeout = TIMEOUT_INFINITE) : fd(fd), locked(lock_shared(fd, timeout)) {}
     inline ~read_lock_s() {
-        LOCK(fd, LOCK_UN);
+        if(locked) unlock_shared(fd);
     }
 } read_lock_t;
 
 typedef struct write_lock_s {
     HANDLE fd;
-    inline write_lock_s(HANDLE fd) : fd(fd) {
-        LOCK(fd, LOCK_EX);
-    }
+    bool locked;
+    inline write_lock_s(HANDLE fd, uint32_t timeout = TIMEOUT_INFINITE) : fd(fd), locked(lock_exclusive(fd, timeout)) {}
     inline ~write_lock_s() {
-        LOCK(fd, LOCK_UN);
+        if(locked) unlock_exclusive(fd);
     }
 } write_lock_t;
-#undef LOCK
+
+static inline uint32_t process_id() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return getpid();
+#endif
+}
+
+// identifies the calling thread among threads of the process, never 0
+static inline uint32_t thread_token() {
+    static volatile uint32_t threads;
+    static thread_local uint32_t token;
+    if(!token) {
+#ifndef _WIN32
+        token = __sync_add_and_fetch(&threads, 1);
+#else
+        token = InterlockedIncrement(reinterpret_cast<volatile LONG*>(&threads));
+#endif
+    }
+    return token;
+}
+
+static inline bool process_alive(uint32_t pid) {
+#ifdef _WIN32
+    return true; // leases of dead processes expire
+#else
+    return kill(pid, 0) == 0 || errno != ESRCH;
+#endif
+}
 
 typedef struct node_s {
     uint32_t    prev;
@@ -65,50 +236,403 @@ typedef struct node_s {
     uint32_t    valLen;
     uint32_t    hash;
     uint16_t    keyLen;
+    uint16_t    flags;
     uint16_t    key[0];
 } node_t;
 
+#define NODE_WINDOW 1 // node is linked in the admission window instead of the main LRU list
+#define NODE_LEASE 2 // node holds a lease_t instead of a value, it is a miss for everyone but the lease holder
+#define NODE_PINNED 4 // node is linked in the pinned list, and only evicted when nothing else is left
+#define NODE_LOW 8 // node is linked in the low priority list, which is evicted first
+#define NODE_NS_SHIFT 8 // bits 8-11 hold the namespace of the node
+#define NODE_NS_MASK 0xf00
+#define NODE_CLASS_SHIFT 12 // bits 12-15 hold the size class of the node, which is 0 unless the cache has slabs
+
+// a thread computing the value of a missing key holds a lease on it, so that
+// other threads and processes wait for the value instead of computing it again
+typedef struct lease_s {
+    uint32_t    pid;
+    uint32_t    thread; // thread_token() of the holder in its process
+    uint64_t    expires; // in now()
+} lease_t;
+
+typedef struct lru_s {
+    uint32_t    head;
+    uint32_t    tail;
+} lru_t;
+
+// a tiny entry, whose key and value fit in SMALL_DATA bytes. Tiny entries are kept in a table
+// of slots instead of blocks, which saves the node header and the allocation of a whole block.
+// They are evicted by a clock among themselves when the table is full, and do not count
+// towards namespace quotas.
+#define SMALL_DATA 20
+
+typedef struct small_s {
+    uint32_t    hash;
+    uint32_t    next; // next slot of the bucket, or of the free list. Slots are numbered from 1
+    uint8_t     keyLen;
+    uint8_t     valLen;
+    uint8_t     flags;
+    uint8_t     reserved;
+    uint8_t     data[SMALL_DATA]; // key, followed by the value
+} small_t;
+
+#define SMALL_USED 1
+#define SMALL_REFERENCED 2 // read by get since the clock hand passed
+#define SMALL_LATIN1 4 // key is stored in 8-bit units, as none of them is above 255
+#define SMALL_NS_SHIFT 4 // bits 4-7 hold the namespace of the entry
+
+// bytes taken by a key in a slot, or SMALL_DATA + 1 if it does not fit
+static inline size_t small_key_size(const uint16_t* key, size_t keyLen) {
+    if(keyLen > SMALL_DATA) {
+        return SMALL_DATA + 1;
+    }
+    for(size_t i = 0; i < keyLen; i++) {
+        if(key[i] > 255) return keyLen << 1;
+    }
+    return keyLen;
+}
+
+// seeds used to derive the 4 rows of the frequency sketch from a key hash
+static const uint64_t SKETCH_SEEDS[] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+
+// a namespace has its own keys, LRU lists and quota, and shares blocks with
+// the other namespaces. Namespace 0 is the default one, which has no name.
+typedef struct namespace_s {
+    uint32_t    quota; // in blocks, 0 for no quota
+    uint32_t    blocks_used;
+    lru_t       lru;
+
+    // W-TinyLFU: new nodes enter a small LRU window. When the window is full,
+    // its oldest node is only admitted into the main list if it is accessed more
+    // frequently than the main victim, otherwise it is evicted itself.
+    lru_t       window;
+    uint32_t    window_blocks;
+
+    // entries set with a priority are kept out of the window and the main list
+    lru_t       low;
+    lru_t       pinned;
+    uint32_t    pinned_blocks;
+
+    uint16_t    nameLen;
+    uint16_t    name[NAMESPACE_NAME_MAX];
+} namespace_t;
+
+// number of generation counters, keys are mapped to them by their hash
+#define GENERATIONS 4096
+
+// statistics are counted in one of these slots, selected by process id, so that
+// processes seldom update the same cache lines
+#define STATS_SLOTS 16
+
+typedef union stats_slot_u {
+    counters_t  counters;
+    uint8_t     padding[128];
+} stats_slot_t;
+
+// slot of the current process
+static uint32_t stats_slot;
+
+static inline void count(uint64_t& counter, uint64_t n = 1) {
+#ifndef _WIN32
+    __sync_fetch_and_add(&counter, n);
+#else
+    InterlockedExchangeAdd64(reinterpret_cast<volatile LONG64*>(&counter), n);
+#endif
+}
+
+// in slab mode, blocks are grouped in pages of 16KB, which are given to size classes on demand
+// and taken back when all their chunks are free. Class c has chunks of 2^c blocks, and a bitmap
+// of them over the whole cache, where chunks of pages it does not own are marked as used
+#define SLAB_PAGE_SHIFT 14
+#define SLAB_CLASSES 9 // 64 bytes to 16KB
+#define SLAB_SCAN 64 // nodes looked at to find a victim of the size class in need
+
+#define COMPACT_SLICE 1024 // hash buckets compacted under one hold of the lock
+
+#define PINNED_SHARE 2 // pinned nodes take at most half of the blocks, so that others can still be stored
+
+typedef struct slab_class_s {
+    uint32_t    bitmap_offset;
+    uint32_t    next_bitmap_index;
+    uint32_t    chunks_free; // in the pages of the class
+    uint32_t    reserved;
+} slab_class_t;
+
+// extension area, placed after the bitmap
+typedef struct ext_s {
+    uint32_t    size; // bytes used by the extension area, including the sketch
+    uint32_t    policy;
+
+    uint32_t    sketch_offset; // count-min sketch, 16 4-bit counters per word
+    uint32_t    sketch_mask;
+    uint32_t    sketch_samples;
+    uint32_t    sketch_limit; // counters are halved when this many samples are taken
+
+    uint32_t    lease_seq; // increased when a lease is resolved, processes waiting for leases wait on it
+    uint32_t    lease_waiters;
+
+    namespace_t namespaces[NAMESPACES];
+
+    // a key is unchanged as long as its generation counter and the epoch are unchanged,
+    // which lets processes keep parsed values of keys without reading them again
+    uint32_t    epoch; // increased when the cache is formatted
+    uint32_t    generations[GENERATIONS];
+
+    stats_slot_t stats[STATS_SLOTS];
+
+    uint32_t    latency; // histograms are recorded if set
+    uint32_t    reserved;
+    latency_t   latencies[LATENCY_HISTOGRAMS];
+
+    uint32_t    small_offset; // buckets of tiny entries, followed by their slots
+    uint32_t    small_mask;
+    uint32_t    small_slots;
+    uint32_t    small_used;
+    uint32_t    small_free; // first free slot
+    uint32_t    small_hand; // last slot visited by the clock
+
+    uint32_t    slab_classes; // 0 unless the cache has slabs
+    uint32_t    slab_offset; // bitmap of pages in use, followed by the bitmaps of classes
+    uint32_t    slab_pages; // including those taken by the header
+    uint32_t    slab_pages_free;
+    uint32_t    next_page_index;
+    uint32_t    compact_cursor; // next hash bucket to be compacted
+    slab_class_t classes[SLAB_CLASSES];
+
+    uint32_t    log_offset; // ring of the change log
+    uint32_t    log_mask; // size of the ring - 1, 0 if the cache has no change log
+    uint64_t    log_head; // bytes appended since the log is created, the next record is appended there
+} ext_t;
+
 typedef struct cache_s {
     uint32_t hashmap[65536];
 
     union {
         uint32_t nexts[0];
 
-        struct { // can be at most 32 dwords
+        struct { // can be at most 16 dwords
             uint32_t    magic; // 1
             uint32_t    blocks_total; // 2
             uint32_t    blocks_available; // 3
             uint32_t    dirty; // 4
 
             uint16_t    block_size_shift;
-            uint16_t    first_block; // 5
+            uint16_t    reserved; // 5
 
             uint32_t    next_bitmap_index; // 6 next bitmap position to look for when allocating block
             uint32_t    blocks_used; // 7
-            uint32_t    head; // 8
-            uint32_t    tail; // 9
+            uint32_t    ext_offset; // 8
+            uint32_t    first_block; // 9 blocks before it hold the header, which takes more than 65535 of them in large caches
         } info;
 
     };
 
-    template<typename T>
+    // block size shift, which is a constant in operations specialized for it, see SPECIALIZE
+    template<uint32_t SHIFT>
+    inline uint32_t blockShift() const {
+        return SHIFT ? SHIFT : info.block_size_shift;
+    }
+
+    template<typename T, uint32_t SHIFT = 0>
     inline T* address(uint32_t block) const {
-        return reinterpret_cast<T*>(((uint8_t*) this) + (block << info.block_size_shift));
+        return reinterpret_cast<T*>(((uint8_t*) this) + (size_t(block) << blockShift<SHIFT>()));
+    }
+
+    inline ext_t& ext() const {
+        return *reinterpret_cast<ext_t*>(((uint8_t*) this) + info.ext_offset);
+    }
+
+    inline namespace_t& space(uint32_t ns) const {
+        return ext().namespaces[ns];
+    }
+
+    inline namespace_t& space(const node_t& node) const {
+        return ext().namespaces[(node.flags & NODE_NS_MASK) >> NODE_NS_SHIFT];
+    }
+
+    inline counters_t& counters() const {
+        return ext().stats[stats_slot].counters;
+    }
+
+    // histograms of an operation if latency recording is enabled, NULL otherwise
+    inline latency_t* latency(uint32_t op) const {
+        ext_t& e = ext();
+        return *static_cast<volatile uint32_t*>(&e.latency) ? &e.latencies[op << 1] : NULL;
+    }
+
+    inline uint64_t* sketch() const {
+        return reinterpret_cast<uint64_t*>(((uint8_t*) this) + ext().sketch_offset);
+    }
+
+    inline uint32_t* smallBuckets() const {
+        return reinterpret_cast<uint32_t*>(((uint8_t*) this) + ext().small_offset);
+    }
+
+    inline small_t* small(uint32_t slot) const {
+        return reinterpret_cast<small_t*>(smallBuckets() + ext().small_mask + 1) + slot - 1;
+    }
+
+    static inline uint8_t* smallValue(small_t& s) {
+        return s.data + (s.flags & SMALL_LATIN1 ? s.keyLen : s.keyLen << 1);
+    }
+
+    // whether a key and a value of these sizes are kept in a slot
+    inline bool fitsSmall(size_t keySize, size_t valLen) const {
+        return ext().small_slots && keySize + valLen <= SMALL_DATA;
+    }
+
+    inline uint32_t findSmall(uint32_t ns, const uint16_t* key, size_t keyLen, uint32_t hash) const {
+        const ext_t& e = ext();
+        if(!e.small_slots) return 0;
+        for(uint32_t curr = smallBuckets()[hash & e.small_mask]; curr;) {
+            const small_t& s = *small(curr);
+            if(s.hash == hash && s.keyLen == keyLen && uint32_t(s.flags >> SMALL_NS_SHIFT) == ns) {
+                size_t i = 0;
+                if(s.flags & SMALL_LATIN1) {
+                    for(; i < keyLen && s.data[i] == key[i]; i++);
+                } else if(!memcmp(s.data, key, keyLen << 1)) {
+                    i = keyLen;
+                }
+                if(i == keyLen) return curr;
+            }
+            curr = s.next;
+        }
+        return 0;
+    }
+
+    inline void readSmall(uint32_t slot, uint8_t*& retval, size_t& retvalLen) const {
+        small_t& s = *small(slot);
+        if(s.valLen > retvalLen) {
+            retval = new uint8_t[s.valLen];
+        }
+        retvalLen = s.valLen;
+        memcpy(retval, smallValue(s), s.valLen);
+    }
+
+    inline bool smallOf(uint32_t slot, uint32_t ns) const {
+        const small_t& s = *small(slot);
+        return s.flags & SMALL_USED && uint32_t(s.flags >> SMALL_NS_SHIFT) == ns;
+    }
+
+    // key of a slot in UTF-16, into buf of SMALL_DATA units
+    inline uint16_t* smallKey(uint32_t slot, uint16_t* buf) const {
+        small_t& s = *small(slot);
+        if(!(s.flags & SMALL_LATIN1)) {
+            memcpy(buf, s.data, s.keyLen << 1);
+        } else {
+            for(uint32_t i = 0; i < s.keyLen; i++) buf[i] = s.data[i];
+        }
+        return buf;
+    }
+
+    inline void dropSmall(uint32_t slot) {
+        ext_t& e = ext();
+        small_t& s = *small(slot);
+        uint32_t* toModify = &smallBuckets()[s.hash & e.small_mask];
+        while(*toModify != slot) {
+            toModify = &small(*toModify)->next;
+        }
+        *toModify = s.next;
+        modified(s.hash);
+        s.flags = 0;
+        s.next = e.small_free;
+        e.small_free = slot;
+        e.small_used--;
+    }
+
+    // takes a free slot, evicting an entry which has not been read since the clock hand passed
+    inline uint32_t allocateSmall() {
+        ext_t& e = ext();
+        while(!e.small_free) {
+            e.small_hand = e.small_hand % e.small_slots + 1;
+            small_t& s = *small(e.small_hand);
+            if(s.flags & SMALL_REFERENCED) {
+                s.flags &= ~SMALL_REFERENCED;
+            } else {
+                counters_t& c = counters();
+                count(c.evictions);
+                count(c.evicted_bytes, sizeof(small_t));
+                dropSmall(e.small_hand);
+            }
+        }
+        uint32_t slot = e.small_free;
+        e.small_free = small(slot)->next;
+        e.small_used++;
+        return slot;
+    }
+
+    // sets the value of a tiny entry, which is added if slot is 0. keySize is from small_key_size
+    inline uint32_t putSmall(uint32_t slot, uint32_t ns, uint32_t hash, const uint16_t* key, size_t keyLen, size_t keySize, const uint8_t* val, size_t valLen) {
+        if(!slot) {
+            slot = allocateSmall();
+            small_t& s = *small(slot);
+            s.hash = hash;
+            s.keyLen = keyLen;
+            s.flags = SMALL_USED | ns << SMALL_NS_SHIFT;
+            if(keySize == keyLen) {
+                s.flags |= SMALL_LATIN1;
+                for(size_t i = 0; i < keyLen; i++) s.data[i] = key[i];
+            } else {
+                memcpy(s.data, key, keyLen << 1);
+            }
+            uint32_t& bucket = smallBuckets()[hash & ext().small_mask];
+            s.next = bucket;
+            bucket = slot;
+        }
+        small_t& s = *small(slot);
+        s.valLen = valLen;
+        memcpy(smallValue(s), val, valLen);
+        return slot;
     }
 
+    template<uint32_t SHIFT = 0>
     inline uint32_t find(const uint16_t* key, size_t keyLen, uint32_t hash) const {
-    
+        counters_t& c = counters();
+        count(c.lookups);
+        uint32_t probes = 0;
         uint32_t curr = hashmap[hash & 0xffff];
         while(curr) {
-            node_t& node = *address<node_t>(curr);
+            node_t& node = *address<node_t, SHIFT>(curr);
+            probes++;
             // fprintf(stderr, "cache::find: tests match block %d (keyLen=%d hash=%d)\n", curr, node.keyLen, node.hash);
             if(node.keyLen == keyLen && node.hash == hash && !memcmp(node.key, key, keyLen << 1)) {
-                return curr;
+                break;
             }
-            curr = nexts[curr];
+            curr = node.hash_next;
         }
 
-        return 0;
+        count(c.probes, probes);
+        return curr;
+    }
+
+    // same as find, but the block where the key was found last time is used if the key
+    // is unchanged since then
+    template<uint32_t SHIFT = 0>
+    inline uint32_t find(const uint16_t* key, size_t keyLen, uint32_t hash, handle_t* handle) const {
+        if(!handle) {
+            return find<SHIFT>(key, keyLen, hash);
+        }
+        if(handle->block && handle->generation == generation(hash)) {
+            return handle->block;
+        }
+        uint32_t found = find<SHIFT>(key, keyLen, hash);
+        remember(handle, found, hash);
+        return found;
+    }
+
+    // same as find, but leases are not values
+    template<uint32_t SHIFT = 0>
+    inline uint32_t findValue(const uint16_t* key, size_t keyLen, uint32_t hash, handle_t* handle = NULL) const {
+        uint32_t found = find<SHIFT>(key, keyLen, hash, handle);
+        return found && !(address<node_t, SHIFT>(found)->flags & NODE_LEASE) ? found : 0;
+    }
+
+    inline void remember(handle_t* handle, uint32_t found, uint32_t hash) const {
+        if(handle) {
+            handle->block = found;
+            handle->generation = generation(hash);
+        }
     }
 
     inline void format() {
@@ -128,31 +652,338 @@ typedef struct cache_s {
             nexts[info.blocks_total + info.next_bitmap_index] = ~mask;
         }
 
-        info.head = 0;
-        info.tail = 0;
+        // namespaces are kept, with their keys dropped
+        ext_t& e = ext();
+        for(uint32_t i = 0; i < NAMESPACES; i++) {
+            namespace_t& space = e.namespaces[i];
+            space.blocks_used = 0;
+            space.lru.head = space.lru.tail = 0;
+            space.window.head = space.window.tail = 0;
+            space.window_blocks = 0;
+            space.low.head = space.low.tail = 0;
+            space.pinned.head = space.pinned.tail = 0;
+            space.pinned_blocks = 0;
+        }
+        e.sketch_samples = 0;
+        if(e.policy == POLICY_TINYLFU) {
+            memset(sketch(), 0, (e.sketch_mask + 1) << 3);
+        }
+        if(e.small_slots) {
+            memset(smallBuckets(), 0, (e.small_mask + 1) << 2);
+            for(uint32_t i = 1; i <= e.small_slots; i++) {
+                small(i)->flags = 0;
+                small(i)->next = i < e.small_slots ? i + 1 : 0;
+            }
+            e.small_free = 1;
+            e.small_used = 0;
+            e.small_hand = 0;
+        }
+        if(e.slab_classes) { // pages of the header stay in use
+            uint32_t first_page = (info.blocks_total - info.blocks_available) >> pageShift();
+            uint32_t words = (e.slab_pages + 31) >> 5;
+            uint32_t* pages = pageBitmap();
+            memset(pages, 0, words << 2);
+            for(uint32_t i = 0; i < first_page; i++) pages[i >> 5] |= 1 << (i & 31);
+            for(uint32_t i = e.slab_pages; i < words << 5; i++) pages[i >> 5] |= 1 << (i & 31);
+            e.slab_pages_free = e.slab_pages - first_page;
+            e.next_page_index = first_page >> 5;
+            for(uint32_t cls = 0; cls < e.slab_classes; cls++) {
+                memset(classBitmap(cls), 0xff, ((info.blocks_total >> cls) + 31) >> 5 << 2);
+                e.classes[cls].next_bitmap_index = 0;
+                e.classes[cls].chunks_free = 0;
+            }
+        }
+        e.epoch++;
+        resolveLeases();
+        journal(LOG_CLEAR, 0, NULL, 0);
         info.dirty = 0; // at last, set dirty to 0
     }
 
+    // generation of keys with the hash, which can be read without lock. A modification in
+    // progress either has changed it already, or completes before values are read
+    inline uint64_t generation(uint32_t hash) const {
+        const ext_t& e = ext();
+        return uint64_t(*static_cast<const volatile uint32_t*>(&e.epoch)) << 32 |
+            *static_cast<const volatile uint32_t*>(&e.generations[hash & (GENERATIONS - 1)]);
+    }
+
+    // marks keys with the hash as modified
+    inline void modified(uint32_t hash) {
+        ext().generations[hash & (GENERATIONS - 1)]++;
+    }
+
+    // wakes up processes waiting for leases
+    inline void resolveLeases() {
+        ext_t& e = ext();
+        e.lease_seq++;
+#ifdef __linux__
+        if(e.lease_waiters) {
+            syscall(SYS_futex, &e.lease_seq, FUTEX_WAKE, 0x7fffffff, 0, 0, 0);
+        }
+#endif
+    }
+
+    // copies bytes into the ring of the change log at a position, wrapping around its end
+    inline void logWrite(uint64_t position, const void* src, size_t len) {
+        const ext_t& e = ext();
+        uint8_t* ring = reinterpret_cast<uint8_t*>(this) + e.log_offset;
+        size_t offset = position & e.log_mask;
+        size_t n = e.log_mask + 1 - offset < len ? e.log_mask + 1 - offset : len;
+        memcpy(ring + offset, src, n);
+        memcpy(ring, static_cast<const uint8_t*>(src) + n, len - n);
+    }
+
+    inline void logRead(uint64_t position, void* dst, size_t len) const {
+        const ext_t& e = ext();
+        const uint8_t* ring = reinterpret_cast<const uint8_t*>(this) + e.log_offset;
+        size_t offset = position & e.log_mask;
+        size_t n = e.log_mask + 1 - offset < len ? e.log_mask + 1 - offset : len;
+        memcpy(dst, ring + offset, n);
+        memcpy(static_cast<uint8_t*>(dst) + n, ring, len - n);
+    }
+
+    // appends a record to the change log, if the cache has one. The value is val, or is read from
+    // node `found' if val is NULL. flags are the node flags the priority is taken from
+    inline void journal(uint32_t type, uint32_t ns, const uint16_t* key, size_t keyLen, const uint8_t* val = NULL, size_t valLen = 0, uint32_t flags = 0, uint32_t found = 0) {
+        ext_t& e = ext();
+        if(!e.log_mask) {
+            return;
+        }
+        const namespace_t& s = e.namespaces[ns];
+        log_record_t record;
+        record.length = sizeof(record) + ((s.nameLen + keyLen) << 1) + valLen;
+        uint64_t position = e.log_head;
+        e.log_head += record.length;
+        if(record.length > e.log_mask + 1) {
+            return; // lost by readers behind it, as if it were overwritten
+        }
+        record.type = type;
+        record.priority = flags & NODE_PINNED ? PRIORITY_PINNED : flags & NODE_LOW ? PRIORITY_LOW : PRIORITY_NORMAL;
+        record.nameLen = s.nameLen;
+        record.reserved = 0;
+        record.keyLen = keyLen;
+        logWrite(position, &record, sizeof(record));
+        position += sizeof(record);
+        logWrite(position, s.name, s.nameLen << 1);
+        position += s.nameLen << 1;
+        logWrite(position, key, keyLen << 1);
+        position += keyLen << 1;
+        if(val) {
+            logWrite(position, val, valLen);
+            return;
+        }
+        uint8_t buf[256];
+        for(size_t offset = 0; offset < valLen; offset += sizeof(buf)) {
+            logWrite(position + offset, buf, read(found, offset, buf, sizeof(buf)));
+        }
+    }
+
+    static inline uint32_t sketchIndex(uint32_t hash, uint32_t row, uint32_t mask) {
+        uint64_t h = (hash + SKETCH_SEEDS[row]) * SKETCH_SEEDS[row];
+        h += h >> 32;
+        return static_cast<uint32_t>(h) & mask;
+    }
+
+    // records an access to the key in the frequency sketch
+    inline void record(uint32_t hash) {
+        ext_t& e = ext();
+        if(e.policy != POLICY_TINYLFU) return;
+
+        uint64_t* table = sketch();
+        uint32_t start = (hash & 3) << 2;
+        bool added = false;
+        for(uint32_t i = 0; i < 4; i++) {
+            uint64_t& word = table[sketchIndex(hash, i, e.sketch_mask)];
+            uint32_t shift = (start + i) << 2;
+            if(((word >> shift) & 15) != 15) {
+                word += 1ULL << shift;
+                added = true;
+            }
+        }
+
+        if(added && ++e.sketch_samples == e.sketch_limit) { // aging
+            for(uint32_t i = 0; i <= e.sketch_mask; i++) {
+                table[i] = (table[i] >> 1) & 0x7777777777777777ULL;
+            }
+            e.sketch_samples >>= 1;
+        }
+    }
+
+    inline uint32_t frequency(uint32_t hash) const {
+        const ext_t& e = ext();
+        const uint64_t* table = sketch();
+        uint32_t start = (hash & 3) << 2;
+        uint32_t freq = 15;
+        for(uint32_t i = 0; i < 4; i++) {
+            uint32_t count = (table[sketchIndex(hash, i, e.sketch_mask)] >> ((start + i) << 2)) & 15;
+            if(count < freq) freq = count;
+        }
+        return freq;
+    }
+
+    // size class of a node, whose blocks are chunks of 2^class blocks
+    static inline uint32_t sizeClass(const node_t& node) {
+        return node.flags >> NODE_CLASS_SHIFT;
+    }
+
+    // log2 of the bytes of the chunks of a node
+    template<uint32_t SHIFT = 0>
+    inline uint32_t chunkShift(const node_t& node) const {
+        return blockShift<SHIFT>() + sizeClass(node);
+    }
+
+    // chunks taken by a node of totalLen bytes, which is put in the smallest class that it fits in,
+    // or in chained chunks of the largest class
+    template<uint32_t SHIFT = 0>
+    inline uint32_t chunks(size_t totalLen, uint32_t& cls) const {
+        uint32_t classes = ext().slab_classes;
+        uint32_t shift = blockShift<SHIFT>();
+        for(cls = 0; cls + 1 < classes && totalLen > size_t(1) << shift; cls++) {
+            shift++;
+        }
+        return (totalLen + (size_t(1) << shift) - 1) >> shift;
+    }
+
+    // log2 of the blocks in a page
+    inline uint32_t pageShift() const {
+        return SLAB_PAGE_SHIFT - info.block_size_shift;
+    }
+
+    inline uint32_t* pageBitmap() const {
+        return reinterpret_cast<uint32_t*>(((uint8_t*) this) + ext().slab_offset);
+    }
+
+    inline uint32_t* classBitmap(uint32_t cls) const {
+        return reinterpret_cast<uint32_t*>(((uint8_t*) this) + ext().classes[cls].bitmap_offset);
+    }
+
+    // marks the chunks of a page in the bitmap of a class as used or free
+    inline void markPage(uint32_t cls, uint32_t page, bool used) {
+        uint32_t* bitmap = classBitmap(cls);
+        uint32_t shift = pageShift() - cls; // chunks in a page
+        uint32_t first = page << shift;
+        if(shift >= 5) {
+            memset(bitmap + (first >> 5), used ? 0xff : 0, 1 << (shift - 3));
+        } else {
+            uint32_t mask = ((1 << (1 << shift)) - 1) << (first & 31);
+            bitmap[first >> 5] = used ? bitmap[first >> 5] | mask : bitmap[first >> 5] & ~mask;
+        }
+    }
+
+    inline bool pageFree(uint32_t cls, uint32_t page) const {
+        const uint32_t* bitmap = classBitmap(cls);
+        uint32_t shift = pageShift() - cls;
+        uint32_t first = page << shift;
+        if(shift < 5) {
+            return !(bitmap[first >> 5] & ((1 << (1 << shift)) - 1) << (first & 31));
+        }
+        for(uint32_t i = first >> 5, end = (first >> 5) + (1 << (shift - 5)); i < end; i++) {
+            if(bitmap[i]) return false;
+        }
+        return true;
+    }
+
+    // gives a free page to a class
+    inline void takePage(uint32_t cls) {
+        ext_t& e = ext();
+        uint32_t* pages = pageBitmap();
+        uint32_t words = (e.slab_pages + 31) >> 5;
+        uint32_t& curr = e.next_page_index;
+        while(pages[curr] == 0xffffffff) {
+            if(++curr == words) curr = 0;
+        }
+        givePage(cls, curr << 5 | (31 - __builtin_clz(~pages[curr])));
+    }
+
+    inline void givePage(uint32_t cls, uint32_t page) {
+        ext_t& e = ext();
+        pageBitmap()[page >> 5] |= 1 << (page & 31);
+        e.slab_pages_free--;
+        markPage(cls, page, false);
+        e.classes[cls].chunks_free += 1 << (pageShift() - cls);
+    }
+
+    // same as selectOne, for a chunk of a class which has free chunks
+    inline uint32_t selectChunk(uint32_t cls) {
+        slab_class_t& sc = ext().classes[cls];
+        uint32_t* bitmap = classBitmap(cls);
+        uint32_t words = ((info.blocks_total >> cls) + 31) >> 5;
+
+        counters_t& c = counters();
+        uint32_t& curr = sc.next_bitmap_index;
+        uint32_t bits = bitmap[curr];
+        uint32_t scans = 1;
+        while(bits == 0xffffffff) {
+            if(++curr == words) {
+                curr = 0;
+                count(c.allocation_wraps);
+            }
+            bits = bitmap[curr];
+            scans++;
+        }
+        count(c.allocation_scans, scans);
+        uint32_t bitSelected = 31 - __builtin_clz(~bits);
+        bitmap[curr] = bits | 1 << bitSelected;
+        sc.chunks_free--;
+        return (curr << 5 | bitSelected) << cls;
+    }
+
+    inline uint32_t select(uint32_t cls) {
+        return ext().slab_classes ? selectChunk(cls) : selectOne();
+    }
+
     inline uint32_t selectOne() {
         uint32_t* bitmap = nexts + info.blocks_total;
 
+        counters_t& c = counters();
         uint32_t& curr = info.next_bitmap_index;
         uint32_t bits = bitmap[curr];
+        uint32_t scans = 1;
         while(bits == 0xffffffff) {
             curr++;
             if(curr == info.blocks_total >> 5) {
                 curr = info.first_block >> 5;
+                count(c.allocation_wraps);
             }
             // fprintf(stderr, "will try slot %d\n", curr);
             bits = bitmap[curr];
+            scans++;
         }
+        count(c.allocation_scans, scans);
         // assert(bits != 0xffffffff)
         uint32_t bitSelected = 31 - __builtin_clz(~bits);
         bitmap[curr] = bits | 1 << bitSelected;
         return curr << 5 | bitSelected;
     }
 
-    inline void release(uint32_t block) {
+    // releases chained chunks of a class, pages whose chunks are all free are given back
+    inline void releaseChunks(uint32_t block, uint32_t cls) {
+        ext_t& e = ext();
+        slab_class_t& sc = e.classes[cls];
+        uint32_t* bitmap = classBitmap(cls);
+        uint32_t shift = pageShift();
+        uint32_t count = 0;
+        for(uint32_t next = block; next; next = nexts[next]) {
+            uint32_t chunk = next >> cls;
+            bitmap[chunk >> 5] ^= 1 << (chunk & 31);
+            sc.chunks_free++;
+            count++;
+            uint32_t page = next >> shift;
+            if(pageFree(cls, page)) {
+                markPage(cls, page, true);
+                sc.chunks_free -= 1 << (shift - cls);
+                pageBitmap()[page >> 5] ^= 1 << (page & 31);
+                e.slab_pages_free++;
+            }
+        }
+        info.blocks_used -= count << cls;
+    }
+
+    inline void release(uint32_t block, uint32_t cls) {
+        if(ext().slab_classes) {
+            releaseChunks(block, cls);
+            return;
+        }
         uint32_t* bitmap = nexts + info.blocks_total;
         uint32_t count = 0;
         for(uint32_t next = block; next; next = nexts[next]) {
@@ -164,42 +995,334 @@ typedef struct cache_s {
         info.blocks_used -= count;
     }
 
-    inline void dropNode(uint32_t first_block) {
-        node_t& node = *address<node_t>(first_block);
-        // fprintf(stderr, "dropping node %d (prev:%d next:%d)\n", first_block, node.prev, node.next);
-        // remove from lru list
-        uint32_t& $prev = node.prev ? address<node_t>(node.prev)->next : info.head;
-        uint32_t& $next = node.next ? address<node_t>(node.next)->prev : info.tail;
-        $prev = node.next;
-        $next = node.prev;
+    // whether the chunks of a node are not in a row
+    inline bool fragmented(uint32_t curr) const {
+        uint32_t unit = 1 << sizeClass(*address<node_t>(curr));
+        for(uint32_t next = nexts[curr]; next; curr = next, next = nexts[next]) {
+            if(next != curr + unit) return true;
+        }
+        return false;
+    }
 
-        // remove from hash list
-        uint32_t* toModify = &hashmap[node.hash & 0xffff];
-        while(*toModify != first_block) {
-            node_t* pcurr = address<node_t>(*toModify);
-            toModify = &pcurr->hash_next;
+    // first of n free bits in a row between begin and end, or end if there is none
+    static inline uint32_t findRun(const uint32_t* bitmap, uint32_t begin, uint32_t end, uint32_t n) {
+        for(uint32_t i = begin, run = 0; i < end; i++) {
+            uint32_t word = bitmap[i >> 5];
+            if(!(i & 31) && word == 0xffffffff) {
+                run = 0;
+                i += 31;
+            } else if(word >> (i & 31) & 1) {
+                run = 0;
+            } else if(++run == n) {
+                return i + 1 - n;
+            }
         }
-        *toModify = node.hash_next;
-        // release blocks
-        release(first_block);
+        return end;
     }
 
-    inline uint32_t allocate(uint32_t count) {
-        uint32_t target = info.blocks_available - count;
-        // fprintf(stderr, "allocate: total=%d used=%d, count=%d, target=%d\n", info.blocks_total, info.blocks_used, count, target);
-        if(info.blocks_used > target) { // not enough
-            do {
-                dropNode(info.head);
-            } while (info.blocks_used > target);
+    // takes n free chunks of a class in a row, and returns the first one, or 0 if there is
+    // none. The search starts at `from', which is moved past the run
+    inline uint32_t selectRun(uint32_t cls, uint32_t n, uint32_t& from) {
+        ext_t& e = ext();
+        uint32_t* bitmap = e.slab_classes ? classBitmap(cls) : nexts + info.blocks_total;
+        uint32_t begin = e.slab_classes ? 0 : info.blocks_total - info.blocks_available;
+        uint32_t end = info.blocks_total >> cls;
+        if(from < begin || from >= end) from = begin;
+
+        uint32_t found = findRun(bitmap, from, end, n);
+        if(found == end && from > begin) {
+            found = findRun(bitmap, begin, from, n);
+            if(found == from) found = end;
         }
-        // TODO
-        uint32_t first_block = selectOne();
+        if(found == end && e.slab_classes) { // free pages in a row are given to the class
+            uint32_t shift = pageShift() - cls;
+            uint32_t pages = (n + (1 << shift) - 1) >> shift;
+            uint32_t page = findRun(pageBitmap(), 0, e.slab_pages, pages);
+            if(page != e.slab_pages) {
+                for(uint32_t i = 0; i < pages; i++) {
+                    givePage(cls, page + i);
+                }
+                found = page << shift;
+            }
+        }
+        if(found == end) {
+            return 0;
+        }
+        for(uint32_t i = found; i < found + n; i++) {
+            bitmap[i >> 5] |= 1 << (i & 31);
+        }
+        if(e.slab_classes) {
+            e.classes[cls].chunks_free -= n;
+        }
+        info.blocks_used += n << cls;
+        from = found + n;
+        return found << cls;
+    }
+
+    // moves a fragmented node into chunks in a row, and returns where it is moved to, or 0 if
+    // there is no room. Its key is marked as modified, as handles may hold where it was
+    inline uint32_t relocate(uint32_t curr, uint32_t& from) {
+        node_t& node = *address<node_t>(curr);
+        uint32_t cls = sizeClass(node);
+        uint32_t unit = 1 << cls;
+        uint32_t moved = selectRun(cls, node.blocks >> cls, from);
+        if(!moved) {
+            return 0;
+        }
+        const uint32_t CHUNK_SIZE = 1 << chunkShift(node);
+        uint32_t dst = moved;
+        for(uint32_t src = curr; src; src = nexts[src], dst += unit) {
+            memcpy(address<uint8_t>(dst), address<uint8_t>(src), CHUNK_SIZE);
+            nexts[dst] = nexts[src] ? dst + unit : 0;
+        }
+
+        node_t& target = *address<node_t>(moved);
+        uint32_t* toModify = &hashmap[target.hash & 0xffff];
+        while(*toModify != curr) {
+            toModify = &address<node_t>(*toModify)->hash_next;
+        }
+        *toModify = moved;
+        lru_t& lru = list(target);
+        (target.prev ? address<node_t>(target.prev)->next : lru.head) = moved;
+        (target.next ? address<node_t>(target.next)->prev : lru.tail) = moved;
+
+        release(curr, cls);
+        modified(target.hash);
+        return moved;
+    }
+
+    // lists of a namespace in the order they are evicted
+    enum {
+        LIST_LOW,
+        LIST_MAIN,
+        LIST_WINDOW,
+        LIST_PINNED,
+        LISTS
+    };
+
+    inline uint32_t rank(const node_t& node) const {
+        if(node.flags & NODE_PINNED) return LIST_PINNED;
+        if(node.flags & NODE_LOW) return LIST_LOW;
+        return node.flags & NODE_WINDOW ? LIST_WINDOW : LIST_MAIN;
+    }
+
+    static inline lru_t& list(namespace_t& s, uint32_t rank) {
+        switch(rank) {
+        case LIST_LOW: return s.low;
+        case LIST_WINDOW: return s.window;
+        case LIST_PINNED: return s.pinned;
+        default: return s.lru;
+        }
+    }
+
+    inline lru_t& list(const node_t& node) const {
+        return list(space(node), rank(node));
+    }
+
+    // first node of the lists of a namespace from `rank' on
+    inline uint32_t head(namespace_t& s, uint32_t rank) const {
+        for(; rank < LISTS; rank++) {
+            if(uint32_t curr = list(s, rank).head) return curr;
+        }
+        return 0;
+    }
+
+    // appends node to the tail of the list
+    inline void link(lru_t& list, uint32_t curr) {
+        node_t& node = *address<node_t>(curr);
+        node.next = 0;
+        node.prev = list.tail;
+        if(list.tail) {
+            address<node_t>(list.tail)->next = curr;
+        } else {
+            list.head = curr;
+        }
+        list.tail = curr;
+    }
+
+    inline void unlink(lru_t& list, uint32_t curr) {
+        node_t& node = *address<node_t>(curr);
+        uint32_t& $prev = node.prev ? address<node_t>(node.prev)->next : list.head;
+        uint32_t& $next = node.next ? address<node_t>(node.next)->prev : list.tail;
+        $prev = node.next;
+        $next = node.prev;
+    }
+
+    // moves a node from the admission window to the main LRU list
+    inline void promote(uint32_t curr) {
+        node_t& node = *address<node_t>(curr);
+        namespace_t& s = space(node);
+        unlink(s.window, curr);
+        s.window_blocks -= node.blocks;
+        node.flags &= ~NODE_WINDOW;
+        link(s.lru, curr);
+    }
+
+    inline void dropNode(uint32_t first_block) {
+        node_t& node = *address<node_t>(first_block);
+        // fprintf(stderr, "dropping node %d (prev:%d next:%d)\n", first_block, node.prev, node.next);
+        // remove from lru list
+        unlink(list(node), first_block);
+        if(node.flags & NODE_LEASE) {
+            resolveLeases();
+        } else {
+            modified(node.hash);
+        }
+        namespace_t& s = space(node);
+        s.blocks_used -= node.blocks;
+        if(node.flags & NODE_WINDOW) {
+            s.window_blocks -= node.blocks;
+        } else if(node.flags & NODE_PINNED) {
+            s.pinned_blocks -= node.blocks;
+        }
+
+        // remove from hash list
+        uint32_t* toModify = &hashmap[node.hash & 0xffff];
+        while(*toModify != first_block) {
+            node_t* pcurr = address<node_t>(*toModify);
+            toModify = &pcurr->hash_next;
+        }
+        *toModify = node.hash_next;
+        // release blocks
+        release(first_block, sizeClass(node));
+    }
+
+    // selects the node of the namespace to be evicted next, which is never `keep', nor pinned
+    inline uint32_t victim(namespace_t& s, uint32_t keep) {
+        if(s.low.head && s.low.head != keep) {
+            return s.low.head;
+        }
+        uint32_t curr = s.lru.head != keep ? s.lru.head : 0;
+        if(ext().policy == POLICY_TINYLFU) {
+            uint32_t window_limit = (s.quota ? s.quota : info.blocks_available) / 100 + 1; // 1% of the namespace
+            while(s.window_blocks > window_limit) {
+                uint32_t candidate = s.window.head;
+                if(!curr || candidate == keep ||
+                    frequency(address<node_t>(candidate)->hash) > frequency(address<node_t>(curr)->hash)) {
+                    // admit candidate into the main list
+                    promote(candidate);
+                    if(curr) return curr;
+                } else {
+                    return candidate;
+                }
+            }
+        }
+        if(!curr) { // the main list was empty, unless the window was promoted into it
+            curr = s.lru.head != keep ? s.lru.head : 0;
+        }
+        if(!curr) {
+            curr = s.window.head != keep ? s.window.head : 0;
+        }
+        return curr;
+    }
+
+    // same as victim, but a node of class `cls' is preferred among the next SLAB_SCAN nodes in slab
+    // mode, as evicting a node of another class makes no room unless its page becomes free
+    inline uint32_t victim(namespace_t& s, uint32_t keep, uint32_t cls) {
+        uint32_t curr = victim(s, keep);
+        uint32_t candidate = curr;
+        for(uint32_t i = 0; candidate && i < SLAB_SCAN; i++) {
+            const node_t& node = *address<node_t>(candidate);
+            if(node.flags & NODE_PINNED) break;
+            if(candidate != keep && sizeClass(node) == cls) return candidate;
+            candidate = following(node);
+        }
+        return curr;
+    }
+
+    // selects the namespace to evict from when the cache is full: the one that uses
+    // most blocks beyond its quota, where namespaces without a quota are over budget
+    // with all their blocks. When every namespace stays within its quota, namespace
+    // `ns' is selected, or the largest one if `ns' has nothing to evict. Pinned blocks
+    // are not evictable, unless no namespace has anything else
+    inline namespace_t& overBudget(uint32_t ns, uint32_t keep) {
+        const node_t* kept = keep ? address<node_t>(keep) : NULL;
+        namespace_t* selected = NULL;
+        namespace_t* largest = NULL;
+        namespace_t* pinned = NULL;
+        uint32_t max_over = 0, max_used = 0, self_used = 0;
+        for(uint32_t i = 0; i < NAMESPACES; i++) {
+            namespace_t& s = space(i);
+            uint32_t evictable = s.blocks_used - s.pinned_blocks;
+            if(kept && &space(*kept) == &s && !(kept->flags & NODE_PINNED)) evictable -= kept->blocks;
+            if(s.pinned.head && s.pinned.head != keep) pinned = &s;
+
+            uint32_t over = s.quota ? (evictable > s.quota ? evictable - s.quota : 0) : evictable;
+            if(over > max_over) {
+                max_over = over;
+                selected = &s;
+            }
+            if(evictable > max_used) {
+                max_used = evictable;
+                largest = &s;
+            }
+            if(i == ns) self_used = evictable;
+        }
+        if(selected) return *selected;
+        return self_used ? space(ns) : largest ? *largest : *pinned;
+    }
+
+    // selects the node to evict when the cache is full
+    inline uint32_t reclaim(uint32_t ns, uint32_t keep, uint32_t cls) {
+        namespace_t& s = overBudget(ns, keep);
+        uint32_t curr = ext().slab_classes ? victim(s, keep, cls) : victim(s, keep);
+        if(!curr) { // nothing is left but pinned nodes
+            curr = s.pinned.head != keep ? s.pinned.head : keep ? address<node_t>(keep)->next : 0;
+        }
+        return curr;
+    }
+
+    inline void hit(uint32_t found) const {
+        counters_t& c = counters();
+        count(c.gets);
+        count(found ? c.hits : c.misses);
+    }
+
+    inline void evict(uint32_t curr) {
+        counters_t& c = counters();
+        count(c.evictions);
+        count(c.evicted_bytes, uint64_t(address<node_t>(curr)->blocks) << info.block_size_shift);
+        dropNode(curr);
+    }
+
+    // allocates chained chunks of a class, which are blocks unless the cache has slabs
+    inline uint32_t allocate(uint32_t count, uint32_t ns, uint32_t keep = 0, uint32_t cls = 0) {
+        namespace_t& self = space(ns);
+        uint32_t blocks = count << cls;
+        if(self.quota) { // make room within the quota first
+            uint32_t curr;
+            while(self.blocks_used + blocks > self.quota && (curr = victim(self, keep))) {
+                evict(curr);
+            }
+        }
+
+        ext_t& e = ext();
+        if(e.slab_classes) {
+            slab_class_t& sc = e.classes[cls];
+            while(sc.chunks_free < count) {
+                if(e.slab_pages_free) {
+                    takePage(cls);
+                } else {
+                    evict(reclaim(ns, keep, cls));
+                }
+            }
+        } else {
+            uint32_t target = info.blocks_available - count;
+            // fprintf(stderr, "allocate: total=%d used=%d, count=%d, target=%d\n", info.blocks_total, info.blocks_used, count, target);
+            if(info.blocks_used > target) { // not enough
+                do {
+                    evict(reclaim(ns, keep, cls));
+                } while (info.blocks_used > target);
+            }
+        }
+        ::cache::count(counters().allocated_blocks, blocks);
+        uint32_t first_block = select(cls);
         // fprintf(stderr, "select %d blocks (first: %d)\n", count, first_block);
-        info.blocks_used += count;
+        info.blocks_used += blocks;
 
         uint32_t curr = first_block;
         while(--count) {
-            uint32_t nextBlock = selectOne();
+            uint32_t nextBlock = select(cls);
             // fprintf(stderr, "selected block  %d\n", nextBlock);
             nexts[curr] = nextBlock;
             curr = nextBlock;
@@ -210,29 +1333,83 @@ typedef struct cache_s {
     }
 
     inline void touch(uint32_t curr) {
-        // fprintf(stderr, "cache::touch %d (current: %d)\n", curr, info.tail);
-        if(info.tail == curr) {
+        node_t& node = *address<node_t>(curr);
+        lru_t& lru = list(node);
+        // fprintf(stderr, "cache::touch %d (current: %d)\n", curr, lru.tail);
+        if(lru.tail == curr) {
             return;
         }
          // bring to tail
+        unlink(lru, curr);
+        link(lru, curr);
+        // fprintf(stderr, "touch: head=%d tail=%d curr=%d prev=%d next=%d\n", lru.head, lru.tail, curr, node.prev, node.next);
+    }
+
+    // first node of the namespace in eviction order: the low priority list, the main list, the
+    // admission window, and the pinned list
+    inline uint32_t first(uint32_t ns) const {
+        return head(space(ns), LIST_LOW);
+    }
+
+    inline uint32_t following(const node_t& node) const {
+        return node.next ? node.next : head(space(node), rank(node) + 1);
+    }
+
+    // updates block count of a node, which has been resized
+    inline void resize(node_t& node, uint32_t blocks) {
+        namespace_t& s = space(node);
+        s.blocks_used += blocks - node.blocks;
+        if(node.flags & NODE_WINDOW) {
+            s.window_blocks += blocks - node.blocks;
+        } else if(node.flags & NODE_PINNED) {
+            s.pinned_blocks += blocks - node.blocks;
+        }
+        node.blocks = blocks;
+    }
+
+    // links a new node into the list of its priority, or the admission window
+    inline void place(uint32_t curr, uint32_t priority) {
         node_t& node = *address<node_t>(curr);
-        // assert: node.next != 0
-        address<node_t>(node.next)->prev = node.prev;
+        namespace_t& s = space(node);
+        node.flags |= priority;
+        if(priority & NODE_PINNED) {
+            s.pinned_blocks += node.blocks;
+        } else if(!priority && ext().policy == POLICY_TINYLFU) {
+            node.flags |= NODE_WINDOW;
+            s.window_blocks += node.blocks;
+        }
+        link(list(node), curr);
+    }
 
-        if(node.prev) {
-            address<node_t>(node.prev)->next = node.next;
-        } else { // node is head
-            info.head = node.next;
+    // moves a node into the list of another priority
+    inline void prioritize(uint32_t curr, uint32_t priority) {
+        node_t& node = *address<node_t>(curr);
+        if((node.flags & (NODE_PINNED | NODE_LOW)) == priority) {
+            return;
         }
-        node.next = 0;
-        node.prev = info.tail;
-        address<node_t>(info.tail)->next = curr;
-        info.tail = curr;
-        // fprintf(stderr, "touch: head=%d tail=%d curr=%d prev=%d next=%d\n", info.head, info.tail, curr, node.prev, node.next);
+        namespace_t& s = space(node);
+        unlink(list(node), curr);
+        if(node.flags & NODE_WINDOW) {
+            s.window_blocks -= node.blocks;
+        } else if(node.flags & NODE_PINNED) {
+            s.pinned_blocks -= node.blocks;
+        }
+        node.flags &= ~(NODE_WINDOW | NODE_PINNED | NODE_LOW);
+        place(curr, priority);
+    }
+
+    // blocks of pinned nodes in all namespaces
+    inline uint32_t pinnedBlocks() const {
+        uint32_t blocks = 0;
+        for(uint32_t i = 0; i < NAMESPACES; i++) {
+            blocks += space(i).pinned_blocks;
+        }
+        return blocks;
     }
 
-    inline uint32_t setup(uint32_t blocks, uint32_t hash, size_t keyLen, const uint16_t* key) {
-        uint32_t found = allocate(blocks);
+    inline uint32_t setup(uint32_t chunks, uint32_t cls, uint32_t ns, uint32_t hash, size_t keyLen, const uint16_t* key, uint32_t priority = 0) {
+        uint32_t found = allocate(chunks, ns, 0, cls);
+        uint32_t blocks = chunks << cls;
         node_t& node = *address<node_t>(found);
         node.blocks = blocks;
         node.hash = hash;
@@ -241,15 +1418,9 @@ typedef struct cache_s {
         node.hash_next = hash_head; // insert into linked list
         hash_head = found;
 
-        if(!info.tail) {
-            info.head = info.tail = found;
-            node.prev = node.next = 0;
-        } else {
-            address<node_t>(info.tail)->next = found;
-            node.prev = info.tail;
-            node.next = 0;
-            info.tail = found;
-        }
+        space(ns).blocks_used += blocks;
+        node.flags = cls << NODE_CLASS_SHIFT | ns << NODE_NS_SHIFT;
+        place(found, priority);
         node.keyLen = keyLen;
         memcpy(node.key, key, keyLen << 1);
         return found;
@@ -263,8 +1434,9 @@ typedef struct cache_s {
     }
 
 
+    template<uint32_t SHIFT = 0>
     void read(uint32_t found, uint8_t*& retval, size_t& retvalLen) const {
-        node_t* pnode = address<node_t>(found);
+        node_t* pnode = address<node_t, SHIFT>(found);
         size_t valLen = pnode->valLen;
         uint8_t* val;
 
@@ -277,16 +1449,23 @@ typedef struct cache_s {
 
         uint8_t* currentBlock = reinterpret_cast<uint8_t*>(pnode);
         uint32_t offset = sizeof(node_t) + (pnode->keyLen << 1);
-        const uint32_t BLK_SIZE = 1 << info.block_size_shift;
+        const uint32_t BLK_SIZE = 1 << chunkShift<SHIFT>(*pnode);
+        const uint32_t UNIT = 1 << sizeClass(*pnode);
         uint32_t capacity = BLK_SIZE - offset;
 
         while(capacity < valLen) {
+            // chunks in a row are copied at once
+            while(nexts[found] == found + UNIT && capacity < valLen) {
+                found += UNIT;
+                capacity += BLK_SIZE;
+            }
+            if(capacity >= valLen) break;
             // fprintf(stderr, "copying val (%x+%d) %d bytes\n", currentBlock, offset, capacity);
-            memcpy(val, currentBlock + offset, BLK_SIZE - offset);
+            memcpy(val, currentBlock + offset, capacity);
             val += capacity;
             valLen -= capacity;
             found = nexts[found];
-            currentBlock = address<uint8_t>(found);
+            currentBlock = address<uint8_t, SHIFT>(found);
             offset = 0;
             capacity = BLK_SIZE;
         }
@@ -295,13 +1474,188 @@ typedef struct cache_s {
             memcpy(val, reinterpret_cast<uint8_t*>(currentBlock) + offset, valLen);
         }
     }
+
+    // copies at most len bytes of the value at offset, and returns the number of bytes copied
+    template<uint32_t SHIFT = 0>
+    size_t read(uint32_t found, size_t offset, uint8_t* dst, size_t len) const {
+        const node_t* pnode = address<node_t, SHIFT>(found);
+        if(offset >= pnode->valLen) return 0;
+        if(len > pnode->valLen - offset) len = pnode->valLen - offset;
+
+        const uint32_t BLK_SIZE = 1 << chunkShift<SHIFT>(*pnode);
+        offset += sizeof(node_t) + (pnode->keyLen << 1); // from the head of the first block
+        for(; offset >= BLK_SIZE; offset -= BLK_SIZE) {
+            found = nexts[found];
+        }
+        for(size_t remaining = len; remaining;) {
+            size_t n = BLK_SIZE - offset < remaining ? BLK_SIZE - offset : remaining;
+            memcpy(dst, address<uint8_t, SHIFT>(found) + offset, n);
+            dst += n;
+            remaining -= n;
+            found = nexts[found];
+            offset = 0;
+        }
+        return len;
+    }
+
+    // copies len bytes into the value at offset, which should be within the value
+    template<uint32_t SHIFT = 0>
+    void write(uint32_t found, size_t offset, const uint8_t* src, size_t len) {
+        const node_t* pnode = address<node_t, SHIFT>(found);
+        const uint32_t BLK_SIZE = 1 << chunkShift<SHIFT>(*pnode);
+        offset += sizeof(node_t) + (pnode->keyLen << 1);
+        for(; offset >= BLK_SIZE; offset -= BLK_SIZE) {
+            found = nexts[found];
+        }
+        while(len) {
+            size_t n = BLK_SIZE - offset < len ? BLK_SIZE - offset : len;
+            memcpy(address<uint8_t, SHIFT>(found) + offset, src, n);
+            src += n;
+            len -= n;
+            found = nexts[found];
+            offset = 0;
+        }
+    }
+
+    // copies value into the blocks of a node, which should be large enough
+    template<uint32_t SHIFT = 0>
+    void write(uint32_t found, const uint8_t* val, size_t valLen) {
+        node_t* pnode = address<node_t, SHIFT>(found);
+        pnode->valLen = valLen;
+
+        uint8_t* currentBlock = reinterpret_cast<uint8_t*>(pnode);
+        uint32_t offset = sizeof(node_t) + (pnode->keyLen << 1);
+        const uint32_t BLK_SIZE = 1 << chunkShift<SHIFT>(*pnode);
+        const uint32_t UNIT = 1 << sizeClass(*pnode);
+        uint32_t capacity = BLK_SIZE - offset;
+
+        while(capacity < valLen) {
+            while(nexts[found] == found + UNIT && capacity < valLen) {
+                found += UNIT;
+                capacity += BLK_SIZE;
+            }
+            if(capacity >= valLen) break;
+            // fprintf(stderr, "copying val (%x+%d) %d bytes. next=%d\n", currentBlock, offset, capacity, nexts[found]);
+            memcpy(currentBlock + offset, val, capacity);
+            val += capacity;
+            valLen -= capacity;
+            found = nexts[found];
+            currentBlock = address<uint8_t, SHIFT>(found);
+            offset = 0;
+            capacity = BLK_SIZE;
+        }
+
+        if(valLen) { // capacity >= valLen
+            // fprintf(stderr, "copying remaining val (%x+%d) %d bytes\n", currentBlock, offset, valLen);
+            memcpy(currentBlock + offset, val, valLen);
+        }
+    }
 } cache_t;
 
-bool init(void* ptr, uint32_t blocks, uint32_t block_size_shift, bool forced) {
+static inline void record(latency_t& histogram, uint64_t ns) {
+    uint32_t index;
+    if(ns < 8) {
+        index = ns;
+    } else {
+        uint32_t bits = 63 - __builtin_clzll(ns); // >= 3
+        index = (bits - 2) * 8 + ((ns >> (bits - 3)) & 7);
+        if(index >= LATENCY_BUCKETS) index = LATENCY_BUCKETS - 1;
+    }
+    count(histogram.count);
+    count(histogram.sum, ns);
+    count(histogram.buckets[index]);
+}
+
+// a lock which records the time waiting for it and holding it into the histograms of
+// an operation when latency recording is enabled
+template<typename lock_t>
+struct timed_lock_s {
+    latency_t* histograms;
+    uint64_t acquired;
+    lock_t lock;
+
+    inline timed_lock_s(const cache_t& cache, HANDLE fd, uint32_t op, uint32_t timeout = TIMEOUT_INFINITE) :
+        histograms(cache.latency(op)), acquired(histograms ? clock_ns() : 0), lock(fd, timeout) {
+        if(histograms) {
+            uint64_t current = clock_ns();
+            record(histograms[LATENCY_LOCK], current - acquired);
+            acquired = current;
+        }
+        if(!lock.locked) {
+            count(cache.counters().lock_timeouts);
+            errno = ETIMEDOUT;
+        }
+    }
+    inline ~timed_lock_s() {
+        if(histograms && lock.locked) {
+            record(histograms[LATENCY_HOLD], clock_ns() - acquired);
+        }
+    }
+
+    inline bool locked() const {
+        return lock.locked;
+    }
+};
+
+typedef timed_lock_s<read_lock_t> timed_read_lock_t;
+typedef timed_lock_s<write_lock_t> timed_write_lock_t;
+
+bool init(void* ptr, uint32_t blocks, uint32_t block_size_shift, const options_t& options, bool forced) {
+    stats_slot = process_id() % STATS_SLOTS;
     uint32_t bitmap_size = blocks >> 3;
     uint32_t nexts_size = blocks << 2;
-    uint32_t blocks_available = ((blocks << block_size_shift) - (HEADER_SIZE + bitmap_size + nexts_size)) >> block_size_shift;
-    uint16_t first_block = blocks - blocks_available;
+    uint32_t ext_offset = (HEADER_SIZE + bitmap_size + nexts_size + 63) & ~63;
+    uint32_t ext_size = (sizeof(ext_t) + 63) & ~63;
+    uint32_t sketch_offset = ext_offset + ext_size;
+    uint32_t sketch_words = 0;
+    if(options.policy == POLICY_TINYLFU) {
+        // one 4-bit counter for every 2 blocks, which is at least one per node
+        sketch_words = 64;
+        while(sketch_words < blocks >> 3) sketch_words <<= 1;
+        ext_size += sketch_words << 3;
+    }
+    uint32_t small_offset = ext_offset + ext_size;
+    uint32_t small_buckets = 0;
+    if(options.small_slots) {
+        small_buckets = 1;
+        while(small_buckets < options.small_slots) small_buckets <<= 1;
+        ext_size += (small_buckets << 2) + options.small_slots * sizeof(small_t);
+    }
+    uint32_t slab_offset = ext_offset + ext_size;
+    uint32_t slab_classes = 0;
+    uint32_t class_offsets[SLAB_CLASSES];
+    if(options.slabs) {
+        slab_classes = SLAB_PAGE_SHIFT - block_size_shift + 1;
+        ext_size += ((blocks >> (SLAB_PAGE_SHIFT - block_size_shift)) + 31) >> 5 << 2;
+        for(uint32_t cls = 0; cls < slab_classes; cls++) {
+            class_offsets[cls] = ext_offset + ext_size;
+            ext_size += ((blocks >> cls) + 31) >> 5 << 2;
+        }
+    }
+    uint32_t log_offset = ext_offset + ext_size;
+    uint32_t log_size = 0;
+    if(options.change_log) {
+        log_size = 64;
+        while(log_size < options.change_log && log_size < 1U << 31) log_size <<= 1;
+        if(uint64_t(ext_size) + log_size > uint64_t(blocks) << block_size_shift) {
+            return false;
+        }
+        ext_size += log_size;
+    }
+    if(uint64_t(ext_offset) + ext_size + (1U << block_size_shift) > uint64_t(blocks) << block_size_shift) {
+        return false; // slots leave no block
+    }
+    uint32_t blocks_available = ((blocks << block_size_shift) - (ext_offset + ext_size)) >> block_size_shift;
+    uint32_t first_block = blocks - blocks_available;
+    if(slab_classes) { // whole pages only
+        uint32_t page_shift = SLAB_PAGE_SHIFT - block_size_shift;
+        uint32_t first_page = (blocks - blocks_available + (1 << page_shift) - 1) >> page_shift;
+        uint32_t pages = blocks >> page_shift;
+        if(first_page >= pages) {
+            return false;
+        }
+        blocks_available = (pages - first_page) << page_shift;
+    }
 
     cache_t& cache = *static_cast<cache_t*>(ptr);
 
@@ -309,7 +1663,13 @@ bool init(void* ptr, uint32_t blocks, uint32_t block_size_shift, bool forced) {
         return cache.info.blocks_total == blocks &&
            cache.info.blocks_available == blocks_available &&
            cache.info.block_size_shift == block_size_shift &&
-           cache.info.first_block == first_block;
+           cache.info.first_block == first_block &&
+           cache.info.ext_offset == ext_offset &&
+           cache.ext().size == ext_size &&
+           cache.ext().policy == options.policy &&
+           cache.ext().small_slots == options.small_slots &&
+           cache.ext().slab_classes == slab_classes &&
+           cache.ext().log_mask == (log_size ? log_size - 1 : 0);
     }
     
     // initialize key words
@@ -318,17 +1678,48 @@ bool init(void* ptr, uint32_t blocks, uint32_t block_size_shift, bool forced) {
     cache.info.blocks_available = blocks_available;
     cache.info.block_size_shift = block_size_shift;
     cache.info.first_block = first_block;
+    cache.info.ext_offset = ext_offset;
+
+    ext_t& ext = cache.ext();
+    ext.size = ext_size;
+    ext.policy = options.policy;
+    memset(ext.namespaces, 0, sizeof(ext.namespaces));
+    memset(ext.stats, 0, sizeof(ext.stats));
+    ext.latency = 0;
+    ext.sketch_offset = sketch_offset;
+    ext.sketch_mask = sketch_words - 1;
+    ext.sketch_limit = sketch_words * 80; // 10 times the nodes the sketch is sized for
+    ext.small_offset = small_offset;
+    ext.small_mask = small_buckets - 1;
+    ext.small_slots = options.small_slots;
+    ext.slab_classes = slab_classes;
+    ext.slab_offset = slab_offset;
+    ext.slab_pages = blocks >> (SLAB_PAGE_SHIFT - block_size_shift);
+    for(uint32_t cls = 0; cls < slab_classes; cls++) {
+        ext.classes[cls].bitmap_offset = class_offsets[cls];
+    }
+    ext.log_offset = log_offset;
+    ext.log_mask = log_size ? log_size - 1 : 0;
+    ext.log_head = 0;
     cache.format();
     // fprintf(stderr, "init cache: size %d, blocks %d, usage %d/%d\n", blocks << block_size_shift, blocks, cache.info.blocks_used, cache.info.blocks_available);
     return true;
 }
 
+bool attach(void* ptr, uint32_t size) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
+    stats_slot = process_id() % STATS_SLOTS;
+    return cache.info.magic == MAGIC &&
+        cache.info.block_size_shift >= 6 && cache.info.block_size_shift <= 14 &&
+        uint64_t(cache.info.blocks_total) << cache.info.block_size_shift == size;
+}
+
 #if(0)
 static void dump(cache_t& cache) {
-    fprintf(stderr, "== DUMP START: head: %d tail:%d", cache.info.head, cache.info.tail);
+    fprintf(stderr, "== DUMP START: head: %d tail:%d", cache.info.lru.head, cache.info.lru.tail);
     uint32_t prev = 0;
 
-    for(uint32_t curr = cache.info.head; curr;) {
+    for(uint32_t curr = cache.info.lru.head; curr;) {
         node_t& node = *cache.address<node_t>(curr);
         if(node.prev != prev) {
             fprintf(stderr, "ERROR: %d->prev=%d != %d\n", curr, node.prev, prev);
@@ -350,8 +1741,8 @@ static void dump(cache_t& cache) {
         prev = curr;
         curr = node.next;
     }
-    if(prev != cache.info.tail) {
-        fprintf(stderr, "\nERROR: ended at %d != tail(%d)\n", prev, cache.info.tail);
+    if(prev != cache.info.lru.tail) {
+        fprintf(stderr, "\nERROR: ended at %d != tail(%d)\n", prev, cache.info.lru.tail);
     } else {
         fprintf(stderr, "\nDUMP END ==\n");
     }
@@ -360,8 +1751,9 @@ static void dump(cache_t& cache) {
 #endif
 
 
-inline uint32_t hashsum(const uint16_t* key, size_t keyLen) {
-    uint32_t hash = 0xffffffff;
+// keys of different namespaces never share the same hash
+inline uint32_t hashsum(const uint16_t* key, size_t keyLen, uint32_t ns) {
+    uint32_t hash = 0xffffffff - ns;
     for(size_t i = 0; i < keyLen; i++) {
         hash = hash * 31 + key[i];
         // fprintf(stderr, "hash %d %c %x\n", i, key[i], hash);
@@ -369,19 +1761,34 @@ inline uint32_t hashsum(const uint16_t* key, size_t keyLen) {
     return hash;
 }
 
-void get(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen, uint8_t*& retval, size_t& retvalLen) {
-    // fprintf(stderr, "cache::get: key len %d\n", keyLen);
-    cache_t& cache = *static_cast<cache_t*>(ptr);
+// reads a value under the write lock, see get
+// calls an operation specialized for the block size shift of a cache, in which blocks are addressed
+// and copied with a constant block size, or its generic version for any other shift
+#define SPECIALIZE(shift, op, args) switch(shift) {\
+    case 6: op<6> args; break;\
+    case 7: op<7> args; break;\
+    case 8: op<8> args; break;\
+    case 9: op<9> args; break;\
+    case 10: op<10> args; break;\
+    case 11: op<11> args; break;\
+    case 12: op<12> args; break;\
+    case 13: op<13> args; break;\
+    case 14: op<14> args; break;\
+    default: op<0> args;\
+    }
 
-    uint32_t hash = hashsum(key, keyLen);
-    write_lock_t lock(fd);
-    if(cache.info.dirty) {
-        retval = NULL;
+template<uint32_t SHIFT>
+static void load(cache_t& cache, uint32_t ns, uint32_t hash, const uint16_t* key, size_t keyLen, uint8_t*& retval, size_t& retvalLen, handle_t* handle) {
+    cache.record(hash);
+    if(uint32_t slot = cache.findSmall(ns, key, keyLen, hash)) {
+        cache.hit(slot);
+        cache.small(slot)->flags |= SMALL_REFERENCED;
+        cache.readSmall(slot, retval, retvalLen);
         return;
     }
-
-    uint32_t found = cache.find(key, keyLen, hash);
+    uint32_t found = cache.findValue<SHIFT>(key, keyLen, hash, handle);
     // fprintf(stderr, "cache::get hash=%d found=%d\n", hash, found);
+    cache.hit(found);
     if(!found) {
         retval = NULL;
         return;
@@ -392,133 +1799,290 @@ void get(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen, uint8_t*& ret
     cache.info.dirty = 0;
 
     // found, read it out
-    cache.read(found, retval, retvalLen);
+    cache.read<SHIFT>(found, retval, retvalLen);
     // dump(cache);
 }
 
-void fast_get(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen, uint8_t*& retval, size_t& retvalLen) {
-    // fprintf(stderr, "cache::fast_get: key len %d\n", keyLen);
+int get(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, uint8_t*& retval, size_t& retvalLen, handle_t* handle, uint32_t timeout) {
+    // fprintf(stderr, "cache::get: key len %d\n", keyLen);
     cache_t& cache = *static_cast<cache_t*>(ptr);
 
-    uint32_t hash = hashsum(key, keyLen);
-    read_lock_t lock(fd);
+    uint32_t hash = handle ? handle->hash : hashsum(key, keyLen, ns);
+    timed_write_lock_t lock(cache, fd, LATENCY_GET, timeout);
+    if(!lock.locked()) {
+        retval = NULL;
+        return -1;
+    }
     if(cache.info.dirty) {
         retval = NULL;
-        return;
+        return 0;
     }
 
-    uint32_t found = cache.find(key, keyLen, hash);
+    SPECIALIZE(cache.info.block_size_shift, load, (cache, ns, hash, key, keyLen, retval, retvalLen, handle));
+    return 0;
+}
+
+// gets a value under the read lock, see fast_get
+template<uint32_t SHIFT>
+static void fetch(const cache_t& cache, uint32_t ns, uint32_t hash, const uint16_t* key, size_t keyLen, uint8_t*& retval, size_t& retvalLen, handle_t* handle) {
+    if(uint32_t slot = cache.findSmall(ns, key, keyLen, hash)) {
+        cache.hit(slot);
+        cache.readSmall(slot, retval, retvalLen);
+        return;
+    }
+    uint32_t found = cache.findValue<SHIFT>(key, keyLen, hash, handle);
     // fprintf(stderr, "cache::fast_get hash=%d found=%d\n", hash, found);
+    cache.hit(found);
     if(!found) {
         retval = NULL;
         return;
     }
 
-    cache.read(found, retval, retvalLen);
+    cache.read<SHIFT>(found, retval, retvalLen);
 }
 
-int set(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen, const uint8_t* val, size_t valLen, uint8_t** oldval, size_t* oldvalLen) {
+int fast_get(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, uint8_t*& retval, size_t& retvalLen, handle_t* handle, uint32_t timeout) {
+    // fprintf(stderr, "cache::fast_get: key len %d\n", keyLen);
     cache_t& cache = *static_cast<cache_t*>(ptr);
-    const size_t totalLen = (keyLen << 1) + valLen + sizeof(node_s);
-    const uint32_t BLK_SIZE = 1 << cache.info.block_size_shift;
-    const uint32_t blocksRequired = totalLen / BLK_SIZE + (totalLen % BLK_SIZE ? 1 : 0);
-    // fprintf(stderr, "cache::set: total len %d (%d blocks required)\n", totalLen, blocksRequired);
 
-
-    if(blocksRequired > cache.info.blocks_total) {
-        errno = E2BIG;
+    uint32_t hash = handle ? handle->hash : hashsum(key, keyLen, ns);
+    timed_read_lock_t lock(cache, fd, LATENCY_FAST_GET, timeout);
+    if(!lock.locked()) {
+        retval = NULL;
         return -1;
     }
-
-    uint32_t hash = hashsum(key, keyLen);
-
-    write_lock_t lock(fd);
     if(cache.info.dirty) {
-        cache.format();
-    }
-    // find if key is already exists
-    uint32_t found = cache.find(key, keyLen, hash);
-    node_t* selectedBlock;
-    cache.info.dirty = 1;
-    // fprintf(stderr, "cache::set hash=%d found=%d hash_head=%d\n", hash, found, cache.hashmap[hash & 0xffff]);
-    if(found) { // update
-        if(oldval) { // preserve old value
-            cache.read(found, *oldval, *oldvalLen);
-        }
-        cache.touch(found);
-        selectedBlock = cache.address<node_t>(found);
-        node_t& node = *selectedBlock;
-        if(node.blocks > blocksRequired) { // free extra blocks
-            uint32_t& lastBlk = cache.next(found, blocksRequired);
-            // drop remaining blocks
-            cache.release(lastBlk);
-            // fprintf(stderr, "freeing %d blocks (%d used)\n", node.blocks - blocksRequired, cache.info.blocks_used);
-            lastBlk = 0;
-        } else if(node.blocks < blocksRequired) {
-            cache.next(found, node.blocks) = cache.allocate(blocksRequired - node.blocks);
-        }
-        node.blocks = blocksRequired;
-    } else { // insert
-        if(oldval) {
-            *oldval = NULL;
-        }
-        // insert into hash table
-        found = cache.setup(blocksRequired, hash, keyLen, key);
-        // fprintf(stderr, "cache::set allocated new block %d\n", found);
-        selectedBlock = cache.address<node_t>(found);
+        retval = NULL;
+        return 0;
     }
-    selectedBlock->valLen = valLen;
 
-    // copy values
+    SPECIALIZE(cache.info.block_size_shift, fetch, (cache, ns, hash, key, keyLen, retval, retvalLen, handle));
+    return 0;
+}
 
-    uint8_t* currentBlock = reinterpret_cast<uint8_t*>(selectedBlock);
-    uint32_t offset = sizeof(node_t) + (keyLen << 1);
-    uint32_t capacity = BLK_SIZE - offset;
+int _peek(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, void* context, void(* visitor)(void*,const value_t&), handle_t* handle, uint32_t timeout) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
 
-    while(capacity < valLen) {
-        // fprintf(stderr, "copying val (%x+%d) %d bytes. next=%d\n", currentBlock, offset, capacity, cache.nexts[found]);
-        memcpy(currentBlock + offset, val, capacity);
-        val += capacity;
-        valLen -= capacity;
-        found = cache.nexts[found];
-        currentBlock = cache.address<uint8_t>(found);
-        offset = 0;
-        capacity = BLK_SIZE;
+    uint32_t hash = handle ? handle->hash : hashsum(key, keyLen, ns);
+    timed_read_lock_t lock(cache, fd, LATENCY_FAST_GET, timeout);
+    if(!lock.locked()) {
+        return -1;
+    }
+    if(cache.info.dirty) {
+        return 0;
     }
 
-    if(valLen) { // capacity >= valLen
-        // fprintf(stderr, "copying remaining val (%x+%d) %d bytes\n", currentBlock, offset, valLen);
-        memcpy(reinterpret_cast<uint8_t*>(currentBlock) + offset, val, valLen);
+    if(uint32_t slot = cache.findSmall(ns, key, keyLen, hash)) {
+        cache.hit(slot);
+        small_t& s = *cache.small(slot);
+        value_t value = {ptr, 0, s.valLen, cache.smallValue(s)};
+        visitor(context, value);
+        return 1;
+    }
+    uint32_t found = cache.findValue(key, keyLen, hash, handle);
+    cache.hit(found);
+    if(!found) {
+        return 0;
     }
-    cache.info.dirty = 0;
-    // dump(cache);
-    return 0;
-}
 
-void _enumerate(void* ptr, HANDLE fd, void* enumerator, void(* callback)(void*,uint16_t*,size_t)) {
-    const cache_t& cache = *static_cast<cache_t*>(ptr);
+    value_t value = {ptr, found, cache.address<node_t>(found)->valLen, NULL};
+    visitor(context, value);
+    return 1;
+}
 
-    read_lock_t lock(fd);
-    if(cache.info.dirty) {
-        return;
+size_t read_value(const value_t& value, size_t offset, uint8_t* dst, size_t len) {
+    if(value.data) {
+        if(offset >= value.length) return 0;
+        if(len > value.length - offset) len = value.length - offset;
+        memcpy(dst, value.data + offset, len);
+        return len;
     }
-    uint32_t curr = cache.info.head;
+    return static_cast<const cache_t*>(value.ptr)->read(value.node, offset, dst, len);
+}
 
-    while(curr) {
-        node_t& node = *cache.address<node_t>(curr);
-        callback(enumerator, node.key, node.keyLen);
-        curr = node.next;
-    }
+// whether a value can be stored, evicting others if needed
+static inline bool fits(const cache_t& cache, uint32_t ns, size_t keyLen, size_t valLen) {
+    uint32_t cls;
+    const uint32_t blocksRequired = cache.chunks((keyLen << 1) + valLen + sizeof(node_s), cls) << cls;
+    uint32_t quota = cache.space(ns).quota;
+    return blocksRequired + cache.pinnedBlocks() <= cache.info.blocks_available && (!quota || blocksRequired <= quota);
 }
 
-void _dump(void* ptr, HANDLE fd, void* dumper, void(* callback)(void*,uint16_t*,size_t,uint8_t*)) {
-    const cache_t& cache = *static_cast<cache_t*>(ptr);
+#define KEEP_PRIORITY 0xffffffff // given to store for entries which keep their priority
 
-    read_lock_t lock(fd);
+// node flags of a priority given to set
+static inline uint32_t priorityFlags(uint32_t priority) {
+    return priority == PRIORITY_KEEP ? KEEP_PRIORITY : priority == PRIORITY_PINNED ? NODE_PINNED : priority == PRIORITY_LOW ? NODE_LOW : 0;
+}
+
+// sets a value under the write lock, see set. priority is in node flags, or KEEP_PRIORITY
+template<uint32_t SHIFT>
+static int store(cache_t& cache, uint32_t ns, uint32_t hash, const uint16_t* key, size_t keyLen, const uint8_t* val, size_t valLen, uint8_t** oldval, size_t* oldvalLen, handle_t* handle, uint32_t priority = KEEP_PRIORITY) {
+    const size_t totalLen = (keyLen << 1) + valLen + sizeof(node_s);
+    uint32_t cls;
+    const uint32_t chunksRequired = cache.chunks<SHIFT>(totalLen, cls);
+    const uint32_t blocksRequired = chunksRequired << cls;
+    // fprintf(stderr, "cache::set: total len %d (%d blocks required)\n", totalLen, blocksRequired);
+
+    if(!fits(cache, ns, keyLen, valLen)) {
+        errno = E2BIG;
+        return -1;
+    }
+    cache.record(hash);
+    count(cache.counters().sets);
+    // find if key is already exists, either in a slot or in blocks
+    uint32_t slot = cache.findSmall(ns, key, keyLen, hash);
+    uint32_t found = slot ? 0 : cache.find<SHIFT>(key, keyLen, hash, handle);
+    if(priority == KEEP_PRIORITY) {
+        priority = found ? cache.address<node_t, SHIFT>(found)->flags & (NODE_PINNED | NODE_LOW) : 0;
+    }
+    if(priority & NODE_PINNED) {
+        uint32_t pinned = cache.pinnedBlocks() + blocksRequired;
+        if(found && cache.address<node_t, SHIFT>(found)->flags & NODE_PINNED) {
+            pinned -= cache.address<node_t, SHIFT>(found)->blocks;
+        }
+        if(pinned > cache.info.blocks_available / PINNED_SHARE) {
+            errno = ENOSPC;
+            return -1;
+        }
+    }
+    node_t* selectedBlock;
+    cache.info.dirty = 1;
+    size_t keySize = small_key_size(key, keyLen);
+    bool small = !priority && cache.fitsSmall(keySize, valLen); // slots are evicted by their own clock
+    if(found && small && !(cache.address<node_t, SHIFT>(found)->flags & NODE_LEASE)) { // the value shrinks into a slot
+        if(oldval) {
+            cache.read<SHIFT>(found, *oldval, *oldvalLen);
+            oldval = NULL;
+        }
+        cache.dropNode(found);
+        found = 0;
+    }
+    if(!found && small) {
+        if(oldval) {
+            if(slot) cache.readSmall(slot, *oldval, *oldvalLen);
+            else *oldval = NULL;
+        }
+        cache.putSmall(slot, ns, hash, key, keyLen, keySize, val, valLen);
+        cache.modified(hash);
+        cache.remember(handle, 0, hash);
+        cache.journal(LOG_SET, ns, key, keyLen, val, valLen);
+        cache.info.dirty = 0;
+        return 0;
+    }
+    if(slot) { // the value has outgrown its slot
+        if(oldval) {
+            cache.readSmall(slot, *oldval, *oldvalLen);
+            oldval = NULL;
+        }
+        cache.dropSmall(slot);
+    }
+    if(found && cache.sizeClass(*cache.address<node_t, SHIFT>(found)) != cls) { // moves to another size class
+        if(oldval) {
+            if(cache.address<node_t, SHIFT>(found)->flags & NODE_LEASE) {
+                *oldval = NULL;
+            } else {
+                cache.read<SHIFT>(found, *oldval, *oldvalLen);
+            }
+            oldval = NULL;
+        }
+        cache.dropNode(found);
+        found = 0;
+    }
+    // fprintf(stderr, "cache::set hash=%d found=%d hash_head=%d\n", hash, found, cache.hashmap[hash & 0xffff]);
+    if(found) { // update
+        selectedBlock = cache.address<node_t, SHIFT>(found);
+        node_t& node = *selectedBlock;
+        if(node.flags & NODE_LEASE) { // lease is resolved by the value
+            node.flags &= ~NODE_LEASE;
+            cache.resolveLeases();
+            if(oldval) {
+                *oldval = NULL;
+            }
+        } else if(oldval) { // preserve old value
+            cache.read<SHIFT>(found, *oldval, *oldvalLen);
+        }
+        cache.touch(found);
+        cache.prioritize(found, priority);
+        if(node.blocks > blocksRequired) { // free extra blocks
+            uint32_t& lastBlk = cache.next(found, chunksRequired);
+            // drop remaining blocks
+            cache.release(lastBlk, cls);
+            // fprintf(stderr, "freeing %d blocks (%d used)\n", node.blocks - blocksRequired, cache.info.blocks_used);
+            lastBlk = 0;
+        } else if(node.blocks < blocksRequired) {
+            // the node itself must survive the eviction
+            uint32_t extra = cache.allocate(chunksRequired - (node.blocks >> cls), ns, found, cls);
+            cache.next(found, node.blocks >> cls) = extra;
+        }
+        cache.resize(node, blocksRequired);
+    } else { // insert
+        if(oldval) {
+            *oldval = NULL;
+        }
+        // insert into hash table
+        found = cache.setup(chunksRequired, cls, ns, hash, keyLen, key, priority);
+        // fprintf(stderr, "cache::set allocated new block %d\n", found);
+    }
+
+    // copy values
+    cache.write<SHIFT>(found, val, valLen);
+    cache.modified(hash);
+    cache.remember(handle, found, hash);
+    cache.journal(LOG_SET, ns, key, keyLen, val, valLen, cache.address<node_t, SHIFT>(found)->flags);
+    cache.info.dirty = 0;
+    // dump(cache);
+    return 0;
+}
+
+int set(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const uint8_t* val, size_t valLen, uint8_t** oldval, size_t* oldvalLen, handle_t* handle, uint32_t timeout, uint32_t priority) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
+    uint32_t hash = handle ? handle->hash : hashsum(key, keyLen, ns);
+
+    timed_write_lock_t lock(cache, fd, LATENCY_SET, timeout);
+    if(!lock.locked()) {
+        return -1;
+    }
+    if(cache.info.dirty) {
+        cache.format();
+    }
+    int ret;
+    SPECIALIZE(cache.info.block_size_shift, ret = store, (cache, ns, hash, key, keyLen, val, valLen, oldval, oldvalLen, handle, priorityFlags(priority)));
+    return ret;
+}
+
+void _enumerate(void* ptr, HANDLE fd, uint32_t ns, void* enumerator, void(* callback)(void*,uint16_t*,size_t)) {
+    const cache_t& cache = *static_cast<cache_t*>(ptr);
+
+    timed_read_lock_t lock(cache, fd, LATENCY_SCAN);
     if(cache.info.dirty) {
         return;
     }
-    uint32_t curr = cache.info.head;
+    uint32_t curr = cache.first(ns);
+
+    while(curr) {
+        node_t& node = *cache.address<node_t>(curr);
+        if(!(node.flags & NODE_LEASE)) {
+            callback(enumerator, node.key, node.keyLen);
+        }
+        curr = cache.following(node);
+    }
+    uint16_t key[SMALL_DATA];
+    for(uint32_t slot = 1; slot <= cache.ext().small_slots; slot++) {
+        if(cache.smallOf(slot, ns)) {
+            callback(enumerator, cache.smallKey(slot, key), cache.small(slot)->keyLen);
+        }
+    }
+}
+
+void _dump(void* ptr, HANDLE fd, uint32_t ns, void* dumper, void(* callback)(void*,uint16_t*,size_t,uint8_t*,size_t)) {
+    const cache_t& cache = *static_cast<cache_t*>(ptr);
+
+    timed_read_lock_t lock(cache, fd, LATENCY_SCAN);
+    if(cache.info.dirty) {
+        return;
+    }
+    uint32_t curr = cache.first(ns);
 
     uint8_t tmp[1024];
     uint8_t* val = tmp;
@@ -526,6 +2090,10 @@ void _dump(void* ptr, HANDLE fd, void* dumper, void(* callback)(void*,uint16_t*,
 
     while(curr) {
         node_t& node = *cache.address<node_t>(curr);
+        if(node.flags & NODE_LEASE) {
+            curr = cache.following(node);
+            continue;
+        }
         uint8_t* newVal = val;
         size_t newValLen = valLen;
         cache.read(curr, newVal, newValLen);
@@ -534,80 +2102,206 @@ void _dump(void* ptr, HANDLE fd, void* dumper, void(* callback)(void*,uint16_t*,
             valLen = newValLen;
             val = newVal;
         }
-        callback(dumper, node.key, node.keyLen, newVal);
-        curr = node.next;
+        callback(dumper, node.key, node.keyLen, newVal, newValLen);
+        curr = cache.following(node);
     }
     if(valLen > sizeof(tmp)) delete[] val;
+
+    uint16_t key[SMALL_DATA];
+    for(uint32_t slot = 1; slot <= cache.ext().small_slots; slot++) {
+        if(cache.smallOf(slot, ns)) {
+            small_t& s = *cache.small(slot);
+            callback(dumper, cache.smallKey(slot, key), s.keyLen, cache.smallValue(s), s.valLen);
+        }
+    }
 }
 
-bool contains(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen) {
+bool contains(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen) {
     const cache_t& cache = *static_cast<cache_t*>(ptr);
 
-    uint32_t hash = hashsum(key, keyLen);
+    uint32_t hash = hashsum(key, keyLen, ns);
 
-    read_lock_t lock(fd);
+    timed_read_lock_t lock(cache, fd, LATENCY_SCAN);
     if(cache.info.dirty) {
         return false;
     }
-    return cache.find(key, keyLen, hash);
+    return cache.findSmall(ns, key, keyLen, hash) || cache.findValue(key, keyLen, hash);
 }
 
-bool unset(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen) {
-    cache_t& cache = *static_cast<cache_t*>(ptr);
-
-    uint32_t hash = hashsum(key, keyLen);
-
-    write_lock_t lock(fd);
-    if(cache.info.dirty) {
-        return false;
+// deletes a key under the write lock, see unset
+static bool remove(cache_t& cache, uint32_t ns, uint32_t hash, const uint16_t* key, size_t keyLen) {
+    if(uint32_t slot = cache.findSmall(ns, key, keyLen, hash)) {
+        count(cache.counters().deletes);
+        cache.info.dirty = 1;
+        cache.dropSmall(slot);
+        cache.journal(LOG_UNSET, ns, key, keyLen);
+        cache.info.dirty = 0;
+        return true;
     }
-
     uint32_t found = cache.find(key, keyLen, hash);
     if(found) {
+        count(cache.counters().deletes);
         cache.info.dirty = 1;
         cache.dropNode(found);
+        cache.journal(LOG_UNSET, ns, key, keyLen);
         cache.info.dirty = 0;
     }
     return found;
 }
 
-void clear(void* ptr, HANDLE fd) {
+bool unset(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen) {
     cache_t& cache = *static_cast<cache_t*>(ptr);
-    write_lock_t lock(fd);
-    cache.format();
+
+    uint32_t hash = hashsum(key, keyLen, ns);
+
+    timed_write_lock_t lock(cache, fd, LATENCY_DELETE);
+    if(cache.info.dirty) {
+        return false;
+    }
+    return remove(cache, ns, hash, key, keyLen);
 }
 
-int32_t increase(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen, int32_t increase_by) {
+// drops the keys of a namespace under the write lock, see clear
+static void drop(cache_t& cache, uint32_t ns) {
+    if(!ns) {
+        cache.format();
+        return;
+    }
+    cache.info.dirty = 1;
+    while(uint32_t curr = cache.first(ns)) {
+        cache.dropNode(curr);
+    }
+    for(uint32_t slot = 1; slot <= cache.ext().small_slots; slot++) {
+        if(cache.smallOf(slot, ns)) {
+            cache.dropSmall(slot);
+        }
+    }
+    cache.journal(LOG_CLEAR, ns, NULL, 0);
+    cache.info.dirty = 0;
+}
+
+void clear(void* ptr, HANDLE fd, uint32_t ns) {
     cache_t& cache = *static_cast<cache_t*>(ptr);
-    uint32_t hash = hashsum(key, keyLen);
-    const uint32_t blocksRequired = 1;
+    timed_write_lock_t lock(cache, fd, LATENCY_DELETE);
+    if(cache.info.dirty) {
+        cache.format();
+        return;
+    }
+    drop(cache, ns);
+}
+
+// returns the id of a namespace under the write lock, see namespace_open
+static int openSpace(cache_t& cache, const uint16_t* name, size_t nameLen) {
+    uint32_t ns = 0;
+    for(uint32_t i = 1; i < NAMESPACES; i++) {
+        namespace_t& s = cache.space(i);
+        if(s.nameLen == nameLen && !memcmp(s.name, name, nameLen << 1)) {
+            ns = i;
+            break;
+        } else if(!s.nameLen && !ns) {
+            ns = i; // first free slot
+        }
+    }
+    if(!ns) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    namespace_t& s = cache.space(ns);
+    if(!s.nameLen) {
+        memcpy(s.name, name, nameLen << 1);
+        s.nameLen = nameLen;
+        s.quota = 0;
+    }
+    return ns;
+}
+
+int namespace_open(void* ptr, HANDLE fd, const uint16_t* name, size_t nameLen, const uint32_t* quota) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
+    if(!nameLen || nameLen > NAMESPACE_NAME_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
 
     write_lock_t lock(fd);
     if(cache.info.dirty) {
         cache.format();
     }
+    int ns = openSpace(cache, name, nameLen);
+    if(ns == -1) {
+        return -1;
+    }
+    namespace_t& s = cache.space(ns);
+    if(quota) {
+        // rounded up to blocks, shrinking a namespace takes effect on its next allocation
+        s.quota = (*quota + (1ULL << cache.info.block_size_shift) - 1) >> cache.info.block_size_shift;
+    }
+    return ns;
+}
+
+// increases a value under the write lock, see increase
+static int32_t add(cache_t& cache, uint32_t ns, uint32_t hash, const uint16_t* key, size_t keyLen, int32_t increase_by, handle_t* handle) {
+    const uint32_t blocksRequired = 1;
+
+    cache.record(hash);
+    count(cache.counters().sets);
 
     // find if key is already exists
-    uint32_t found = cache.find(key, keyLen, hash);
+    uint32_t slot = cache.findSmall(ns, key, keyLen, hash);
+    uint32_t found = slot ? 0 : cache.find(key, keyLen, hash, handle);
     node_t* selectedBlock;
     cache.info.dirty = 1;
+    size_t keySize = small_key_size(key, keyLen);
+    bool small = cache.fitsSmall(keySize, 5);
+    if(found && small && !(cache.address<node_t>(found)->flags & (NODE_LEASE | NODE_PINNED | NODE_LOW))) { // longer than an integer, so it is reset in a slot
+        cache.dropNode(found);
+        found = 0;
+    }
+    if(!found && small) {
+        int32_t val = 0;
+        if(slot) {
+            small_t& s = *cache.small(slot);
+            const uint8_t* data = cache.smallValue(s);
+            if(s.valLen == 5 && data[0] == bson::Int32) {
+                memcpy(&val, data + 1, 4);
+            }
+        }
+        val += increase_by;
+        uint8_t data[5] = {bson::Int32};
+        memcpy(data + 1, &val, 4);
+        cache.putSmall(slot, ns, hash, key, keyLen, keySize, data, 5);
+        cache.modified(hash);
+        cache.remember(handle, 0, hash);
+        cache.journal(LOG_SET, ns, key, keyLen, data, 5);
+        cache.info.dirty = 0;
+        return val;
+    }
+    if(slot) { // shorter than an integer, so it is reset in blocks
+        cache.dropSmall(slot);
+    }
     // fprintf(stderr, "cache::set hash=%d found=%d\n", hash, found);
     if(found) { // update
         cache.touch(found);
         selectedBlock = cache.address<node_t>(found);
         node_t& node = *selectedBlock;
-        if(node.blocks > blocksRequired) { // free extra blocks
+        if(node.flags & NODE_LEASE) {
+            node.flags &= ~NODE_LEASE;
+            cache.resolveLeases();
+            node.valLen = 0;
+        }
+        uint32_t cls = cache.sizeClass(node);
+        if(node.blocks > blocksRequired << cls) { // free extra chunks, the first one is kept in its class
             uint32_t& lastBlk = cache.next(found, blocksRequired);
             // drop remaining blocks
-            cache.release(lastBlk);
+            cache.release(lastBlk, cls);
             // fprintf(stderr, "freeing %d blocks (%d used)\n", node.blocks - blocksRequired, cache.info.blocks_used);
             lastBlk = 0;
-            node.blocks = blocksRequired;
+            cache.resize(node, blocksRequired << cls);
             selectedBlock->valLen = 0;
         }
     } else { // insert
         // insert into hash table
-        found = cache.setup(blocksRequired, hash, keyLen, key);
+        found = cache.setup(blocksRequired, 0, ns, hash, keyLen, key);
         // fprintf(stderr, "cache::set allocated new block %d\n", found);
         selectedBlock = cache.address<node_t>(found);
         selectedBlock->valLen = 0;
@@ -621,8 +2315,691 @@ int32_t increase(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen, int32
     }
 
     val += increase_by;
+    cache.modified(hash);
+    cache.remember(handle, found, hash);
+    cache.journal(LOG_SET, ns, key, keyLen, data, 5, selectedBlock->flags);
     cache.info.dirty = 0;
     return val;
 }
 
+int32_t increase(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, int32_t increase_by, handle_t* handle) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
+    uint32_t hash = handle ? handle->hash : hashsum(key, keyLen, ns);
+
+    timed_write_lock_t lock(cache, fd, LATENCY_SET);
+    if(cache.info.dirty) {
+        cache.format();
+    }
+    return add(cache, ns, hash, key, keyLen, increase_by, handle);
+}
+
+// a field of a value of type Fields
+typedef struct field_s {
+    uint32_t    count; // fields of the value
+    size_t      offset; // of the field, or of the end of the value if the field is absent
+    size_t      length; // of the name and the value, with their lengths
+    size_t      valOffset;
+    uint32_t    valLen;
+} field_t;
+
+#define FIELDS_HEADER 5 // type and number of fields
+
+// copies at most len bytes of the value in a slot or in blocks at offset
+static inline size_t readPart(const cache_t& cache, uint32_t slot, uint32_t found, size_t offset, uint8_t* dst, size_t len) {
+    if(!len) {
+        return 0;
+    }
+    if(found) {
+        return cache.read(found, offset, dst, len);
+    }
+    small_t& s = *cache.small(slot);
+    if(offset >= s.valLen) return 0;
+    if(len > s.valLen - offset) len = s.valLen - offset;
+    memcpy(dst, cache_t::smallValue(s) + offset, len);
+    return len;
+}
+
+// looks for a field in the value of a key, which is in a slot or in blocks, or absent if both are 0.
+// Returns 1 if the field is found, 0 if not, or -1 if the key holds a value of another type.
+// Names are compared in place, and values are skipped over
+static int findField(const cache_t& cache, uint32_t slot, uint32_t found, const uint16_t* field, size_t fieldLen, field_t& f) {
+    f.count = 0;
+    f.offset = FIELDS_HEADER;
+    f.length = 0;
+    if(!slot && !found) {
+        return 0;
+    }
+    uint8_t head[FIELDS_HEADER];
+    if(readPart(cache, slot, found, 0, head, FIELDS_HEADER) != FIELDS_HEADER || head[0] != bson::Fields) {
+        return -1;
+    }
+    memcpy(&f.count, head + 1, sizeof(uint32_t));
+    for(uint32_t i = 0; i < f.count; i++, f.offset += f.length) {
+        uint32_t nameLen = 0;
+        readPart(cache, slot, found, f.offset, reinterpret_cast<uint8_t*>(&nameLen), sizeof(uint32_t));
+        f.valOffset = f.offset + 2 * sizeof(uint32_t) + nameLen;
+        readPart(cache, slot, found, f.valOffset - sizeof(uint32_t), reinterpret_cast<uint8_t*>(&f.valLen), sizeof(uint32_t));
+        f.length = 2 * sizeof(uint32_t) + nameLen + f.valLen;
+        if(nameLen != fieldLen << 1) continue;
+
+        uint16_t name[64];
+        size_t compared = 0;
+        while(compared < fieldLen) {
+            size_t n = fieldLen - compared < 64 ? fieldLen - compared : 64;
+            readPart(cache, slot, found, f.offset + sizeof(uint32_t) + (compared << 1), reinterpret_cast<uint8_t*>(name), n << 1);
+            if(memcmp(name, field + compared, n << 1)) break;
+            compared += n;
+        }
+        if(compared == fieldLen) {
+            return 1;
+        }
+    }
+    f.length = 0;
+    return 0;
+}
+
+// stores the value of a key with field `f' replaced by `field' and `val', or removed if val is
+// NULL. The key is removed with its last field
+static int rewrite(cache_t& cache, uint32_t ns, uint32_t hash, const uint16_t* key, size_t keyLen, uint32_t slot, uint32_t found, const field_t& f,
+    const uint16_t* field, size_t fieldLen, const uint8_t* val, size_t valLen, handle_t* handle) {
+    size_t oldLen = found ? cache.address<node_t>(found)->valLen : slot ? cache.small(slot)->valLen : FIELDS_HEADER;
+    size_t added = val ? 2 * sizeof(uint32_t) + (fieldLen << 1) + valLen : 0;
+    uint32_t count = f.count + (f.length ? 0 : 1) - (val ? 0 : 1);
+    if(!count) {
+        cache.info.dirty = 1;
+        if(slot) cache.dropSmall(slot);
+        if(found) cache.dropNode(found);
+        cache.journal(LOG_UNSET, ns, key, keyLen);
+        cache.info.dirty = 0;
+        return 0;
+    }
+
+    std::vector<uint8_t> value(oldLen - f.length + added);
+    uint8_t* data = &value[0];
+    data[0] = bson::Fields;
+    memcpy(data + 1, &count, sizeof(uint32_t));
+    readPart(cache, slot, found, FIELDS_HEADER, data + FIELDS_HEADER, f.offset - FIELDS_HEADER);
+    data += f.offset;
+    if(val) {
+        uint32_t len = fieldLen << 1;
+        memcpy(data, &len, sizeof(uint32_t));
+        memcpy(data + sizeof(uint32_t), field, len);
+        data += sizeof(uint32_t) + len;
+        len = valLen;
+        memcpy(data, &len, sizeof(uint32_t));
+        memcpy(data + sizeof(uint32_t), val, valLen);
+        data += sizeof(uint32_t) + valLen;
+    }
+    readPart(cache, slot, found, f.offset + f.length, data, oldLen - f.offset - f.length);
+    // the hash keeps its priority, hashes in slots are of normal priority
+    uint32_t priority = found ? cache.address<node_t>(found)->flags & (NODE_PINNED | NODE_LOW) : 0;
+    return store<0>(cache, ns, hash, key, keyLen, &value[0], value.size(), NULL, NULL, handle, priority);
+}
+
+int hset(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const uint16_t* field, size_t fieldLen, const uint8_t* val, size_t valLen, handle_t* handle, uint32_t timeout) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
+    uint32_t hash = handle ? handle->hash : hashsum(key, keyLen, ns);
+
+    timed_write_lock_t lock(cache, fd, LATENCY_SET, timeout);
+    if(!lock.locked()) {
+        return -1;
+    }
+    if(cache.info.dirty) {
+        cache.format();
+    }
+    uint32_t slot = cache.findSmall(ns, key, keyLen, hash);
+    uint32_t found = slot ? 0 : cache.findValue(key, keyLen, hash, handle);
+    field_t f;
+    int ret = findField(cache, slot, found, field, fieldLen, f);
+    if(ret == -1) {
+        errno = EINVAL;
+        return -1;
+    }
+    if(ret && found && f.valLen == valLen) { // overwritten in place
+        cache.record(hash);
+        count(cache.counters().sets);
+        cache.info.dirty = 1;
+        cache.touch(found);
+        cache.write(found, f.valOffset, val, valLen);
+        cache.modified(hash);
+        cache.remember(handle, found, hash);
+        cache.journal(LOG_SET, ns, key, keyLen, NULL, cache.address<node_t>(found)->valLen, cache.address<node_t>(found)->flags, found);
+        cache.info.dirty = 0;
+        return 0;
+    }
+    if(rewrite(cache, ns, hash, key, keyLen, slot, found, f, field, fieldLen, val, valLen, handle) == -1) {
+        return -1;
+    }
+    return !ret;
+}
+
+int hget(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const uint16_t* field, size_t fieldLen, uint8_t*& retval, size_t& retvalLen, handle_t* handle, uint32_t timeout) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
+    uint32_t hash = handle ? handle->hash : hashsum(key, keyLen, ns);
+    uint8_t* buffer = retval;
+    retval = NULL;
+
+    timed_write_lock_t lock(cache, fd, LATENCY_GET, timeout);
+    if(!lock.locked()) {
+        return -1;
+    }
+    if(cache.info.dirty) {
+        return 0;
+    }
+    cache.record(hash);
+    uint32_t slot = cache.findSmall(ns, key, keyLen, hash);
+    uint32_t found = slot ? 0 : cache.findValue(key, keyLen, hash, handle);
+    field_t f;
+    int ret = findField(cache, slot, found, field, fieldLen, f);
+    if(ret == -1) {
+        errno = EINVAL;
+        return -1;
+    }
+    cache.hit(ret);
+    if(!ret) {
+        return 0;
+    }
+    if(slot) {
+        cache.small(slot)->flags |= SMALL_REFERENCED;
+    } else {
+        cache.info.dirty = 1;
+        cache.touch(found);
+        cache.info.dirty = 0;
+    }
+    retval = f.valLen > retvalLen ? new uint8_t[f.valLen] : buffer;
+    retvalLen = readPart(cache, slot, found, f.valOffset, retval, f.valLen);
+    return 1;
+}
+
+int hdel(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const uint16_t* field, size_t fieldLen, handle_t* handle, uint32_t timeout) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
+    uint32_t hash = handle ? handle->hash : hashsum(key, keyLen, ns);
+
+    timed_write_lock_t lock(cache, fd, LATENCY_DELETE, timeout);
+    if(!lock.locked()) {
+        return -1;
+    }
+    if(cache.info.dirty) {
+        return 0;
+    }
+    uint32_t slot = cache.findSmall(ns, key, keyLen, hash);
+    uint32_t found = slot ? 0 : cache.findValue(key, keyLen, hash, handle);
+    field_t f;
+    int ret = findField(cache, slot, found, field, fieldLen, f);
+    if(ret == -1) {
+        errno = EINVAL;
+        return -1;
+    }
+    if(!ret) {
+        return 0;
+    }
+    count(cache.counters().deletes);
+    return rewrite(cache, ns, hash, key, keyLen, slot, found, f, NULL, 0, NULL, 0, handle) == -1 ? -1 : 1;
+}
+
+int hincr(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const uint16_t* field, size_t fieldLen, int32_t increase_by, int32_t& result, handle_t* handle, uint32_t timeout) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
+    uint32_t hash = handle ? handle->hash : hashsum(key, keyLen, ns);
+
+    timed_write_lock_t lock(cache, fd, LATENCY_SET, timeout);
+    if(!lock.locked()) {
+        return -1;
+    }
+    if(cache.info.dirty) {
+        cache.format();
+    }
+    uint32_t slot = cache.findSmall(ns, key, keyLen, hash);
+    uint32_t found = slot ? 0 : cache.findValue(key, keyLen, hash, handle);
+    field_t f;
+    int ret = findField(cache, slot, found, field, fieldLen, f);
+    if(ret == -1) {
+        errno = EINVAL;
+        return -1;
+    }
+    uint8_t data[5] = {bson::Int32};
+    result = 0;
+    if(ret && f.valLen == 5) {
+        readPart(cache, slot, found, f.valOffset, data, 5);
+        if(data[0] == bson::Int32) {
+            memcpy(&result, data + 1, 4);
+        } else {
+            data[0] = bson::Int32;
+        }
+    }
+    result += increase_by;
+    memcpy(data + 1, &result, 4);
+    if(ret && found && f.valLen == 5) { // overwritten in place
+        cache.record(hash);
+        count(cache.counters().sets);
+        cache.info.dirty = 1;
+        cache.touch(found);
+        cache.write(found, f.valOffset, data, 5);
+        cache.modified(hash);
+        cache.remember(handle, found, hash);
+        cache.journal(LOG_SET, ns, key, keyLen, NULL, cache.address<node_t>(found)->valLen, cache.address<node_t>(found)->flags, found);
+        cache.info.dirty = 0;
+        return 0;
+    }
+    return rewrite(cache, ns, hash, key, keyLen, slot, found, f, field, fieldLen, data, 5, handle);
+}
+
+// whether the value of a key is the same as val, or the key is absent if val is NULL
+static bool matches(const cache_t& cache, uint32_t ns, uint32_t hash, const uint16_t* key, size_t keyLen, const uint8_t* val, size_t valLen) {
+    uint32_t slot = cache.findSmall(ns, key, keyLen, hash);
+    uint32_t found = slot ? 0 : cache.findValue(key, keyLen, hash);
+    if(!slot && !found) {
+        return !val;
+    }
+    size_t length = slot ? cache.small(slot)->valLen : cache.address<node_t>(found)->valLen;
+    if(!val || length != valLen) {
+        return false;
+    }
+    uint8_t buf[256];
+    for(size_t offset = 0; offset < valLen; offset += sizeof(buf)) {
+        size_t n = readPart(cache, slot, found, offset, buf, sizeof(buf));
+        if(memcmp(buf, val + offset, n)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int transaction(void* ptr, HANDLE fd, uint32_t ns, op_t* ops, size_t n, uint32_t timeout) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
+    std::vector<uint32_t> hashes(n);
+    for(size_t i = 0; i < n; i++) {
+        hashes[i] = hashsum(ops[i].key, ops[i].keyLen, ns);
+    }
+
+    timed_write_lock_t lock(cache, fd, LATENCY_SET, timeout);
+    if(!lock.locked()) {
+        return -1;
+    }
+    if(cache.info.dirty) {
+        cache.format();
+    }
+
+    // nothing is applied unless all checks pass and all values can be stored
+    for(size_t i = 0; i < n; i++) {
+        const op_t& op = ops[i];
+        if(op.type == OP_CHECK && !matches(cache, ns, hashes[i], op.key, op.keyLen, op.val, op.valLen)) {
+            return 0;
+        }
+        if(op.type == OP_SET && !fits(cache, ns, op.keyLen, op.valLen)) {
+            errno = E2BIG;
+            return -1;
+        }
+    }
+
+    for(size_t i = 0; i < n; i++) {
+        op_t& op = ops[i];
+        switch(op.type) {
+        case OP_GET:
+            load<0>(cache, ns, hashes[i], op.key, op.keyLen, op.retval, op.retvalLen, NULL);
+            break;
+        case OP_SET:
+            store<0>(cache, ns, hashes[i], op.key, op.keyLen, op.val, op.valLen, NULL, NULL, NULL);
+            break;
+        case OP_UNSET:
+            op.result = remove(cache, ns, hashes[i], op.key, op.keyLen);
+            break;
+        case OP_INCREASE:
+            op.result = add(cache, ns, hashes[i], op.key, op.keyLen, op.increase_by, NULL);
+            break;
+        }
+    }
+    return 1;
+}
+
+long log_read(void* ptr, HANDLE fd, uint64_t& cursor, uint8_t* buf, size_t bufLen) {
+    const cache_t& cache = *static_cast<cache_t*>(ptr);
+    const ext_t& e = cache.ext();
+    if(!e.log_mask) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    timed_read_lock_t lock(cache, fd, LATENCY_SCAN);
+    uint64_t head = e.log_head;
+    if(cursor > head || head - cursor > e.log_mask + 1) { // overwritten, or the cache is created again
+        errno = ERANGE;
+        return -1;
+    }
+    size_t copied = 0;
+    while(cursor < head) {
+        uint32_t length;
+        cache.logRead(cursor, &length, sizeof(length));
+        if(length > bufLen - copied) {
+            if(copied) break;
+            errno = ENOBUFS;
+            return -1;
+        }
+        cache.logRead(cursor, buf + copied, length);
+        copied += length;
+        cursor += length;
+    }
+    return copied;
+}
+
+// makes a record of a key of a snapshot, and returns where its value of valLen bytes is copied
+static uint8_t* frame(std::vector<uint8_t>& record, uint32_t type, const namespace_t& s, const uint16_t* key, size_t keyLen, size_t valLen, uint32_t priority) {
+    log_record_t head;
+    head.length = sizeof(head) + ((s.nameLen + keyLen) << 1) + valLen;
+    head.type = type;
+    head.priority = priority;
+    head.nameLen = s.nameLen;
+    head.reserved = 0;
+    head.keyLen = keyLen;
+    record.resize(head.length);
+    uint8_t* data = &record[0];
+    memcpy(data, &head, sizeof(head));
+    memcpy(data + sizeof(head), s.name, s.nameLen << 1);
+    memcpy(data + sizeof(head) + (s.nameLen << 1), key, keyLen << 1);
+    return data + head.length - valLen;
+}
+
+uint64_t _snapshot(void* ptr, HANDLE fd, void* context, void(* callback)(void*,const uint8_t*,size_t)) {
+    const cache_t& cache = *static_cast<cache_t*>(ptr);
+    const ext_t& e = cache.ext();
+
+    timed_read_lock_t lock(cache, fd, LATENCY_SCAN);
+    std::vector<uint8_t> record;
+    frame(record, LOG_CLEAR, e.namespaces[0], NULL, 0, 0, PRIORITY_NORMAL);
+    callback(context, &record[0], record.size());
+    if(cache.info.dirty) {
+        return e.log_head; // the cache is cleared by the next writer
+    }
+    for(uint32_t ns = 0; ns < NAMESPACES; ns++) {
+        const namespace_t& s = e.namespaces[ns];
+        if(ns && !s.nameLen) {
+            continue;
+        }
+        // from the next victim on, so that entries are applied in the order they are used
+        for(uint32_t curr = cache.first(ns); curr;) {
+            node_t& node = *cache.address<node_t>(curr);
+            if(!(node.flags & NODE_LEASE)) {
+                uint8_t* val = frame(record, LOG_SET, s, node.key, node.keyLen, node.valLen,
+                    node.flags & NODE_PINNED ? PRIORITY_PINNED : node.flags & NODE_LOW ? PRIORITY_LOW : PRIORITY_NORMAL);
+                cache.read(curr, 0, val, node.valLen);
+                callback(context, &record[0], record.size());
+            }
+            curr = cache.following(node);
+        }
+        uint16_t key[SMALL_DATA];
+        for(uint32_t slot = 1; slot <= e.small_slots; slot++) {
+            if(cache.smallOf(slot, ns)) {
+                small_t& sm = *cache.small(slot);
+                uint8_t* val = frame(record, LOG_SET, s, cache.smallKey(slot, key), sm.keyLen, sm.valLen, PRIORITY_NORMAL);
+                memcpy(val, cache.smallValue(sm), sm.valLen);
+                callback(context, &record[0], record.size());
+            }
+        }
+    }
+    return e.log_head;
+}
+
+long log_apply(void* ptr, HANDLE fd, const uint8_t* records, size_t len, uint32_t timeout) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
+
+    timed_write_lock_t lock(cache, fd, LATENCY_SET, timeout);
+    if(!lock.locked()) {
+        return -1;
+    }
+    if(cache.info.dirty) {
+        cache.format();
+    }
+    size_t applied = 0;
+    while(len - applied >= sizeof(log_record_t)) {
+        log_record_t head;
+        memcpy(&head, records + applied, sizeof(head));
+        size_t keyOffset = sizeof(head) + (head.nameLen << 1);
+        size_t valOffset = keyOffset + (size_t(head.keyLen) << 1);
+        if(head.length < valOffset || head.type > LOG_CLEAR || head.priority > PRIORITY_PINNED || head.nameLen > NAMESPACE_NAME_MAX) {
+            errno = EINVAL;
+            return -1;
+        }
+        // keys are bounded as those given to set, records of clear have none
+        if(head.type == LOG_CLEAR ? head.keyLen != 0 : head.keyLen > 256 || (head.keyLen << 1) + 32 > 1U << cache.info.block_size_shift) {
+            errno = EINVAL;
+            return -1;
+        }
+        if(head.length > len - applied) {
+            break; // cut, to be applied with the rest of it
+        }
+        const uint8_t* record = records + applied;
+        applied += head.length;
+
+        // keys are copied out, as records are not aligned
+        std::vector<uint16_t> text(head.nameLen + head.keyLen + 1);
+        memcpy(&text[0], record + sizeof(head), valOffset - sizeof(head));
+        int ns = head.nameLen ? openSpace(cache, &text[0], head.nameLen) : 0;
+        if(ns == -1) {
+            continue; // no namespace is left
+        }
+        const uint16_t* key = &text[head.nameLen];
+        uint32_t hash = hashsum(key, head.keyLen, ns);
+        switch(head.type) {
+        case LOG_SET:
+            store<0>(cache, ns, hash, key, head.keyLen, record + valOffset, head.length - valOffset, NULL, NULL, NULL, priorityFlags(head.priority));
+            break;
+        case LOG_UNSET:
+            remove(cache, ns, hash, key, head.keyLen);
+            break;
+        case LOG_CLEAR:
+            drop(cache, ns);
+            break;
+        }
+    }
+    return applied;
+}
+
+uint64_t generation(void* ptr, uint32_t ns, const uint16_t* key, size_t keyLen, const handle_t* handle) {
+    return static_cast<cache_t*>(ptr)->generation(handle ? handle->hash : hashsum(key, keyLen, ns));
+}
+
+void fragmentation(void* ptr, HANDLE fd, fragmentation_t& result) {
+    const cache_t& cache = *static_cast<cache_t*>(ptr);
+    memset(&result, 0, sizeof(result));
+
+    timed_read_lock_t lock(cache, fd, LATENCY_SCAN);
+    if(cache.info.dirty) {
+        return;
+    }
+    for(uint32_t bucket = 0; bucket < 65536; bucket++) {
+        for(uint32_t curr = cache.hashmap[bucket]; curr; curr = cache.address<node_t>(curr)->hash_next) {
+            result.values++;
+            if(cache.nexts[curr]) result.chained++;
+            if(cache.fragmented(curr)) result.fragmented++;
+        }
+    }
+}
+
+uint32_t compact(void* ptr, HANDLE fd, uint32_t budget) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
+    uint64_t deadline = now() + budget;
+    uint32_t moved = 0;
+
+    // the lock is released between slices, so that other operations wait at most for one
+    for(uint32_t done = 0; done < 65536 && (!done || now() < deadline);) {
+        timed_write_lock_t lock(cache, fd, LATENCY_SET);
+        if(cache.info.dirty) {
+            cache.format();
+        }
+        cache.info.dirty = 1;
+        uint32_t& cursor = cache.ext().compact_cursor;
+        uint32_t from = 0; // where free runs are looked for
+        for(uint32_t end = done + COMPACT_SLICE; done < end; done++) {
+            uint32_t curr = cache.hashmap[cursor];
+            cursor = (cursor + 1) & 0xffff;
+            while(curr) {
+                uint32_t next = cache.address<node_t>(curr)->hash_next;
+                if(cache.fragmented(curr) && cache.relocate(curr, from)) {
+                    moved++;
+                }
+                curr = next;
+            }
+        }
+        cache.info.dirty = 0;
+    }
+    if(moved) {
+        count(cache.counters().compactions, moved);
+    }
+    return moved;
+}
+
+void make_handle(void* ptr, uint32_t ns, const uint16_t* key, size_t keyLen, handle_t& handle) {
+    handle.hash = hashsum(key, keyLen, ns);
+    handle.block = 0;
+    handle.generation = 0;
+}
+
+void stats(void* ptr, HANDLE fd, stats_t& stats) {
+    const cache_t& cache = *static_cast<cache_t*>(ptr);
+    memset(&stats, 0, sizeof(stats));
+
+    read_lock_t lock(fd);
+    const ext_t& ext = cache.ext();
+    uint64_t* sum = reinterpret_cast<uint64_t*>(&stats.counters);
+    for(uint32_t i = 0; i < STATS_SLOTS; i++) {
+        const uint64_t* counters = reinterpret_cast<const uint64_t*>(&ext.stats[i].counters);
+        for(uint32_t j = 0; j < sizeof(counters_t) / sizeof(uint64_t); j++) {
+            sum[j] += counters[j];
+        }
+    }
+    stats.block_size = 1 << cache.info.block_size_shift;
+    stats.blocks_available = cache.info.blocks_available;
+    stats.blocks_used = cache.info.blocks_used;
+    stats.small_slots = ext.small_slots;
+    stats.small_used = ext.small_used;
+    stats.slab_classes = ext.slab_classes;
+    stats.slab_pages = ext.slab_pages;
+    stats.slab_pages_free = ext.slab_pages_free;
+    stats.pinned_blocks = cache.pinnedBlocks();
+    stats.log_size = ext.log_mask ? ext.log_mask + 1 : 0;
+    stats.log_position = ext.log_head;
+}
+
+void latency_enable(void* ptr, HANDLE fd, bool enabled) {
+    ext_t& ext = static_cast<cache_t*>(ptr)->ext();
+    write_lock_t lock(fd);
+    if(enabled && !ext.latency) {
+        memset(ext.latencies, 0, sizeof(ext.latencies));
+    }
+    ext.latency = enabled;
+}
+
+bool latency_enabled(void* ptr) {
+    return static_cast<cache_t*>(ptr)->latency(0);
 }
+
+void latency(void* ptr, HANDLE fd, latency_t* histograms) {
+    const ext_t& ext = static_cast<cache_t*>(ptr)->ext();
+    read_lock_t lock(fd);
+    memcpy(histograms, ext.latencies, sizeof(ext.latencies));
+}
+
+uint64_t latency_clock() {
+    return clock_ns();
+}
+
+void latency_record(void* ptr, uint32_t histogram, uint64_t ns) {
+    record(static_cast<cache_t*>(ptr)->ext().latencies[histogram], ns);
+}
+
+uint64_t latency_value(uint32_t bucket) {
+    if(bucket < 8) return bucket;
+    uint32_t bits = bucket / 8 + 2;
+    return uint64_t(8 | (bucket & 7)) << (bits - 3);
+}
+
+int get_or_lock(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, uint32_t leaseMs, uint8_t*& retval, size_t& retvalLen, uint32_t& seq, uint32_t& wait, handle_t* handle) {
+    cache_t& cache = *static_cast<cache_t*>(ptr);
+    const size_t totalLen = (keyLen << 1) + sizeof(lease_t) + sizeof(node_s);
+    uint32_t cls;
+    const uint32_t chunksRequired = cache.chunks(totalLen, cls);
+    const uint32_t blocksRequired = chunksRequired << cls;
+
+    uint32_t hash = handle ? handle->hash : hashsum(key, keyLen, ns);
+    retval = NULL;
+    retvalLen = 0;
+
+    timed_write_lock_t lock(cache, fd, LATENCY_GET);
+    if(cache.info.dirty) {
+        cache.format();
+    }
+    cache.record(hash);
+
+    if(uint32_t slot = cache.findSmall(ns, key, keyLen, hash)) {
+        cache.small(slot)->flags |= SMALL_REFERENCED;
+        cache.readSmall(slot, retval, retvalLen);
+        cache.hit(slot);
+        return LEASE_FOUND;
+    }
+    uint32_t found = cache.find(key, keyLen, hash, handle);
+    uint64_t current = now();
+    lease_t lease;
+    if(found) {
+        node_t& node = *cache.address<node_t>(found);
+        cache.info.dirty = 1;
+        cache.touch(found);
+        cache.info.dirty = 0;
+        if(!(node.flags & NODE_LEASE)) {
+            cache.read(found, retval, retvalLen);
+            cache.hit(found);
+            return LEASE_FOUND;
+        }
+
+        uint8_t* pLease = reinterpret_cast<uint8_t*>(&lease);
+        size_t leaseLen = sizeof(lease);
+        cache.read(found, pLease, leaseLen);
+        bool holder = lease.pid == process_id() && lease.thread == thread_token();
+        if(lease.expires > current && !holder && process_alive(lease.pid)) {
+            seq = cache.ext().lease_seq;
+            wait = lease.expires - current;
+            return LEASE_BUSY;
+        }
+        // the lease is held by the caller, has expired, or its holder has died
+    } else {
+        uint32_t quota = cache.space(ns).quota;
+        if(quota && blocksRequired > quota) {
+            errno = E2BIG;
+            return -1;
+        }
+        cache.info.dirty = 1;
+        found = cache.setup(chunksRequired, cls, ns, hash, keyLen, key);
+        cache.address<node_t>(found)->flags |= NODE_LEASE;
+        cache.remember(handle, found, hash);
+    }
+
+    cache.info.dirty = 1;
+    lease.pid = process_id();
+    lease.thread = thread_token();
+    lease.expires = current + leaseMs;
+    cache.write(found, reinterpret_cast<uint8_t*>(&lease), sizeof(lease));
+    cache.info.dirty = 0;
+    cache.hit(0);
+    return LEASE_ACQUIRED;
+}
+
+void lease_wait(void* ptr, uint32_t seq, uint32_t timeout) {
+    ext_t& ext = static_cast<cache_t*>(ptr)->ext();
+#ifdef __linux__
+    struct timespec ts;
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000;
+    __sync_fetch_and_add(&ext.lease_waiters, 1);
+    syscall(SYS_futex, &ext.lease_seq, FUTEX_WAIT, seq, &ts, 0, 0);
+    __sync_fetch_and_sub(&ext.lease_waiters, 1);
+#else
+    // no futex, poll the sequence instead
+    for(uint64_t until = now() + timeout; *static_cast<volatile uint32_t*>(&ext.lease_seq) == seq && now() < until; ) {
+#ifdef _WIN32
+        Sleep(1);
+#else
+        usleep(1000);
+#endif
+    }
+#endif
+}
+
+}
\ No newline at end of file
@@ -1,6 +1,9 @@
 #ifndef MEMCACHE_H_
 #define MEMCACHE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifndef _WIN32
 typedef int HANDLE;
 #else
@@ -8,37 +11,298 @@ typedef int HANDLE;
 #endif
 
 #define HEADER_SIZE 262144
+#define CACHE_HEADER_IN_WORDS 131080 // block_size_shift, in 16-bit words from the start of the cache
+
+#define NAMESPACES 16 // including the default namespace
+#define NAMESPACE_NAME_MAX 32
+
+#define TIMEOUT_INFINITE 0xffffffff // operations wait for the lock forever by default
 
 namespace cache {
-    bool init(void* ptr, uint32_t blocks, uint32_t block_size_shift, bool forced);
+    enum {
+        POLICY_LRU,
+        POLICY_TINYLFU
+    };
+
+    typedef struct options_s {
+        uint32_t    policy; // eviction policy
+        uint32_t    small_slots; // slots of tiny entries, which are kept out of blocks. 0 to disable
+        uint32_t    slabs; // if set, values are kept in chunks of size classes from the block size up to 16KB
+        uint32_t    change_log; // bytes of the ring of the change log, rounded up to a power of 2. 0 to disable
+
+        inline options_s() : policy(POLICY_LRU), small_slots(0), slabs(0), change_log(0) {}
+    } options_t;
+
+    // a key prepared by make_handle. Its hash is computed once, and the block where it
+    // was found last time is used as long as the key is unchanged
+    typedef struct handle_s {
+        uint32_t    hash;
+        uint32_t    block;
+        uint64_t    generation;
+    } handle_t;
+
+    // counted since the cache is created, by all processes
+    typedef struct counters_s {
+        uint64_t    gets;
+        uint64_t    hits;
+        uint64_t    misses;
+        uint64_t    sets;
+        uint64_t    deletes;
+        uint64_t    evictions;
+        uint64_t    evicted_bytes; // size of the blocks of evicted keys
+        uint64_t    allocated_blocks;
+        uint64_t    allocation_scans; // bitmap words scanned to allocate blocks
+        uint64_t    allocation_wraps; // times the scan wrapped around the bitmap
+        uint64_t    lookups;
+        uint64_t    probes; // keys compared by lookups, probes / lookups is the mean hash chain length
+        uint64_t    lock_timeouts; // operations given up as the lock was not acquired in time
+        uint64_t    compactions; // values moved into chunks in a row by compact
+    } counters_t;
+
+    typedef struct stats_s {
+        counters_t  counters;
+        uint32_t    block_size;
+        uint32_t    blocks_available;
+        uint32_t    blocks_used;
+        uint32_t    small_slots;
+        uint32_t    small_used;
+        uint32_t    slab_classes; // 0 unless the cache is divided in size classes
+        uint32_t    slab_pages; // pages of 16KB shared by size classes
+        uint32_t    slab_pages_free;
+        uint32_t    pinned_blocks;
+        uint32_t    log_size; // bytes of the ring of the change log, 0 if the cache has none
+        uint64_t    log_position; // bytes appended to the change log since it is created
+    } stats_t;
+
+    // latency histograms, recorded in ns into log buckets, 8 for every power of 2
+    #define LATENCY_BUCKETS 272 // up to 2^36 ns, longer latencies fall into the last bucket
+
+    typedef struct latency_s {
+        uint64_t    count;
+        uint64_t    sum;
+        uint64_t    buckets[LATENCY_BUCKETS];
+    } latency_t;
+
+    // every operation has a histogram of the time waiting for the lock, followed by one of the time holding it
+    enum {
+        LATENCY_GET, // get, get_or_lock
+        LATENCY_FAST_GET,
+        LATENCY_SET, // set, increase
+        LATENCY_DELETE, // unset, clear
+        LATENCY_SCAN, // enumerate, dump, contains
+        LATENCY_OPS
+    };
+    enum {
+        LATENCY_LOCK,
+        LATENCY_HOLD,
+        LATENCY_SERIALIZE = LATENCY_OPS << 1, // recorded by callers with latency_record
+        LATENCY_PARSE,
+        LATENCY_HISTOGRAMS
+    };
+
+    bool init(void* ptr, uint32_t blocks, uint32_t block_size_shift, const options_t& options, bool forced);
+
+    // checks an initialized cache of `size' bytes, which is to be used with the layout it has
+    bool attach(void* ptr, uint32_t size);
 
-    int set(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen, const uint8_t* val, size_t valLen, uint8_t** oldval = NULL, size_t* oldvalLen = NULL);
+    // returns the id of the namespace named `name', which is created if absent.
+    // quota is updated if not NULL
+    int namespace_open(void* ptr, HANDLE fd, const uint16_t* name, size_t nameLen, const uint32_t* quota = NULL);
 
-    void _enumerate(void* ptr, HANDLE fd, void* enumerator, void(* callback)(void*,uint16_t*,size_t));
+    // priorities of entries, which are given by set. An entry keeps its priority until a set gives another one
+    enum {
+        PRIORITY_NORMAL,
+        PRIORITY_LOW, // evicted before entries of normal priority
+        PRIORITY_PINNED, // evicted only when nothing else is left. Pinned entries take at most half of the blocks
+        PRIORITY_KEEP = 0xff // the entry keeps its priority, new entries are of normal priority
+    };
 
-    void _dump(void* ptr, HANDLE fd, void* dumper, void(* callback)(void*,uint16_t*,size_t,uint8_t*));
+    // returns 0, or -1 with errno set, which is ETIMEDOUT if the lock is not acquired in `timeout' milliseconds,
+    // or ENOSPC if a pinned value would take more than half of the blocks
+    int set(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const uint8_t* val, size_t valLen, uint8_t** oldval = NULL, size_t* oldvalLen = NULL, handle_t* handle = NULL, uint32_t timeout = TIMEOUT_INFINITE, uint32_t priority = PRIORITY_KEEP);
+
+    void _enumerate(void* ptr, HANDLE fd, uint32_t ns, void* enumerator, void(* callback)(void*,uint16_t*,size_t));
+
+    void _dump(void* ptr, HANDLE fd, uint32_t ns, void* dumper, void(* callback)(void*,uint16_t*,size_t,uint8_t*,size_t));
 
 	template<typename T>
-    inline void enumerate(void* ptr, HANDLE fd, T* enumerator, void(* callback)(T*,uint16_t*,size_t)) {
-    	_enumerate(ptr, fd, enumerator, (void(*)(void*,uint16_t*,size_t)) callback);
+    inline void enumerate(void* ptr, HANDLE fd, uint32_t ns, T* enumerator, void(* callback)(T*,uint16_t*,size_t)) {
+    	_enumerate(ptr, fd, ns, enumerator, (void(*)(void*,uint16_t*,size_t)) callback);
     }
 
     template<typename T>
-    inline void dump(void* ptr, HANDLE fd, T* dumper, void(* callback)(T*,uint16_t*,size_t,uint8_t*)) {
-    	_dump(ptr, fd, dumper, (void(*)(void*,uint16_t*,size_t,uint8_t*)) callback);
+    inline void dump(void* ptr, HANDLE fd, uint32_t ns, T* dumper, void(* callback)(T*,uint16_t*,size_t,uint8_t*,size_t)) {
+    	_dump(ptr, fd, ns, dumper, (void(*)(void*,uint16_t*,size_t,uint8_t*,size_t)) callback);
+    }
+
+    // returns 0, or -1 with errno set to ETIMEDOUT if the lock is not acquired in `timeout' milliseconds
+    int get(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, uint8_t*& val, size_t& valLen, handle_t* handle = NULL, uint32_t timeout = TIMEOUT_INFINITE);
+
+    int fast_get(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, uint8_t*& val, size_t& valLen, handle_t* handle = NULL, uint32_t timeout = TIMEOUT_INFINITE);
+
+    // a value found by peek, which is read in place by read_value while the visitor runs
+    typedef struct value_s {
+        const void* ptr;
+        uint32_t    node;
+        size_t      length;
+        const uint8_t* data; // tiny values are read from here instead of the node
+    } value_t;
+
+    // calls visitor with the value of the key under the shared lock, like fast_get. Returns 1
+    // if the key is found, 0 if absent, or -1 if the lock is not acquired in `timeout' milliseconds
+    int _peek(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, void* context, void(* visitor)(void*,const value_t&), handle_t* handle = NULL, uint32_t timeout = TIMEOUT_INFINITE);
+
+    template<typename T>
+    inline int peek(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, T* context, void(* visitor)(T*,const value_t&), handle_t* handle = NULL, uint32_t timeout = TIMEOUT_INFINITE) {
+        return _peek(ptr, fd, ns, key, keyLen, context, (void(*)(void*,const value_t&)) visitor, handle, timeout);
+    }
+
+    // copies at most len bytes of the value at offset, and returns the number of bytes copied
+    size_t read_value(const value_t& value, size_t offset, uint8_t* dst, size_t len);
+
+    bool contains(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen);
+
+    bool unset(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen);
+
+    // clears keys of a namespace, or the whole cache if ns is 0
+    void clear(void* ptr, HANDLE fd, uint32_t ns);
+
+    int32_t increase(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, int32_t increase_by, handle_t* handle = NULL);
+
+    // fields of hash values, which are values of type Fields (see bson_types.h) that are read and
+    // updated one field at a time under the lock. Values of fields are serialized values. These
+    // return -1 with errno set to EINVAL if the key holds a value of another type
+
+    // sets a field, and returns 1 if it is added, 0 if it is replaced, or -1 with errno set
+    int hset(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const uint16_t* field, size_t fieldLen, const uint8_t* val, size_t valLen, handle_t* handle = NULL, uint32_t timeout = TIMEOUT_INFINITE);
+
+    // gets a field into a new buffer, and returns 1 if it is found, 0 if absent, or -1
+    int hget(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const uint16_t* field, size_t fieldLen, uint8_t*& val, size_t& valLen, handle_t* handle = NULL, uint32_t timeout = TIMEOUT_INFINITE);
+
+    // deletes a field, and the key with its last field. Returns 1 if deleted, 0 if absent, or -1
+    int hdel(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const uint16_t* field, size_t fieldLen, handle_t* handle = NULL, uint32_t timeout = TIMEOUT_INFINITE);
+
+    // increases an integer field, which is set to increase_by if absent or not an integer
+    int hincr(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, const uint16_t* field, size_t fieldLen, int32_t increase_by, int32_t& result, handle_t* handle = NULL, uint32_t timeout = TIMEOUT_INFINITE);
+
+    // operations of a transaction
+    enum {
+        OP_GET, // reads the value into retval, following the contract of get
+        OP_SET,
+        OP_UNSET, // result is whether the key is deleted
+        OP_INCREASE, // result is the increased value
+        OP_CHECK // the transaction is aborted unless the value is val, or the key is absent if val is NULL
+    };
+
+    typedef struct op_s {
+        uint32_t        type;
+        const uint16_t* key;
+        size_t          keyLen;
+        const uint8_t*  val;
+        size_t          valLen;
+        int32_t         increase_by;
+        int32_t         result;
+        uint8_t*        retval;
+        size_t          retvalLen;
+    } op_t;
+
+    // runs operations on keys of a namespace in order under a single hold of the write lock.
+    // Checks see the values before the transaction, and if any of them fails, nothing is applied.
+    // Returns 1 if applied, 0 if a check failed, or -1 with errno set to E2BIG if a value can not
+    // be stored, or ETIMEDOUT if the lock is not acquired in `timeout' milliseconds
+    int transaction(void* ptr, HANDLE fd, uint32_t ns, op_t* ops, size_t count, uint32_t timeout = TIMEOUT_INFINITE);
+
+    void stats(void* ptr, HANDLE fd, stats_t& stats);
+
+    typedef struct fragmentation_s {
+        uint32_t    values; // values in blocks, tiny values in slots are not counted
+        uint32_t    chained; // values of more than one block or chunk
+        uint32_t    fragmented; // chained values whose blocks are not in a row
+    } fragmentation_t;
+
+    void fragmentation(void* ptr, HANDLE fd, fragmentation_t& fragmentation);
+
+    // moves fragmented values into free blocks in a row, so that they are read and written
+    // with a single copy. Hash buckets are visited from where the last call stopped, under
+    // the lock for 1024 buckets at a time, until all of them are visited or `budget'
+    // milliseconds are spent. Returns the number of values moved
+    uint32_t compact(void* ptr, HANDLE fd, uint32_t budget);
+
+    // switches latency recording of all processes, histograms are cleared when it is enabled
+    void latency_enable(void* ptr, HANDLE fd, bool enabled);
+
+    bool latency_enabled(void* ptr);
+
+    // copies LATENCY_HISTOGRAMS histograms
+    void latency(void* ptr, HANDLE fd, latency_t* histograms);
+
+    // nanoseconds of a monotonic clock
+    uint64_t latency_clock();
+
+    void latency_record(void* ptr, uint32_t histogram, uint64_t ns);
+
+    // lower bound of a bucket in ns
+    uint64_t latency_value(uint32_t bucket);
+
+    // the change log is a ring in the cache, where every modification appends a record under the
+    // write lock, so that other caches are kept in sync by applying them. Evictions are not logged
+    enum {
+        LOG_SET, // increase and updates of fields are logged as the values they leave, with the priority the entry keeps
+        LOG_UNSET,
+        LOG_CLEAR // of a namespace, or of the whole cache for the default namespace
+    };
+
+    // a record is followed by the name of its namespace and the key in UTF-16, and the value
+    typedef struct log_record_s {
+        uint32_t    length; // of the whole record
+        uint8_t     type;
+        uint8_t     priority;
+        uint8_t     nameLen; // 0 for the default namespace
+        uint8_t     reserved;
+        uint32_t    keyLen;
+    } log_record_t;
+
+    // copies whole records appended from `cursor' into buf, and moves cursor past them. Returns the
+    // number of bytes copied, or -1 with errno set to ERANGE if records after cursor are overwritten,
+    // ENOBUFS if the next record does not fit in bufLen, or ENOTSUP if the cache has no change log
+    long log_read(void* ptr, HANDLE fd, uint64_t& cursor, uint8_t* buf, size_t bufLen);
+
+    // calls callback with a LOG_CLEAR record of the cache, followed by a LOG_SET record of every entry
+    // of every namespace, all under one hold of the read lock. Values are copied as they are stored.
+    // Returns the position of the change log, which records after the snapshot are read from
+    uint64_t _snapshot(void* ptr, HANDLE fd, void* context, void(* callback)(void*,const uint8_t*,size_t));
+
+    template<typename T>
+    inline uint64_t snapshot(void* ptr, HANDLE fd, T* context, void(* callback)(T*,const uint8_t*,size_t)) {
+        return _snapshot(ptr, fd, context, (void(*)(void*,const uint8_t*,size_t)) callback);
     }
 
-    void get(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen, uint8_t*& val, size_t& valLen);
+    // applies records of a change log or a snapshot in order, under one hold of the write lock.
+    // Namespaces are created by name. Values which do not fit in the cache are skipped. Returns the
+    // number of bytes of whole records, which is less than len if the last one is cut, or -1 with
+    // errno set to EINVAL if a record is malformed, or ETIMEDOUT if the lock is not acquired in time
+    long log_apply(void* ptr, HANDLE fd, const uint8_t* records, size_t len, uint32_t timeout = TIMEOUT_INFINITE);
 
-    void fast_get(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen, uint8_t*& val, size_t& valLen);
+    // returns the generation of a key, which changes whenever the key is set, deleted or
+    // evicted. A value read after the generation is taken is valid as long as it is unchanged.
+    uint64_t generation(void* ptr, uint32_t ns, const uint16_t* key, size_t keyLen, const handle_t* handle = NULL);
 
-    bool contains(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen);
+    void make_handle(void* ptr, uint32_t ns, const uint16_t* key, size_t keyLen, handle_t& handle);
 
-    bool unset(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen);
+    enum {
+        LEASE_FOUND, // value is returned
+        LEASE_ACQUIRED, // key is absent, and the caller is expected to set it
+        LEASE_BUSY // another process holds the lease
+    };
 
-    void clear(void* ptr, HANDLE fd);
+    // gets value of the key. When the key is absent, a lease on it is granted to the
+    // calling thread for leaseMs milliseconds, during which other threads get
+    // LEASE_BUSY, and should call lease_wait with `seq' and `wait' before retrying.
+    // The lease is resolved when the key is set or deleted.
+    int get_or_lock(void* ptr, HANDLE fd, uint32_t ns, const uint16_t* key, size_t keyLen, uint32_t leaseMs, uint8_t*& val, size_t& valLen, uint32_t& seq, uint32_t& wait, handle_t* handle = NULL);
 
-    int32_t increase(void* ptr, HANDLE fd, const uint16_t* key, size_t keyLen, int32_t increase_by);
+    // waits at most `timeout' milliseconds until a lease is resolved
+    void lease_wait(void* ptr, uint32_t seq, uint32_t timeout);
 
 }
 
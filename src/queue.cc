@@ -0,0 +1,269 @@
+#include<string.h>
+#include<errno.h>
+#include<limits.h>
+#include "memcache.h"
+#include "queue.h"
+
+#ifndef _WIN32
+#include <time.h> // clock_gettime
+#include <unistd.h> // usleep
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#define QUEUE_MAGIC 0x71756575
+#define QUEUE_CAPACITY_MAX (1 << 24)
+#define QUEUE_MESSAGE_MAX (1 << 24)
+
+namespace queue {
+
+// head and tail are positions counted since the queue is created, and do not wrap. Cell i % capacity
+// is free for the push of position i if its sequence is i, and holds the message of position i if
+// its sequence is i + 1. Consumers set it to i + capacity, which frees it for the next round
+typedef struct header_s {
+    uint32_t    magic;
+    uint32_t    capacity;
+    uint32_t    cell_size; // of a cell, including its sequence and length
+    uint32_t    message_size;
+    uint8_t     padding0[48];
+
+    // each of them is written by other processes, so they are kept on cache lines of their own
+    volatile uint64_t tail; // next position to push
+    uint8_t     padding1[56];
+    volatile uint64_t head; // next position to pop
+    uint8_t     padding2[56];
+    volatile uint32_t pushes; // futex word, which is changed by every push
+    volatile uint32_t waiters;
+    uint8_t     padding3[56];
+} header_t;
+
+typedef struct cell_s {
+    volatile uint64_t sequence;
+    uint32_t    length;
+    uint32_t    reserved;
+} cell_t;
+
+static inline header_t& header(void* ptr) {
+    return *static_cast<header_t*>(ptr);
+}
+
+static inline cell_t& cell(header_t& h, uint64_t pos) {
+    return *reinterpret_cast<cell_t*>(reinterpret_cast<uint8_t*>(&h) + QUEUE_HEADER_SIZE + (pos & (h.capacity - 1)) * h.cell_size);
+}
+
+static inline uint8_t* data(cell_t& c) {
+    return reinterpret_cast<uint8_t*>(&c + 1);
+}
+
+// reads the sequence of a cell, before its content is read or written
+static inline uint64_t sequence(const cell_t& c) {
+    uint64_t seq = c.sequence;
+#ifndef _WIN32
+    __sync_synchronize();
+#else
+    MemoryBarrier();
+#endif
+    return seq;
+}
+
+// publishes the content of a cell to other processes
+static inline void publish(cell_t& c, uint64_t seq) {
+#ifndef _WIN32
+    __sync_synchronize();
+#else
+    MemoryBarrier();
+#endif
+    c.sequence = seq;
+}
+
+static inline bool cas(volatile uint64_t* pos, uint64_t expected, uint64_t value) {
+#ifndef _WIN32
+    return __sync_bool_compare_and_swap(pos, expected, value);
+#else
+    return InterlockedCompareExchange64(reinterpret_cast<volatile LONG64*>(pos), value, expected) == expected;
+#endif
+}
+
+static inline uint64_t now() {
+#ifdef _WIN32
+    return GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+static inline uint32_t roundCapacity(uint32_t capacity) {
+    uint32_t ret = 1;
+    while(ret < capacity) ret <<= 1;
+    return ret;
+}
+
+static inline uint32_t cellSize(uint32_t message_size) {
+    return (sizeof(cell_t) + message_size + 63) & ~63; // cells do not share cache lines
+}
+
+size_t size_of(uint32_t capacity, uint32_t message_size) {
+    if(!capacity || capacity > QUEUE_CAPACITY_MAX || !message_size || message_size > QUEUE_MESSAGE_MAX) {
+        return 0;
+    }
+    uint64_t size = QUEUE_HEADER_SIZE + uint64_t(roundCapacity(capacity)) * cellSize(message_size);
+    return size > 0xffffffff ? 0 : size;
+}
+
+bool init(void* ptr, size_t size, uint32_t capacity, uint32_t message_size, bool forced) {
+    header_t& h = header(ptr);
+    capacity = roundCapacity(capacity);
+    if(!forced) {
+        return attach(ptr, size) && h.capacity == capacity && h.message_size == message_size;
+    }
+    memset(&h, 0, QUEUE_HEADER_SIZE);
+    h.capacity = capacity;
+    h.cell_size = cellSize(message_size);
+    h.message_size = message_size;
+    for(uint32_t i = 0; i < capacity; i++) {
+        cell(h, i).sequence = i;
+    }
+#ifndef _WIN32
+    __sync_synchronize();
+#else
+    MemoryBarrier();
+#endif
+    h.magic = QUEUE_MAGIC;
+    return true;
+}
+
+bool attach(void* ptr, size_t size) {
+    const header_t& h = header(ptr);
+    return size >= QUEUE_HEADER_SIZE && h.magic == QUEUE_MAGIC &&
+        QUEUE_HEADER_SIZE + uint64_t(h.capacity) * h.cell_size <= size;
+}
+
+int push(void* ptr, const uint8_t* const* vals, const size_t* lens, uint32_t count) {
+    header_t& h = header(ptr);
+    for(uint32_t i = 0; i < count; i++) {
+        if(lens[i] > h.message_size) {
+            errno = E2BIG;
+            return -1;
+        }
+    }
+    if(!count) {
+        return 0;
+    }
+
+    // takes the free cells in a row from the tail
+    uint64_t pos = h.tail;
+    uint32_t n;
+    for(;;) {
+        for(n = 0; n < count && sequence(cell(h, pos + n)) == pos + n; n++);
+        if(n) {
+            if(cas(&h.tail, pos, pos + n)) break;
+        } else if(int64_t(sequence(cell(h, pos)) - pos) < 0) { // not popped yet
+            return 0;
+        }
+        pos = h.tail; // taken by another producer
+    }
+
+    for(uint32_t i = 0; i < n; i++) {
+        cell_t& c = cell(h, pos + i);
+        c.length = lens[i];
+        memcpy(data(c), vals[i], lens[i]);
+        publish(c, pos + i + 1);
+    }
+
+#ifndef _WIN32
+    __sync_fetch_and_add(&h.pushes, 1);
+#else
+    InterlockedIncrement(reinterpret_cast<volatile LONG*>(&h.pushes));
+#endif
+#ifdef __linux__
+    if(h.waiters) {
+        syscall(SYS_futex, &h.pushes, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+    }
+#endif
+    return n;
+}
+
+// takes the messages in a row from the head
+static uint32_t take(header_t& h, uint32_t max, void* context, void(* callback)(void*,const uint8_t*,size_t)) {
+    uint64_t pos = h.head;
+    uint32_t n;
+    for(;;) {
+        for(n = 0; n < max && sequence(cell(h, pos + n)) == pos + n + 1; n++);
+        if(n) {
+            if(cas(&h.head, pos, pos + n)) break;
+        } else if(int64_t(sequence(cell(h, pos)) - (pos + 1)) < 0) { // not pushed yet
+            return 0;
+        }
+        pos = h.head; // taken by another consumer
+    }
+
+    for(uint32_t i = 0; i < n; i++) {
+        cell_t& c = cell(h, pos + i);
+        callback(context, data(c), c.length);
+        publish(c, pos + i + h.capacity);
+    }
+    return n;
+}
+
+// waits at most ms milliseconds until `pushes' is changed from `seen'
+static void wait(header_t& h, uint32_t seen, uint32_t ms) {
+#ifdef __linux__
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+    __sync_fetch_and_add(&h.waiters, 1);
+    syscall(SYS_futex, &h.pushes, FUTEX_WAIT, seen, ms == TIMEOUT_INFINITE ? NULL : &ts, 0, 0);
+    __sync_fetch_and_sub(&h.waiters, 1);
+#else
+    // no futex, poll the counter instead
+    for(uint64_t until = now() + ms; h.pushes == seen && (ms == TIMEOUT_INFINITE || now() < until); ) {
+#ifdef _WIN32
+        Sleep(1);
+#else
+        usleep(1000);
+#endif
+    }
+#endif
+}
+
+uint32_t _pop(void* ptr, uint32_t max, uint32_t timeout, void* context, void(* callback)(void*,const uint8_t*,size_t)) {
+    header_t& h = header(ptr);
+    uint64_t until = now() + timeout;
+    for(;;) {
+        uint32_t seen = h.pushes;
+#ifndef _WIN32
+        __sync_synchronize();
+#else
+        MemoryBarrier();
+#endif
+        uint32_t n = take(h, max, context, callback);
+        if(n || !timeout || !max) {
+            return n;
+        }
+        if(timeout == TIMEOUT_INFINITE) {
+            wait(h, seen, TIMEOUT_INFINITE);
+            continue;
+        }
+        uint64_t current = now();
+        if(current >= until) {
+            return 0;
+        }
+        wait(h, seen, until - current);
+    }
+}
+
+void stats(void* ptr, stats_t& stats) {
+    const header_t& h = header(ptr);
+    stats.capacity = h.capacity;
+    stats.message_size = h.message_size;
+    stats.popped = h.head;
+    stats.pushed = h.tail;
+    stats.waiters = h.waiters;
+}
+
+}
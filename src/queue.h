@@ -0,0 +1,54 @@
+#ifndef QUEUE_H_
+#define QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bounded multi-producer multi-consumer queue of messages in shared memory. Messages are kept in
+ * a ring of cells of a fixed size, each with a sequence number telling whether it is free or
+ * written in the current round, so that producers and consumers only race for the head and the
+ * tail with compare-and-swap, and never take a lock. Consumers waiting for messages sleep on a
+ * futex, which is woken by producers.
+ */
+namespace queue {
+    #define QUEUE_HEADER_SIZE 256
+
+    // bytes taken by a queue of `capacity' messages of at most `message_size' bytes, or 0 if it
+    // is too large. capacity is rounded up to a power of 2
+    size_t size_of(uint32_t capacity, uint32_t message_size);
+
+    // initializes a queue of `size' bytes, as returned by size_of. If `forced' is false, the
+    // queue is expected to be initialized with the same capacity and message size
+    bool init(void* ptr, size_t size, uint32_t capacity, uint32_t message_size, bool forced);
+
+    // checks that a queue is initialized, and fits in `size' bytes
+    bool attach(void* ptr, size_t size);
+
+    // pushes messages in order, and returns the number pushed, which is less than count if the
+    // queue is full, or -1 with errno set to E2BIG if a message is larger than the message size,
+    // in which case nothing is pushed
+    int push(void* ptr, const uint8_t* const* vals, const size_t* lens, uint32_t count);
+
+    // pops at most `max' messages, which are passed in order to callback before their cells are
+    // given back, and returns the number popped. If the queue is empty, waits at most `timeout'
+    // milliseconds for a message, which is TIMEOUT_INFINITE to wait forever
+    uint32_t _pop(void* ptr, uint32_t max, uint32_t timeout, void* context, void(* callback)(void*,const uint8_t*,size_t));
+
+    template<typename T>
+    inline uint32_t pop(void* ptr, uint32_t max, uint32_t timeout, T* context, void(* callback)(T*,const uint8_t*,size_t)) {
+        return _pop(ptr, max, timeout, context, (void(*)(void*,const uint8_t*,size_t)) callback);
+    }
+
+    typedef struct stats_s {
+        uint32_t    capacity;
+        uint32_t    message_size;
+        uint64_t    pushed; // since the queue is created
+        uint64_t    popped;
+        uint32_t    waiters; // consumers waiting for messages
+    } stats_t;
+
+    void stats(void* ptr, stats_t& stats);
+}
+
+#endif
@@ -0,0 +1,430 @@
+#include<sys/types.h>
+#include<sys/stat.h>
+#include<fcntl.h>
+#include<errno.h>
+#include<stdio.h>
+#include<string.h>
+#include<list>
+#include<string>
+#include "memcache.h"
+#include "shared_cache.h"
+#include "queue.h"
+
+#ifndef _WIN32
+#include<unistd.h>
+#include<sys/mman.h>
+#include<pthread.h>
+#endif
+
+// caches mapped by the process, which are shared by its threads, and by all opens of the same
+// name, so that each cache is mapped once and locked through the same fd
+typedef struct segment_s {
+    std::string     name;
+    shared_cache_t  cache;
+    uint32_t        refs;
+    bool            released; // the name refers to another cache if opened again
+} segment_t;
+
+static std::list<segment_t> segments;
+
+#ifndef _WIN32
+static pthread_mutex_t segments_lock = PTHREAD_MUTEX_INITIALIZER;
+#define SEGMENTS_LOCK() pthread_mutex_lock(&segments_lock)
+#define SEGMENTS_UNLOCK() pthread_mutex_unlock(&segments_lock)
+#else
+static SRWLOCK segments_lock = SRWLOCK_INIT;
+#define SEGMENTS_LOCK() AcquireSRWLockExclusive(&segments_lock)
+#define SEGMENTS_UNLOCK() ReleaseSRWLockExclusive(&segments_lock)
+#endif
+
+// keys should fit in the first block, and in 256 code units
+static inline bool valid_key(const shared_cache_t* cache, size_t keyLen) {
+    uint32_t block_size_shift = static_cast<uint16_t*>(cache->ptr)[CACHE_HEADER_IN_WORDS];
+    if(keyLen > 256 || (keyLen << 1) + 32 > 1U << block_size_shift) {
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+// maps the shared memory object `name' into ptr. If size is 0, an existing object is mapped with
+// its own size, which size is set to. Otherwise the object is created with `size' bytes if absent,
+// and created is set. handle is the descriptor of the object, or its mapping on Windows
+static int map_segment(const char* name, uint32_t& size, void*& ptr, HANDLE& handle, bool& created) {
+    created = false;
+#ifndef _WIN32
+    if((handle = shm_open(name, size ? O_RDWR | O_CREAT : O_RDWR, S_IRUSR | S_IWUSR)) == -1) {
+        return SHARED_CACHE_ERROR;
+    }
+    struct stat stat;
+    if(fstat(handle, &stat) == -1) {
+        close(handle);
+        return SHARED_CACHE_ERROR;
+    }
+
+    if(!size) {
+        if(stat.st_size == 0) { // being created
+            close(handle);
+            errno = ENOENT;
+            return SHARED_CACHE_ERROR;
+        }
+        size = stat.st_size;
+    } else if(stat.st_size == 0) {
+        if(ftruncate(handle, size) == -1) {
+            close(handle);
+            return SHARED_CACHE_ERROR;
+        }
+        created = true;
+    } else if(stat.st_size != size) {
+        close(handle);
+        return SHARED_CACHE_ESIZE;
+    }
+
+    if((ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0)) == MAP_FAILED) {
+        close(handle);
+        return SHARED_CACHE_ERROR;
+    }
+#else
+    // create/open the file mapping
+    if(!(handle = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, name))) {
+        if(!size || !(handle = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name))) {
+            errno = GetLastError();
+            return SHARED_CACHE_ERROR;
+        }
+        created = true;
+    }
+
+    // map the memory
+    if(!(ptr = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size))) {
+        errno = GetLastError();
+        CloseHandle(handle);
+        return SHARED_CACHE_ERROR;
+    }
+    if(!size) {
+        MEMORY_BASIC_INFORMATION mbi;
+        VirtualQuery(ptr, &mbi, sizeof(mbi));
+        size = mbi.RegionSize;
+    }
+#endif
+    return SHARED_CACHE_OK;
+}
+
+static void unmap_segment(void* ptr, uint32_t size, HANDLE handle) {
+#ifndef _WIN32
+    munmap(ptr, size);
+    close(handle);
+#else
+    UnmapViewOfFile(ptr);
+    CloseHandle(handle);
+#endif
+}
+
+// sets up the object a mapped cache is locked with, and fills `cache'
+static int lock_segment(shared_cache_t* cache, const char* name, void* ptr, uint32_t size, HANDLE handle, bool create) {
+    HANDLE fd = handle;
+#ifdef _WIN32
+    // create a mutex for synchronization
+    char mutexName[64];
+    _snprintf(mutexName, sizeof(mutexName), "mutex:%s", name);
+    fd = create ? CreateMutex(NULL, FALSE, mutexName) : OpenMutex(SYNCHRONIZE, FALSE, mutexName);
+    if (!fd && create && GetLastError() == ERROR_ALREADY_EXISTS) {
+        fd = OpenMutex(SYNCHRONIZE, FALSE, mutexName);
+    }
+    if (!fd) {
+        errno = GetLastError();
+        unmap_segment(ptr, size, handle);
+        return SHARED_CACHE_ERROR;
+    }
+#elif defined(__MACH__)
+    // shared memory objects can not be locked with flock
+    char sbuf[64];
+    snprintf(sbuf, sizeof(sbuf), "/tmp/shared_cache_%s", name);
+    close(handle);
+    if((fd = open(sbuf, O_CREAT | O_RDONLY, 0400)) == -1) {
+        munmap(ptr, size);
+        return SHARED_CACHE_ERROR;
+    }
+#endif
+
+    cache->ptr = ptr;
+    cache->size = size;
+    cache->ns = 0;
+    cache->fd = fd;
+#ifdef _WIN32
+    cache->mapping = handle;
+#endif
+    return SHARED_CACHE_OK;
+}
+
+// maps an existing cache, whose size and layout are taken from the segment
+static int attach(shared_cache_t* cache, const char* name) {
+    void* ptr;
+    uint32_t size = 0;
+    HANDLE handle;
+    bool created;
+    int ret = map_segment(name, size, ptr, handle, created);
+    if(ret != SHARED_CACHE_OK) {
+        return ret;
+    }
+    if(size < HEADER_SIZE) { // being created
+        unmap_segment(ptr, size, handle);
+        errno = ENOENT;
+        return SHARED_CACHE_ERROR;
+    }
+    if(!cache::attach(ptr, size)) {
+        unmap_segment(ptr, size, handle);
+        return SHARED_CACHE_ELAYOUT;
+    }
+    return lock_segment(cache, name, ptr, size, handle, false);
+}
+
+static int open_segment(shared_cache_t* cache, const char* name, uint32_t size, uint32_t block_size_shift, const cache::options_t& options) {
+    if(!size) {
+        return attach(cache, name);
+    }
+    if(block_size_shift < 6 || block_size_shift > 14 || options.policy > cache::POLICY_TINYLFU) {
+        errno = EINVAL;
+        return SHARED_CACHE_ERROR;
+    }
+    uint32_t blocks = size >> (5 + block_size_shift) << 5; // 32 aligned
+    size = blocks << block_size_shift;
+    if(size < 524288) {
+        errno = EINVAL;
+        return SHARED_CACHE_ERROR;
+    }
+
+    void* ptr;
+    HANDLE handle;
+    bool created;
+    int ret = map_segment(name, size, ptr, handle, created);
+    if(ret != SHARED_CACHE_OK) {
+        return ret;
+    }
+    if(!cache::init(ptr, blocks, block_size_shift, options, created)) {
+        unmap_segment(ptr, size, handle);
+        return SHARED_CACHE_ELAYOUT;
+    }
+    return lock_segment(cache, name, ptr, size, handle, true);
+}
+
+// checks that a mapped cache is opened with the same layout
+static int reuse(const shared_cache_t& cache, uint32_t size, uint32_t block_size_shift, const cache::options_t& options) {
+    if(!size) {
+        return SHARED_CACHE_OK;
+    }
+    if(block_size_shift < 6 || block_size_shift > 14 || options.policy > cache::POLICY_TINYLFU) {
+        errno = EINVAL;
+        return SHARED_CACHE_ERROR;
+    }
+    uint32_t blocks = size >> (5 + block_size_shift) << 5;
+    if(blocks << block_size_shift != cache.size) {
+        return SHARED_CACHE_ESIZE;
+    }
+    return cache::init(cache.ptr, blocks, block_size_shift, options, false) ? SHARED_CACHE_OK : SHARED_CACHE_ELAYOUT;
+}
+
+int shared_cache_open(shared_cache_t* cache, const char* name, uint32_t size, uint32_t block_size_shift, uint32_t policy) {
+    shared_cache_options_t options;
+    options.policy = policy;
+    options.small_slots = 0;
+    options.slabs = 0;
+    options.change_log = 0;
+    return shared_cache_open_options(cache, name, size, block_size_shift, &options);
+}
+
+int shared_cache_open_options(shared_cache_t* cache, const char* name, uint32_t size, uint32_t block_size_shift, const shared_cache_options_t* opts) {
+    cache::options_t options;
+    options.policy = opts->policy;
+    options.small_slots = opts->small_slots;
+    options.slabs = opts->slabs;
+    options.change_log = opts->change_log;
+
+    SEGMENTS_LOCK();
+    for(std::list<segment_t>::iterator it = segments.begin(); it != segments.end(); ++it) {
+        if(!it->released && it->name == name) {
+            int ret = reuse(it->cache, size, block_size_shift, options);
+            if(ret == SHARED_CACHE_OK) {
+                it->refs++;
+                *cache = it->cache;
+            }
+            SEGMENTS_UNLOCK();
+            return ret;
+        }
+    }
+
+    int ret = open_segment(cache, name, size, block_size_shift, options);
+    if(ret == SHARED_CACHE_OK) {
+        segment_t segment;
+        segment.name = name;
+        segment.cache = *cache;
+        segment.refs = 1;
+        segment.released = false;
+        segments.push_back(segment);
+    }
+    SEGMENTS_UNLOCK();
+    return ret;
+}
+
+void shared_cache_close(shared_cache_t* cache) {
+    SEGMENTS_LOCK();
+    for(std::list<segment_t>::iterator it = segments.begin(); it != segments.end(); ++it) {
+        if(it->cache.ptr == cache->ptr) {
+            if(!--it->refs) {
+#ifndef _WIN32
+                munmap(cache->ptr, cache->size);
+                close(cache->fd);
+#else
+                UnmapViewOfFile(cache->ptr);
+                CloseHandle(it->cache.mapping);
+                CloseHandle(cache->fd);
+#endif
+                segments.erase(it);
+            }
+            break;
+        }
+    }
+    SEGMENTS_UNLOCK();
+    cache->ptr = NULL;
+}
+
+int shared_cache_release(const char* name) {
+    SEGMENTS_LOCK();
+    for(std::list<segment_t>::iterator it = segments.begin(); it != segments.end(); ++it) {
+        if(it->name == name) {
+            it->released = true; // stays mapped until closed
+        }
+    }
+    SEGMENTS_UNLOCK();
+#ifndef _WIN32
+    return shm_unlink(name);
+#else
+    return 0; // the mapping is released with its last handle
+#endif
+}
+
+int shared_cache_namespace(const shared_cache_t* cache, shared_cache_t* out, const uint16_t* name, size_t nameLen, const uint32_t* quota) {
+    int id = cache::namespace_open(cache->ptr, cache->fd, name, nameLen, quota);
+    if(id == -1) {
+        return -1;
+    }
+    *out = *cache;
+    out->ns = id;
+    return 0;
+}
+
+int shared_cache_get(const shared_cache_t* cache, const uint16_t* key, size_t keyLen, uint8_t** val, size_t* valLen) {
+    if(!valid_key(cache, keyLen)) {
+        return -1;
+    }
+    cache::get(cache->ptr, cache->fd, cache->ns, key, keyLen, *val, *valLen);
+    return *val != NULL;
+}
+
+int shared_cache_fast_get(const shared_cache_t* cache, const uint16_t* key, size_t keyLen, uint8_t** val, size_t* valLen) {
+    if(!valid_key(cache, keyLen)) {
+        return -1;
+    }
+    cache::fast_get(cache->ptr, cache->fd, cache->ns, key, keyLen, *val, *valLen);
+    return *val != NULL;
+}
+
+void shared_cache_free(uint8_t* val) {
+    delete[] val;
+}
+
+int shared_cache_set(const shared_cache_t* cache, const uint16_t* key, size_t keyLen, const uint8_t* val, size_t valLen) {
+    if(!valid_key(cache, keyLen)) {
+        return -1;
+    }
+    return cache::set(cache->ptr, cache->fd, cache->ns, key, keyLen, val, valLen);
+}
+
+int shared_cache_set_priority(const shared_cache_t* cache, const uint16_t* key, size_t keyLen, const uint8_t* val, size_t valLen, uint32_t priority) {
+    if(!valid_key(cache, keyLen)) {
+        return -1;
+    }
+    if(priority > SHARED_CACHE_PRIORITY_PINNED) {
+        errno = EINVAL;
+        return -1;
+    }
+    return cache::set(cache->ptr, cache->fd, cache->ns, key, keyLen, val, valLen, NULL, NULL, NULL, TIMEOUT_INFINITE, priority);
+}
+
+int shared_cache_unset(const shared_cache_t* cache, const uint16_t* key, size_t keyLen) {
+    if(!valid_key(cache, keyLen)) {
+        return 0;
+    }
+    return cache::unset(cache->ptr, cache->fd, cache->ns, key, keyLen);
+}
+
+int32_t shared_cache_increase(const shared_cache_t* cache, const uint16_t* key, size_t keyLen, int32_t increase_by) {
+    if(!valid_key(cache, keyLen)) {
+        return 0;
+    }
+    return cache::increase(cache->ptr, cache->fd, cache->ns, key, keyLen, increase_by);
+}
+
+void shared_cache_enumerate(const shared_cache_t* cache, void* context, void (*callback)(void* context, uint16_t* key, size_t keyLen)) {
+    cache::_enumerate(cache->ptr, cache->fd, cache->ns, context, callback);
+}
+
+long shared_cache_log_read(const shared_cache_t* cache, uint64_t* cursor, uint8_t* buf, size_t bufLen) {
+    return cache::log_read(cache->ptr, cache->fd, *cursor, buf, bufLen);
+}
+
+uint64_t shared_cache_snapshot(const shared_cache_t* cache, void* context, void (*callback)(void* context, const uint8_t* record, size_t len)) {
+    return cache::_snapshot(cache->ptr, cache->fd, context, callback);
+}
+
+long shared_cache_log_apply(const shared_cache_t* cache, const uint8_t* records, size_t len) {
+    return cache::log_apply(cache->ptr, cache->fd, records, len);
+}
+
+int shared_queue_open(shared_queue_t* queue, const char* name, uint32_t capacity, uint32_t message_size) {
+    uint32_t size = 0;
+    if(capacity) {
+        if(!(size = queue::size_of(capacity, message_size))) {
+            errno = EINVAL;
+            return SHARED_CACHE_ERROR;
+        }
+    }
+
+    void* ptr;
+    HANDLE handle;
+    bool created;
+    int ret = map_segment(name, size, ptr, handle, created);
+    if(ret != SHARED_CACHE_OK) {
+        return ret;
+    }
+    if(capacity ? !queue::init(ptr, size, capacity, message_size, created) : !queue::attach(ptr, size)) {
+        unmap_segment(ptr, size, handle);
+        return SHARED_CACHE_ELAYOUT;
+    }
+
+    queue->ptr = ptr;
+    queue->size = size;
+#ifndef _WIN32
+    close(handle); // queues are not locked
+#else
+    queue->mapping = handle;
+#endif
+    return SHARED_CACHE_OK;
+}
+
+void shared_queue_close(shared_queue_t* queue) {
+#ifndef _WIN32
+    munmap(queue->ptr, queue->size);
+#else
+    UnmapViewOfFile(queue->ptr);
+    CloseHandle(queue->mapping);
+#endif
+    queue->ptr = NULL;
+}
+
+int shared_queue_push(const shared_queue_t* queue, const uint8_t* const* vals, const size_t* lens, uint32_t count) {
+    return queue::push(queue->ptr, vals, lens, count);
+}
+
+uint32_t shared_queue_pop(const shared_queue_t* queue, uint32_t max, uint32_t timeout, void* context, void (*callback)(void* context, const uint8_t* val, size_t valLen)) {
+    return queue::_pop(queue->ptr, max, timeout, context, callback);
+}
@@ -0,0 +1,161 @@
+#ifndef SHARED_CACHE_H_
+#define SHARED_CACHE_H_
+
+/*
+ * C API of the cache, for native programs sharing caches with Node.JS processes.
+ *
+ * Keys are strings of UTF-16 code units. Values are raw bytes, which are stored as they are. Values
+ * written by Node.JS are serialized in the format described in bson_types.h, and values read by
+ * Node.JS are expected to be in that format as well.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#define SHARED_CACHE_POLICY_LRU     0
+#define SHARED_CACHE_POLICY_TINYLFU 1
+
+#define SHARED_CACHE_PRIORITY_NORMAL 0
+#define SHARED_CACHE_PRIORITY_LOW    1 /* evicted before entries of normal priority */
+#define SHARED_CACHE_PRIORITY_PINNED 2 /* evicted only when nothing else is left, at most half of the cache */
+
+/* return values of shared_cache_open */
+#define SHARED_CACHE_OK             0
+#define SHARED_CACHE_ERROR          -1 /* errno is set */
+#define SHARED_CACHE_ESIZE          -2 /* the cache exists with another size */
+#define SHARED_CACHE_ELAYOUT        -3 /* the cache exists with other options or block size */
+
+typedef struct shared_cache_options_s {
+    uint32_t    policy; /* SHARED_CACHE_POLICY_x */
+    uint32_t    small_slots; /* slots of entries whose key and value fit in 20 bytes, 0 to disable */
+    uint32_t    slabs; /* if not 0, values are kept in chunks of size classes from the block size up to 16KB */
+    uint32_t    change_log; /* bytes of the ring of the change log, rounded up to a power of 2, 0 to disable */
+} shared_cache_options_t;
+
+typedef struct shared_cache_s {
+    void*       ptr;
+    uint32_t    size;
+    uint32_t    ns; /* namespace the cache operates on, 0 for the default namespace */
+#ifndef _WIN32
+    int         fd; /* locked with flock */
+#else
+    HANDLE      fd; /* mutex */
+    HANDLE      mapping;
+#endif
+} shared_cache_t;
+
+/*
+ * queue of messages shared by processes, which any of them push to and pop from. Messages are raw
+ * bytes, which are serialized in the format of bson_types.h by Node.JS.
+ */
+typedef struct shared_queue_s {
+    void*       ptr;
+    uint32_t    size;
+#ifdef _WIN32
+    HANDLE      mapping;
+#endif
+} shared_queue_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * opens the cache named `name', which is created if absent. size is rounded down to 32 blocks, and
+ * should be at least 512KB. block_size_shift is between 6 (64 bytes) and 14 (16KB). If size is 0,
+ * an existing cache is opened with its own size, block size and policy.
+ */
+int shared_cache_open(shared_cache_t* cache, const char* name, uint32_t size, uint32_t block_size_shift, uint32_t policy);
+
+/* same as shared_cache_open, with options, which all processes should open the cache with */
+int shared_cache_open_options(shared_cache_t* cache, const char* name, uint32_t size, uint32_t block_size_shift, const shared_cache_options_t* options);
+
+/* unmaps the cache, which is kept in the shared memory */
+void shared_cache_close(shared_cache_t* cache);
+
+/* removes the cache from the shared memory */
+int shared_cache_release(const char* name);
+
+/*
+ * opens the namespace named `name' into `out', which is created if absent. quota is updated if not
+ * NULL. Returns -1 with errno set on failure.
+ */
+int shared_cache_namespace(const shared_cache_t* cache, shared_cache_t* out, const uint16_t* name, size_t nameLen, const uint32_t* quota);
+
+/*
+ * gets value of the key, and returns 1 if found, 0 if absent, or -1 if the key is too long. *val
+ * is a buffer of *valLen bytes given by the caller. If the value does not fit in, a new buffer is
+ * allocated, which should be freed with shared_cache_free. *valLen is set to the value length.
+ */
+int shared_cache_get(const shared_cache_t* cache, const uint16_t* key, size_t keyLen, uint8_t** val, size_t* valLen);
+
+/* same as shared_cache_get, but does not touch the LRU sequence, and reads under a shared lock */
+int shared_cache_fast_get(const shared_cache_t* cache, const uint16_t* key, size_t keyLen, uint8_t** val, size_t* valLen);
+
+void shared_cache_free(uint8_t* val);
+
+/* returns 0, or -1 with errno set, which is E2BIG if the value is too large. The entry keeps its priority */
+int shared_cache_set(const shared_cache_t* cache, const uint16_t* key, size_t keyLen, const uint8_t* val, size_t valLen);
+
+/* same as shared_cache_set, with a priority. errno is ENOSPC if pinned entries would take more than half of the cache */
+int shared_cache_set_priority(const shared_cache_t* cache, const uint16_t* key, size_t keyLen, const uint8_t* val, size_t valLen, uint32_t priority);
+
+/* returns 1 if the key is deleted, 0 if absent */
+int shared_cache_unset(const shared_cache_t* cache, const uint16_t* key, size_t keyLen);
+
+/* increases an integer value, which is set to increase_by if absent, or not an integer */
+int32_t shared_cache_increase(const shared_cache_t* cache, const uint16_t* key, size_t keyLen, int32_t increase_by);
+
+/* calls callback with every key */
+void shared_cache_enumerate(const shared_cache_t* cache, void* context, void (*callback)(void* context, uint16_t* key, size_t keyLen));
+
+/*
+ * the change log of a cache opened with change_log records every modification of all namespaces,
+ * which are applied to other caches to keep them in sync. Records are described in memcache.h.
+ *
+ * copies whole records appended from *cursor into buf, and moves *cursor past them. Returns the
+ * number of bytes copied, or -1 with errno set to ERANGE if records after *cursor are overwritten,
+ * in which case the cache should be taken a snapshot of again
+ */
+long shared_cache_log_read(const shared_cache_t* cache, uint64_t* cursor, uint8_t* buf, size_t bufLen);
+
+/*
+ * calls callback with records which clear a cache and set all entries of this one. Returns the
+ * cursor which the change log is to be read from after the snapshot
+ */
+uint64_t shared_cache_snapshot(const shared_cache_t* cache, void* context, void (*callback)(void* context, const uint8_t* record, size_t len));
+
+/* applies records in order, and returns the number of bytes of whole records applied, or -1 with errno set */
+long shared_cache_log_apply(const shared_cache_t* cache, const uint8_t* records, size_t len);
+
+/*
+ * opens the queue named `name', which is created if absent, with room for `capacity' messages of at
+ * most `message_size' bytes. capacity is rounded up to a power of 2. If capacity is 0, an existing
+ * queue is opened. Returns SHARED_CACHE_x. Queues are removed with shared_cache_release.
+ */
+int shared_queue_open(shared_queue_t* queue, const char* name, uint32_t capacity, uint32_t message_size);
+
+void shared_queue_close(shared_queue_t* queue);
+
+/*
+ * pushes `count' messages, and returns the number pushed, which is less than count if the queue is
+ * full, or -1 with errno set to E2BIG if a message is too large, in which case nothing is pushed
+ */
+int shared_queue_push(const shared_queue_t* queue, const uint8_t* const* vals, const size_t* lens, uint32_t count);
+
+/*
+ * pops at most `max' messages, calling callback with each of them in order, and returns the number
+ * popped. If the queue is empty, waits at most `timeout' milliseconds for a message to be pushed,
+ * or forever if timeout is 0xffffffff
+ */
+uint32_t shared_queue_pop(const shared_queue_t* queue, uint32_t max, uint32_t timeout, void* context, void (*callback)(void* context, const uint8_t* val, size_t valLen));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,65 @@
+var binding = require('../index.js');
+try {
+	binding.release('async');
+} catch(e) {}
+
+var assert = require('assert');
+
+var obj = new binding.Cache("async", 1048576);
+var big = Array(4096).join('-');
+
+obj.foo = 'bar';
+binding.getAsync(obj, 'foo').then(function(value) {
+	assert.strictEqual(value, 'bar');
+	return binding.setAsync(obj, 'foo', {bar: [1, 2, 3]});
+}).then(function() {
+	assert.deepEqual(obj.foo, {bar: [1, 2, 3]});
+	return binding.fastGetAsync(obj, binding.key(obj, 'foo'));
+}).then(function(value) {
+	assert.deepEqual(value, {bar: [1, 2, 3]});
+	return binding.getAsync(obj, 'absent');
+}).then(function(value) {
+	assert.strictEqual(value, undefined);
+	return binding.setAsync(obj, 'big', Array(1048576).join('-'));
+}).then(function() {
+	assert.fail('value too large');
+}, function(e) {
+	assert(/failed with code/.test(e.message));
+
+	// operations run concurrently on the threadpool, and with the main thread
+	var ops = [];
+	for(var i = 0; i < 64; i++) {
+		ops.push(binding.setAsync(obj, 'k' + i, {i: i, big: big}));
+		obj['s' + i] = i;
+		ops.push(binding.dumpAsync(obj, 's'));
+	}
+	return Promise.all(ops);
+}).then(function() {
+	for(var i = 0; i < 64; i++) {
+		assert.strictEqual(obj['s' + i], i);
+	}
+	return Promise.all([binding.dumpAsync(obj), binding.dumpAsync(obj, 'k1')]);
+}).then(function(dumps) {
+	assert.deepEqual(dumps[0], binding.dump(obj));
+	assert.deepEqual(Object.keys(dumps[1]).sort(), ['k1', 'k10', 'k11', 'k12', 'k13', 'k14', 'k15', 'k16', 'k17', 'k18', 'k19'].filter(function(k) {
+		return k in obj;
+	}));
+
+	// near cache hits do not go to the threadpool
+	var near = new binding.Cache("async", 1048576, binding.SIZE_DEFAULT, {nearCache: 4});
+	near.foo = {};
+	var first = near.foo;
+	return binding.getAsync(near, 'foo').then(function(value) {
+		assert.strictEqual(value, first);
+	});
+}).then(function() {
+	return binding.getAsync(obj, Array(20).join('-'));
+}).then(function() {
+	assert.fail('key too long');
+}, function(e) {
+	assert(/length of property name/.test(e.message));
+	binding.release('async');
+}).catch(function(e) {
+	console.error(e.stack);
+	process.exit(1);
+});
@@ -0,0 +1,253 @@
+// Native benchmark of the cache engine, without V8 and serialization.
+//
+//   benchmark [-p processes] [-t seconds] [-m cache_mb] [-k keys,...] [-v value_sizes,...]
+//             [-s block_size_shifts,...] [-r read_percents,...] [-P policy] [-l]
+//
+// Every combination of the listed key counts, value sizes, block size shifts and read
+// percents is run by all processes at once, for the given seconds each. Keys are picked
+// uniformly. Reports throughput, and latency percentiles of reads and writes. -l divides the
+// caches in size classes (slabs).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <vector>
+#include "memcache.h"
+#include "shared_cache.h"
+
+// log-linear histogram of latencies in nanoseconds: 16 buckets for every power of 2
+#define SUB_BUCKETS 16
+#define BUCKETS (64 * SUB_BUCKETS)
+
+typedef struct histogram_s {
+    uint64_t count;
+    uint64_t buckets[BUCKETS];
+
+    inline void record(uint64_t ns) {
+        uint32_t index;
+        if(ns < SUB_BUCKETS) {
+            index = ns;
+        } else {
+            uint32_t bits = 63 - __builtin_clzll(ns); // >= 4
+            index = (bits - 3) * SUB_BUCKETS + ((ns >> (bits - 4)) & (SUB_BUCKETS - 1));
+        }
+        buckets[index]++;
+        count++;
+    }
+
+    // lower bound of the bucket
+    static inline uint64_t value(uint32_t index) {
+        if(index < SUB_BUCKETS) return index;
+        uint32_t bits = index / SUB_BUCKETS + 3;
+        return (uint64_t(SUB_BUCKETS) | (index & (SUB_BUCKETS - 1))) << (bits - 4);
+    }
+
+    uint64_t percentile(double p) const {
+        uint64_t rank = uint64_t(count * p), seen = 0;
+        for(uint32_t i = 0; i < BUCKETS; i++) {
+            seen += buckets[i];
+            if(seen > rank) return value(i);
+        }
+        return 0;
+    }
+
+    void merge(const histogram_s& other) {
+        count += other.count;
+        for(uint32_t i = 0; i < BUCKETS; i++) {
+            buckets[i] += other.buckets[i];
+        }
+    }
+} histogram_t;
+
+typedef struct result_s {
+    uint64_t ops;
+    histogram_t reads;
+    histogram_t writes;
+} result_t;
+
+typedef struct config_s {
+    uint32_t processes;
+    uint32_t seconds;
+    uint32_t size;
+    uint32_t policy;
+    uint32_t slabs;
+    uint32_t keys;
+    uint32_t valLen;
+    uint32_t shift;
+    uint32_t reads; // in percent
+} config_t;
+
+static inline uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static inline uint32_t xorshift(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static inline size_t make_key(uint16_t* key, uint32_t n) {
+    char buf[16];
+    size_t len = sprintf(buf, "k%u", n);
+    for(size_t i = 0; i < len; i++) key[i] = buf[i];
+    return len;
+}
+
+static void worker(const shared_cache_t& cache, const config_t& config, uint32_t seed, uint64_t until, result_t& result) {
+    std::vector<uint8_t> value(config.valLen, 'x');
+    uint8_t buf[1024];
+    uint16_t key[16];
+    uint32_t state = seed * 2654435761U | 1;
+
+    // the clock is checked every 64 operations
+    for(uint64_t t = 0; t < until; result.ops += 64) {
+        for(int i = 0; i < 64; i++) {
+            size_t keyLen = make_key(key, xorshift(state) % config.keys);
+            bool read = xorshift(state) % 100 < config.reads;
+            uint8_t* val = buf;
+            size_t valLen = sizeof(buf);
+
+            uint64_t begin = now();
+            if(read) {
+                cache::get(cache.ptr, cache.fd, cache.ns, key, keyLen, val, valLen);
+                if(val && val != buf) delete[] val;
+            } else {
+                cache::set(cache.ptr, cache.fd, cache.ns, key, keyLen, &value[0], value.size());
+            }
+            t = now();
+            (read ? result.reads : result.writes).record(t - begin);
+        }
+    }
+}
+
+static int run(const config_t& config) {
+    char name[64];
+    sprintf(name, "benchmark_native_%d", getpid());
+    shared_cache_release(name);
+
+    shared_cache_t cache;
+    shared_cache_options_t options = {config.policy, 0, config.slabs};
+    if(shared_cache_open_options(&cache, name, config.size, config.shift, &options) != SHARED_CACHE_OK) {
+        fprintf(stderr, "failed to open cache: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // warm up with all keys
+    std::vector<uint8_t> value(config.valLen, 'x');
+    uint16_t key[16];
+    for(uint32_t i = 0; i < config.keys; i++) {
+        cache::set(cache.ptr, cache.fd, cache.ns, key, make_key(key, i), &value[0], value.size());
+    }
+
+    result_t* results = static_cast<result_t*>(mmap(NULL, sizeof(result_t) * config.processes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if(results == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    memset(results, 0, sizeof(result_t) * config.processes);
+
+    uint64_t start = now() + 10000000; // leaves 10ms for the processes to start
+    uint64_t until = start + uint64_t(config.seconds) * 1000000000;
+    for(uint32_t i = 0; i < config.processes; i++) {
+        pid_t pid = fork();
+        if(pid == 0) {
+            while(now() < start);
+            worker(cache, config, i + 1, until, results[i]);
+            _exit(0);
+        } else if(pid == -1) {
+            perror("fork");
+            return -1;
+        }
+    }
+    for(uint32_t i = 0; i < config.processes; i++) {
+        wait(NULL);
+    }
+
+    result_t total;
+    memset(&total, 0, sizeof(total));
+    for(uint32_t i = 0; i < config.processes; i++) {
+        total.ops += results[i].ops;
+        total.reads.merge(results[i].reads);
+        total.writes.merge(results[i].writes);
+    }
+    printf("%9u %7u %5u %4u%% %12.0f", config.keys, config.valLen, config.shift, config.reads, total.ops / double(config.seconds));
+    const histogram_t* histograms[] = {&total.reads, &total.writes};
+    for(int i = 0; i < 2; i++) {
+        const histogram_t& h = *histograms[i];
+        if(h.count) {
+            printf(" %8.2f %8.2f %8.2f", h.percentile(0.5) / 1e3, h.percentile(0.99) / 1e3, h.percentile(0.999) / 1e3);
+        } else {
+            printf(" %8s %8s %8s", "-", "-", "-");
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+
+    munmap(results, sizeof(result_t) * config.processes);
+    shared_cache_close(&cache);
+    shared_cache_release(name);
+    return 0;
+}
+
+static std::vector<uint32_t> parse_list(const char* arg) {
+    std::vector<uint32_t> list;
+    for(char* end; *arg; arg = *end ? end + 1 : end) {
+        list.push_back(strtoul(arg, &end, 10));
+    }
+    return list;
+}
+
+int main(int argc, char** argv) {
+    config_t config;
+    config.processes = 4;
+    config.seconds = 1;
+    config.size = 16 << 20;
+    config.policy = SHARED_CACHE_POLICY_LRU;
+    config.slabs = 0;
+    std::vector<uint32_t> keys = parse_list("1000,100000");
+    std::vector<uint32_t> valLens = parse_list("16,256,4096");
+    std::vector<uint32_t> shifts = parse_list("6,9");
+    std::vector<uint32_t> reads = parse_list("50,95");
+
+    int opt;
+    while((opt = getopt(argc, argv, "p:t:m:k:v:s:r:P:l")) != -1) {
+        switch(opt) {
+        case 'p': config.processes = atoi(optarg); break;
+        case 't': config.seconds = atoi(optarg); break;
+        case 'm': config.size = atoi(optarg) << 20; break;
+        case 'k': keys = parse_list(optarg); break;
+        case 'v': valLens = parse_list(optarg); break;
+        case 's': shifts = parse_list(optarg); break;
+        case 'r': reads = parse_list(optarg); break;
+        case 'P': config.policy = atoi(optarg); break;
+        case 'l': config.slabs = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-p processes] [-t seconds] [-m cache_mb] [-k keys,...] [-v value_sizes,...] [-s block_size_shifts,...] [-r read_percents,...] [-P policy] [-l]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%u processes, %us each, %uMB cache, latencies in us\n", config.processes, config.seconds, config.size >> 20);
+    printf("%9s %7s %5s %5s %12s %8s %8s %8s %8s %8s %8s\n", "keys", "value", "shift", "reads", "ops/s",
+        "get p50", "p99", "p999", "set p50", "p99", "p999");
+    for(size_t k = 0; k < keys.size(); k++)
+    for(size_t v = 0; v < valLens.size(); v++)
+    for(size_t s = 0; s < shifts.size(); s++)
+    for(size_t r = 0; r < reads.size(); r++) {
+        config.keys = keys[k];
+        config.valLen = valLens[v];
+        config.shift = shifts[s];
+        config.reads = reads[r];
+        if(run(config)) return 1;
+    }
+    return 0;
+}
@@ -27,6 +27,38 @@ for(var i = 0; i < 1e6; i++) {
 }
 console.log('write shared cache 100w times: %sms', end());
 
+begin();
+for(var i = 0; i < 1e6; i++) {
+    binding.set(obj, 'test' + (i & 127), i);
+}
+console.log('write shared cache with set() 100w times: %sms', end());
+
+var keys = [];
+for(var i = 0; i < 128; i++) {
+    keys[i] = binding.key(obj, 'test' + i);
+}
+begin();
+for(var i = 0; i < 1e6; i++) {
+    binding.set(obj, keys[i & 127], i);
+}
+console.log('write shared cache with set() and key handles 100w times: %sms', end());
+
+begin();
+for(var i = 0; i < 1e6; i++) {
+    binding.set(obj, 'test' + (i & 127), i + 0.5);
+}
+console.log('write double with set() 100w times: %sms', end());
+
+begin();
+for(var i = 0; i < 1e6; i++) {
+    binding.set(obj, 'test' + (i & 127), 'value');
+}
+console.log('write string with set() 100w times: %sms', end());
+
+for(var i = 0; i < 128; i++) {
+    obj['test' + i] = i;
+}
+
 // test read existing key
 begin();
 for(var i = 0; i < 1e6; i++) {
@@ -40,6 +72,18 @@ for(var i = 0; i < 1e6; i++) {
 }
 console.log('read shared cache 100w times: %sms', end());
 
+begin();
+for(var i = 0; i < 1e6; i++) {
+    binding.get(obj, 'test' + (i & 127));
+}
+console.log('read shared cache with get() 100w times: %sms', end());
+
+begin();
+for(var i = 0; i < 1e6; i++) {
+    binding.get(obj, keys[i & 127]);
+}
+console.log('read shared cache with get() and key handles 100w times: %sms', end());
+
 begin();
 for(var i = 0; i < 1e6; i++) {
     binding.fastGet(obj, 'test' + (i & 127));
@@ -0,0 +1,91 @@
+var binding = require('../index.js');
+try {
+	binding.release('compact');
+} catch(e) {}
+
+var assert = require('assert');
+
+function str(n, c) {
+	return Array(n + 1).join(c || '-');
+}
+
+function fragment(obj) {
+	// small values take every block, and every other one is deleted to leave holes
+	for(var i = 0; i < 2000; i++) {
+		obj['s' + i] = i;
+	}
+	for(var i = 0; i < 2000; i += 2) {
+		delete obj['s' + i];
+	}
+	// which larger values are spread over
+	for(var i = 0; i < 20; i++) {
+		obj['l' + i] = str(300, String.fromCharCode(97 + i));
+	}
+	// then some room in a row is made
+	for(var i = 1; i < 2000; i += 4) {
+		delete obj['s' + i];
+	}
+}
+
+var obj = new binding.Cache("compact", 512 << 10, binding.SIZE_DEFAULT);
+var filler = 0;
+while(binding.stats(obj).blocksUsed + 100 < binding.stats(obj).blocksAvailable) {
+	obj['f' + filler++] = filler;
+}
+binding.clear(obj);
+fragment(obj);
+
+var before = binding.fragmentation(obj);
+assert.strictEqual(before.values, 20 + 500);
+assert.strictEqual(before.chained, 20);
+assert(before.fragmented > 0);
+
+var handle = binding.key(obj, 'l0');
+assert.strictEqual(binding.fastGet(obj, handle), str(300, 'a'));
+
+var moved = binding.compact(obj, 1000);
+assert.strictEqual(moved, before.fragmented);
+assert.strictEqual(binding.fragmentation(obj).fragmented, 0);
+assert.strictEqual(binding.stats(obj).compactions, moved);
+assert.strictEqual(binding.compact(obj), 0);
+
+// values, LRU order and handles are kept
+for(var i = 0; i < 20; i++) {
+	assert.strictEqual(obj['l' + i], str(300, String.fromCharCode(97 + i)));
+}
+for(var i = 3; i < 2000; i += 4) {
+	assert.strictEqual(obj['s' + i], i);
+}
+assert.strictEqual(binding.fastGet(obj, handle), str(300, 'a'));
+assert.deepEqual(Object.keys(obj).length, 520);
+obj.l0 = 'x';
+assert.strictEqual(binding.fastGet(obj, handle), 'x');
+delete obj.l1;
+assert.strictEqual(obj.l1, undefined);
+assert.strictEqual(binding.fragmentation(obj).values, 519);
+
+// slabs have runs of chunks of the class
+binding.release('compact');
+obj = new binding.Cache("compact", 1 << 20, binding.SIZE_DEFAULT, {slabs: true});
+// values of a page take every page, and every other one is deleted to leave holes
+for(var i = 0; i < 64; i++) {
+	obj['a' + i] = str(5000, 'a');
+}
+for(var i = 0; i < 64; i += 2) {
+	delete obj['a' + i];
+}
+for(var i = 0; i < 5; i++) {
+	obj['b' + i] = str(20000, 'b');
+}
+for(var i = 1; i < 64; i += 4) {
+	delete obj['a' + i];
+}
+var before = binding.fragmentation(obj);
+assert.strictEqual(before.fragmented, 5);
+assert.strictEqual(binding.compact(obj, 1000), 5);
+assert.strictEqual(binding.fragmentation(obj).fragmented, 0);
+for(var key in obj) {
+	assert.strictEqual(obj[key], str(key[0] === 'a' ? 5000 : 20000, key[0]));
+}
+
+binding.release('compact');
@@ -0,0 +1,46 @@
+var binding = require('../index.js');
+var assert = require('assert');
+var fs = require('fs');
+
+if(!fs.existsSync('/proc/self/maps')) {
+	return console.log('/proc/self/maps is not available, skipped');
+}
+require('v8').setFlagsFromString('--expose-gc');
+var gc = require('vm').runInNewContext('gc');
+
+function mappings() {
+	return fs.readFileSync('/proc/self/maps', 'utf8').split('\n').filter(function(line) {
+		return /\/gc_cache( \(deleted\))?$/.test(line);
+	}).length;
+}
+
+try {
+	binding.release('gc_cache');
+} catch(e) {}
+
+// caches which are released and opened again are unmapped when their instances are collected
+(function() {
+	for(var i = 0; i < 20; i++) {
+		var obj = new binding.Cache('gc_cache', 1048576, binding.SIZE_DEFAULT, {nearCache: 16});
+		obj.foo = {i: i};
+		assert.strictEqual(obj.foo.i, i);
+		binding.release('gc_cache');
+	}
+})();
+
+// namespaces and key handles keep the mapping of their cache
+var obj = new binding.Cache('gc_cache', 1048576);
+var ns = binding.namespace(obj, 'ns');
+obj = null;
+var handle = binding.key(ns, 'bar');
+ns.foo = 1;
+binding.set(ns, 'bar', 2);
+
+gc();
+setTimeout(function() {
+	gc();
+	assert.strictEqual(ns.foo, 1);
+	assert.strictEqual(binding.get(ns, handle), 2);
+	assert(mappings() <= 2, mappings() + ' mappings are left');
+	binding.release('gc_cache');
+}, 10);
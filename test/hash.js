@@ -0,0 +1,113 @@
+var binding = require('../index.js');
+try {
+	binding.release('hash');
+} catch(e) {}
+
+var assert = require('assert');
+
+var obj = new binding.Cache("hash", 1048576);
+
+// fields are added, replaced and read one at a time
+assert.strictEqual(binding.hset(obj, 'user', 'name', 'foo'), true);
+assert.strictEqual(binding.hset(obj, 'user', 'tags', ['a', 'b']), true);
+assert.strictEqual(binding.hset(obj, 'user', 'name', 'bar'), false);
+assert.strictEqual(binding.hset(obj, 'user', 'name', 'bazqux'), false);
+assert.strictEqual(binding.hget(obj, 'user', 'name'), 'bazqux');
+assert.deepEqual(binding.hget(obj, 'user', 'tags'), ['a', 'b']);
+assert.strictEqual(binding.hget(obj, 'user', 'age'), undefined);
+assert.strictEqual(binding.hget(obj, 'nobody', 'age'), undefined);
+
+// the whole hash is read as an object
+assert.deepEqual(binding.hgetall(obj, 'user'), {name: 'bazqux', tags: ['a', 'b']});
+assert.deepEqual(obj.user, {name: 'bazqux', tags: ['a', 'b']});
+assert.deepEqual(binding.hgetall(obj, 'nobody'), {});
+assert.deepEqual(binding.getPath(obj, 'user', ['tags', 1]), 'b');
+assert.deepEqual(binding.getPath(obj, 'user', ['tags', 'length']), 2);
+
+// values of fields are written on their own, so references do not cross fields
+var shared = {x: 1};
+binding.hset(obj, 'user', 'a', {p: shared, q: shared});
+binding.hset(obj, 'user', 'b', [shared, shared]);
+var a = binding.hget(obj, 'user', 'a');
+assert.strictEqual(a.p, a.q);
+assert.deepEqual(binding.hget(obj, 'user', 'b'), [{x: 1}, {x: 1}]);
+binding.hdel(obj, 'user', 'a');
+assert.deepEqual(binding.hget(obj, 'user', 'b'), [{x: 1}, {x: 1}]);
+
+// counters
+assert.strictEqual(binding.hincr(obj, 'user', 'visits'), 1);
+assert.strictEqual(binding.hincr(obj, 'user', 'visits', 10), 11);
+assert.strictEqual(binding.hincr(obj, 'user', 'visits', -2), 9);
+assert.strictEqual(binding.hincr(obj, 'user', 'name'), 1); // not an integer
+assert.strictEqual(binding.hget(obj, 'user', 'visits'), 9);
+
+// deletion
+assert.strictEqual(binding.hdel(obj, 'user', 'name'), true);
+assert.strictEqual(binding.hdel(obj, 'user', 'name'), false);
+assert.deepEqual(Object.keys(binding.hgetall(obj, 'user')).sort(), ['b', 'tags', 'visits']);
+binding.hdel(obj, 'user', 'b');
+binding.hdel(obj, 'user', 'tags');
+binding.hdel(obj, 'user', 'visits');
+assert.strictEqual(obj.user, undefined); // with its last field
+
+// keys holding other values are not hashes
+obj.plain = {name: 'foo'};
+assert.throws(function() {
+	binding.hset(obj, 'plain', 'name', 'bar');
+}, TypeError);
+assert.throws(function() {
+	binding.hget(obj, 'plain', 'name');
+}, TypeError);
+assert.throws(function() {
+	binding.hgetall(obj, 'plain');
+}, TypeError);
+assert.deepEqual(obj.plain, {name: 'foo'});
+
+// names of any length and values over several blocks
+var long = Array(1000).join('中');
+binding.hset(obj, 'big', long, long);
+binding.hset(obj, 'big', 'x', Array(3000).join('-'));
+assert.strictEqual(binding.hget(obj, 'big', long), long);
+binding.hset(obj, 'big', 'x', Array(3000).join('+'));
+assert.strictEqual(binding.hget(obj, 'big', 'x'), Array(3000).join('+'));
+assert.strictEqual(binding.hget(obj, 'big', long), long);
+
+// updates of concurrent writers are not lost
+binding.hset(obj, 'counters', 'n', 0);
+for(var i = 0; i < 100; i++) {
+	binding.hincr(obj, 'counters', 'n');
+	binding.hset(obj, 'counters', 'f' + (i % 10), i);
+}
+assert.strictEqual(binding.hget(obj, 'counters', 'n'), 100);
+assert.strictEqual(Object.keys(obj.counters).length, 11);
+
+// key handles address hashes like names
+var user = binding.key(obj, 'user:2');
+assert.strictEqual(binding.hset(obj, user, 'name', 'bar'), true);
+assert.strictEqual(binding.hincr(obj, user, 'visits'), 1);
+assert.strictEqual(binding.hincr(obj, user, 'visits', 2), 3);
+assert.strictEqual(binding.hget(obj, user, 'name'), 'bar');
+assert.strictEqual(binding.hset(obj, user, 'name', Array(100).join('-')), false);
+assert.strictEqual(binding.hget(obj, 'user:2', 'name'), Array(100).join('-'));
+assert.strictEqual(binding.hdel(obj, user, 'name'), true);
+assert.deepEqual(binding.hgetall(obj, user), {visits: 3});
+assert.deepEqual(obj['user:2'], {visits: 3});
+
+// tiny hashes are kept in slots
+binding.release('hash');
+obj = new binding.Cache("hash", 1048576, binding.SIZE_DEFAULT, {smallSlots: 64});
+assert.strictEqual(binding.hincr(obj, 'h', ''), 1);
+assert.strictEqual(binding.stats(obj).smallUsed, 1);
+assert.strictEqual(binding.hincr(obj, 'h', ''), 2);
+binding.hset(obj, 'h', 'name', 'foobar');
+assert.strictEqual(binding.stats(obj).smallUsed, 0);
+assert.deepEqual(binding.hgetall(obj, 'h'), {'': 2, name: 'foobar'});
+binding.hdel(obj, 'h', 'name');
+assert.strictEqual(binding.stats(obj).smallUsed, 1);
+assert.deepEqual(obj.h, {'': 2});
+obj.n = 1;
+assert.throws(function() {
+	binding.hincr(obj, 'n', 'x');
+}, TypeError);
+
+binding.release('hash');
@@ -0,0 +1,60 @@
+var binding = require('../index.js');
+try {
+	binding.release('key');
+} catch(e) {}
+
+var assert = require('assert');
+
+var obj = new binding.Cache("key", 1048576);
+var foo = binding.key(obj, 'foo');
+
+// handles can be used in place of key names
+assert.strictEqual(binding.fastGet(obj, foo), undefined);
+assert.strictEqual(binding.increase(obj, foo), 1);
+assert.strictEqual(binding.increase(obj, foo, 2), 3);
+assert.strictEqual(binding.fastGet(obj, foo), 3);
+assert.strictEqual(binding.exchange(obj, foo, 'bar'), 3);
+assert.strictEqual(obj.foo, 'bar');
+assert.strictEqual(binding.fastGet(obj, foo), 'bar');
+
+// modifications by names are seen by handles
+obj.foo = 'baz';
+assert.strictEqual(binding.fastGet(obj, foo), 'baz');
+delete obj.foo;
+assert.strictEqual(binding.fastGet(obj, foo), undefined);
+assert.strictEqual(binding.exchange(obj, foo, 1), undefined);
+assert.strictEqual(binding.fastGet(obj, foo), 1);
+
+// and so are evictions
+var data = Array(1024).join('-');
+for(var i = 0; i < 1024; i++) {
+	obj['k' + i] = data;
+}
+assert.strictEqual(binding.fastGet(obj, foo), undefined);
+binding.exchange(obj, foo, 2);
+binding.clear(obj);
+assert.strictEqual(binding.fastGet(obj, foo), undefined);
+
+// handles belong to the namespace they are prepared for
+var ns = binding.namespace(obj, 'ns');
+var nsFoo = binding.key(ns, 'foo');
+binding.exchange(ns, nsFoo, 'ns');
+assert.strictEqual(ns.foo, 'ns');
+assert.strictEqual(obj.foo, undefined);
+assert.throws(function() {
+	binding.fastGet(obj, nsFoo);
+}, /another cache instance/);
+
+assert.throws(function() {
+	binding.key(obj, Array(20).join('-'));
+}, /length of property name/);
+
+// near cache with handles
+var near = new binding.Cache("key", 1048576, binding.SIZE_DEFAULT, {nearCache: 16});
+var bar = binding.key(near, 'bar');
+near.bar = {};
+assert.strictEqual(binding.fastGet(near, bar), binding.fastGet(near, bar));
+near.bar = {baz: 1};
+assert.deepEqual(binding.fastGet(near, bar), {baz: 1});
+
+binding.release('key');
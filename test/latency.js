@@ -0,0 +1,45 @@
+var binding = require('../index.js');
+try {
+	binding.release('latency');
+} catch(e) {}
+
+var assert = require('assert');
+
+var obj = new binding.Cache("latency", 1048576);
+
+// nothing is recorded until enabled
+obj.foo = 'bar';
+var latency = binding.latency(obj);
+assert.strictEqual(latency.enabled, false);
+assert.strictEqual(latency.set.lock.count, 0);
+
+latency = binding.latency(obj, true);
+assert.strictEqual(latency.enabled, true);
+for(var i = 0; i < 100; i++) {
+	obj.foo = {bar: i};
+	binding.fastGet(obj, 'foo');
+}
+assert.deepEqual(obj.foo, {bar: 99});
+delete obj.foo;
+
+latency = binding.latency(obj);
+assert.strictEqual(latency.set.lock.count, 100);
+assert.strictEqual(latency.set.hold.count, 100);
+assert.strictEqual(latency.fastGet.hold.count, 100);
+assert.strictEqual(latency.get.hold.count, 1);
+assert.strictEqual(latency.delete.hold.count, 1);
+assert.strictEqual(latency.serialize.count, 100);
+assert.strictEqual(latency.parse.count, 101);
+var h = latency.set.hold;
+assert(h.p50 <= h.p90 && h.p90 <= h.p99 && h.p99 <= h.p999 && h.p999 <= h.max);
+assert(h.mean > 0);
+
+// histograms are shared by processes, and cleared when enabled again
+var attached = new binding.Cache("latency", 0);
+assert.strictEqual(binding.latency(attached).set.lock.count, 100);
+binding.latency(attached, false);
+obj.foo = 1;
+assert.strictEqual(binding.latency(obj).set.lock.count, 100);
+assert.strictEqual(binding.latency(obj, true).set.lock.count, 0);
+
+binding.release('latency');
@@ -0,0 +1,93 @@
+var binding = require('../index.js');
+var assert = require('assert');
+var child_process = require('child_process');
+
+function child(role) {
+	return child_process.spawn(process.execPath, process.execArgv.concat([__filename, role]), {stdio: ['ignore', 'pipe', 'inherit']});
+}
+
+function output(proc, cb) {
+	var out = '';
+	proc.stdout.on('data', function(data) {
+		out += data;
+	});
+	proc.on('exit', function(code) {
+		assert.strictEqual(code, 0);
+		cb(out);
+	});
+}
+
+var role = process.argv[2];
+if(role) {
+	var obj = new binding.Cache("lease", 1048576);
+	if(role === 'wait') { // blocks until the parent sets the key
+		process.stdout.write(String(JSON.stringify(binding.getOrLock(obj, 'foo'))));
+	} else if(role === 'hold') { // exits with the lease held
+		assert.strictEqual(binding.getOrLock(obj, 'bar', 60000), undefined);
+	}
+	return;
+}
+
+try {
+	binding.release('lease');
+} catch(e) {}
+
+var obj = new binding.Cache("lease", 1048576);
+
+// a present key is returned
+obj.foo = 1;
+assert.strictEqual(binding.getOrLock(obj, 'foo'), 1);
+
+// an absent key is leased, and regarded absent
+delete obj.foo;
+assert.strictEqual(binding.getOrLock(obj, 'foo'), undefined);
+assert.strictEqual(obj.foo, undefined);
+assert.strictEqual(binding.fastGet(obj, 'foo'), undefined);
+assert.ok(!('foo' in obj));
+assert.deepEqual(Object.keys(obj), []);
+assert.deepEqual(binding.dump(obj), {});
+// the lease holder may ask again
+assert.strictEqual(binding.getOrLock(obj, 'foo'), undefined);
+// the lease is resolved by setting the key
+assert.strictEqual(binding.exchange(obj, 'foo', 2), undefined);
+assert.strictEqual(binding.getOrLock(obj, 'foo'), 2);
+
+// increase resolves the lease too
+assert.strictEqual(binding.getOrLock(obj, 'baz'), undefined);
+assert.strictEqual(binding.increase(obj, 'baz'), 1);
+
+// key handles are leased like names
+var qux = binding.key(obj, 'qux');
+assert.strictEqual(binding.getOrLock(obj, qux), undefined);
+assert.strictEqual(obj.qux, undefined);
+assert.strictEqual(binding.getOrLock(obj, qux), undefined);
+obj.qux = 4;
+assert.strictEqual(binding.getOrLock(obj, qux), 4);
+assert.strictEqual(binding.getOrLock(obj, 'qux'), 4);
+
+// another process waits for the value
+delete obj.foo;
+assert.strictEqual(binding.getOrLock(obj, 'foo'), undefined);
+var start = Date.now();
+output(child('wait'), function(out) {
+	assert.deepEqual(JSON.parse(out), {value: 3});
+	assert.ok(Date.now() - start >= 200);
+
+	// lease of an exited process is taken over
+	output(child('hold'), function() {
+		start = Date.now();
+		assert.strictEqual(binding.getOrLock(obj, 'bar'), undefined);
+		assert.ok(Date.now() - start < 1000);
+
+		// expired lease is taken over
+		delete obj.foo;
+		assert.strictEqual(binding.getOrLock(obj, 'foo', 1), undefined);
+		output(child('wait'), function(out) {
+			assert.strictEqual(out, 'undefined');
+			binding.release('lease');
+		});
+	});
+});
+setTimeout(function() {
+	obj.foo = {value: 3};
+}, 300);
@@ -0,0 +1,42 @@
+var binding = require('../index.js');
+try {
+	binding.release('method');
+} catch(e) {}
+
+var assert = require('assert');
+
+var obj = new binding.Cache("method", 1048576);
+
+// values set by methods are seen by properties, and vice versa
+binding.set(obj, 'int', 123);
+binding.set(obj, 'negative', -1);
+binding.set(obj, 'double', 1.5);
+binding.set(obj, 'large', 4294967296);
+binding.set(obj, 'string', 'foo');
+binding.set(obj, 'object', {foo: [1, 'bar']});
+assert.strictEqual(obj.int, 123);
+assert.strictEqual(obj.negative, -1);
+assert.strictEqual(obj.double, 1.5);
+assert.strictEqual(obj.large, 4294967296);
+assert.strictEqual(obj.string, 'foo');
+assert.deepEqual(obj.object, {foo: [1, 'bar']});
+
+obj.foo = 'bar';
+assert.strictEqual(binding.get(obj, 'foo'), 'bar');
+assert.strictEqual(binding.get(obj, 'absent'), undefined);
+binding.set(obj, 'nan', NaN);
+assert.ok(isNaN(binding.get(obj, 'nan')));
+
+// names which are shadowed by the prototype through properties
+binding.set(obj, 'toString', 'foo');
+assert.strictEqual(binding.get(obj, 'toString'), 'foo');
+
+// key handles
+var key = binding.key(obj, 'key');
+binding.set(obj, key, 1);
+assert.strictEqual(binding.get(obj, key), 1);
+binding.set(obj, key, 2);
+assert.strictEqual(binding.get(obj, key), 2);
+assert.strictEqual(obj.key, 2);
+
+binding.release('method');
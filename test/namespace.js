@@ -0,0 +1,50 @@
+var binding = require('../index.js');
+try {
+	binding.release('namespace');
+} catch(e) {}
+
+var assert = require('assert');
+
+var obj = new binding.Cache("namespace", 1048576);
+var sessions = binding.namespace(obj, 'sessions', 128 << 10);
+var fragments = binding.namespace(obj, 'fragments', 256 << 10);
+
+// keys of namespaces are separated
+obj.foo = 'default';
+sessions.foo = 'session';
+assert.strictEqual(obj.foo, 'default');
+assert.strictEqual(sessions.foo, 'session');
+assert.strictEqual(fragments.foo, undefined);
+assert.strictEqual(binding.increase(fragments, 'foo'), 1);
+assert.deepEqual(Object.keys(sessions), ['foo']);
+assert.deepEqual(binding.dump(fragments), {foo: 1});
+
+// the same namespace is returned by name
+assert.strictEqual(binding.namespace(obj, 'sessions').foo, 'session');
+
+for(var i = 0; i < 1000; i++) {
+	sessions['s' + i] = i;
+}
+
+// a burst of big writes only evicts keys of its own namespace
+var fragment = Array(64).join('<div></div>');
+for(var i = 0; i < 10000; i++) {
+	fragments['f' + i] = fragment;
+}
+assert.strictEqual(obj.foo, 'default');
+for(var i = 0; i < 1000; i++) {
+	assert.strictEqual(sessions['s' + i], i);
+}
+assert.ok(Object.keys(fragments).length < 256 << 10 >> 10);
+
+// values larger than the quota are rejected
+assert.throws(function () {
+	sessions.big = Array(128 << 10).join('x');
+});
+
+// clearing a namespace keeps other namespaces
+binding.clear(fragments);
+assert.deepEqual(Object.keys(fragments), []);
+assert.strictEqual(sessions.s1, 1);
+binding.clear(obj);
+assert.deepEqual(Object.keys(sessions), []);
@@ -0,0 +1,86 @@
+var binding = require('../index.js');
+var assert = require('assert');
+var child_process = require('child_process');
+
+if(process.argv[2]) { // sets a key from another process
+	var obj = new binding.Cache("nearcache", 1048576);
+	obj[process.argv[2]] = JSON.parse(process.argv[3]);
+	return;
+}
+
+function setInChild(key, value) {
+	var ret = child_process.spawnSync(process.execPath, process.execArgv.concat([__filename, key, JSON.stringify(value)]), {stdio: 'inherit'});
+	assert.strictEqual(ret.status, 0);
+}
+
+try {
+	binding.release('nearcache');
+} catch(e) {}
+
+var obj = new binding.Cache("nearcache", 1048576, binding.SIZE_DEFAULT, {nearCache: 2});
+
+// parsed values are reused while the key is unchanged
+obj.foo = {bar: 1};
+var foo = obj.foo;
+assert.deepEqual(foo, {bar: 1});
+assert.strictEqual(obj.foo, foo);
+assert.strictEqual(binding.fastGet(obj, 'foo'), foo);
+
+// modifications of this process
+obj.foo = {bar: 2};
+assert.deepEqual(obj.foo, {bar: 2});
+assert.notStrictEqual(obj.foo, foo);
+foo = obj.foo;
+binding.increase(obj, 'foo');
+assert.strictEqual(obj.foo, 1);
+obj.foo = {bar: 3};
+foo = obj.foo;
+assert.strictEqual(binding.exchange(obj, 'foo', {bar: 4}).bar, 3);
+assert.strictEqual(obj.foo.bar, 4);
+foo = obj.foo;
+delete obj.foo;
+assert.strictEqual(obj.foo, undefined);
+
+// modifications of other processes
+obj.foo = {bar: 5};
+foo = obj.foo;
+setInChild('foo', {bar: 6});
+assert.deepEqual(obj.foo, {bar: 6});
+
+// clearing the cache
+foo = obj.foo;
+binding.clear(obj);
+assert.strictEqual(obj.foo, undefined);
+
+// namespaces share the near cache but not the keys
+var ns = binding.namespace(obj, 'ns');
+obj.foo = 'default';
+ns.foo = 'ns';
+assert.strictEqual(obj.foo, 'default');
+assert.strictEqual(ns.foo, 'ns');
+assert.strictEqual(obj.foo, 'default');
+
+// entries are limited
+obj.a = {}; obj.b = {}; obj.c = {};
+var a = obj.a, b = obj.b;
+assert.strictEqual(obj.a, a);
+assert.strictEqual(obj.b, b);
+obj.c;
+assert.strictEqual(obj.b, b);
+assert.notStrictEqual(obj.a, a);
+
+// evicted keys
+obj.big = {bar: 1};
+var big = obj.big;
+var data = Array(1024).join('-');
+for(var i = 0; i < 1024; i++) {
+	obj['k' + i] = data;
+}
+assert.strictEqual(obj.big, undefined);
+
+// the near cache is not enabled by default
+var plain = new binding.Cache("nearcache", 1048576);
+plain.foo = {};
+assert.notStrictEqual(plain.foo, plain.foo);
+
+binding.release('nearcache');
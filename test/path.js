@@ -0,0 +1,78 @@
+var binding = require('../index.js');
+try {
+	binding.release('path');
+} catch(e) {}
+
+var assert = require('assert');
+
+var indexed = new binding.Cache("path", 4194304, binding.SIZE_DEFAULT, {indexed: true});
+var plain = new binding.Cache("path", 4194304);
+
+var profile = {
+	id: 42,
+	user: {name: 'foo', prefs: ['a', 'b', {theme: 'dark'}, 3.5], 10: 'ten'},
+	history: []
+};
+for(var i = 0; i < 1000; i++) {
+	profile.history.push({at: i, page: '/page/' + i});
+}
+
+// values written by either instance are read by both
+binding.set(indexed, 'profile', profile);
+binding.set(plain, 'plain', profile);
+assert.deepEqual(indexed.profile, profile);
+assert.deepEqual(plain.profile, profile);
+
+[indexed, plain].forEach(function(obj) {
+	['profile', 'plain'].forEach(function(key) {
+		assert.strictEqual(binding.getPath(obj, key, ['id']), 42);
+		assert.strictEqual(binding.getPath(obj, key, ['user', 'name']), 'foo');
+		assert.strictEqual(binding.getPath(obj, key, ['user', 'prefs', 1]), 'b');
+		assert.strictEqual(binding.getPath(obj, key, ['user', 'prefs', '3']), 3.5);
+		assert.deepEqual(binding.getPath(obj, key, ['user', 'prefs', 2]), {theme: 'dark'});
+		assert.strictEqual(binding.getPath(obj, key, ['user', 'prefs', 2, 'theme']), 'dark');
+		assert.strictEqual(binding.getPath(obj, key, ['user', 10]), 'ten');
+		assert.strictEqual(binding.getPath(obj, key, ['user', 'prefs', 'length']), 4);
+		assert.deepEqual(binding.getPath(obj, key, ['history', 999]), {at: 999, page: '/page/999'});
+		assert.strictEqual(binding.getPath(obj, key, ['history', 1000]), undefined);
+		assert.strictEqual(binding.getPath(obj, key, ['user', 'missing']), undefined);
+		assert.strictEqual(binding.getPath(obj, key, ['id', 'missing']), undefined);
+		assert.deepEqual(binding.getPath(obj, key, []), profile);
+	});
+	assert.strictEqual(binding.getPath(obj, 'missing', ['id']), undefined);
+});
+
+// parts are smaller than the value
+var stats = binding.stats(indexed);
+assert.ok(stats.hits > 0);
+
+// references inside the part are kept, and references out of it are resolved from the whole value
+var shared = {x: 1};
+var graph = {a: {left: shared, right: shared}, b: shared};
+graph.a.self = graph.a;
+graph.a.root = graph;
+binding.set(indexed, 'graph', graph);
+var a = binding.getPath(indexed, 'graph', ['a']);
+assert.strictEqual(a.left, a.right);
+assert.strictEqual(a.self, a);
+assert.strictEqual(a.root.a, a);
+var b = binding.getPath(indexed, 'graph', ['b']);
+assert.deepEqual(b, {x: 1});
+
+// other types are walked through after parsing
+binding.set(indexed, 'map', {m: new Map([['k', [1, 2]]]), s: 'str'});
+assert.strictEqual(binding.getPath(indexed, 'map', ['s', 'length']), 3);
+assert.ok(binding.getPath(indexed, 'map', ['m']) instanceof Map);
+
+// handles and namespaces
+var key = binding.key(indexed, 'profile');
+assert.strictEqual(binding.getPath(indexed, key, ['user', 'name']), 'foo');
+var ns = binding.namespace(indexed, 'ns');
+binding.set(ns, 'profile', {deep: [{er: true}]});
+assert.strictEqual(binding.getPath(ns, 'profile', ['deep', 0, 'er']), true);
+
+assert.throws(function() {
+	binding.getPath(indexed, 'profile', 'user');
+}, /path should be an array/);
+
+binding.release('path');
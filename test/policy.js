@@ -0,0 +1,68 @@
+// Replays a key trace against an LRU cache and a TinyLFU cache, and reports hit rates.
+//
+//   node test/policy.js [trace_file]
+//
+// trace_file contains one key per line. Without it, a synthetic trace is used: a skewed
+// hot set whose accesses are interrupted by scans over keys that are never seen again.
+var fs = require('fs');
+var binding = require('../index.js');
+
+var trace;
+if(process.argv[2]) {
+    trace = fs.readFileSync(process.argv[2], 'utf8').split('\n').filter(Boolean);
+} else {
+    trace = synthetic(1500, 20, 20000, 5000);
+}
+
+function synthetic(hotKeys, rounds, hotAccesses, scanLength) {
+    // zipf distribution over the hot set
+    var cdf = [], sum = 0;
+    for(var i = 0; i < hotKeys; i++) {
+        cdf[i] = sum += 1 / Math.pow(i + 1, 0.9);
+    }
+
+    var seed = 1;
+    function random() {
+        seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+        return seed / 0x80000000;
+    }
+
+    var keys = [], cold = 0;
+    for(var round = 0; round < rounds; round++) {
+        for(var i = 0; i < hotAccesses; i++) {
+            var r = random() * sum, lo = 0, hi = hotKeys - 1;
+            while(lo < hi) {
+                var mid = lo + hi >> 1;
+                if(cdf[mid] < r) lo = mid + 1;
+                else hi = mid;
+            }
+            keys.push('h' + lo);
+        }
+        for(var i = 0; i < scanLength; i++) {
+            keys.push('c' + cold++);
+        }
+    }
+    return keys;
+}
+
+function replay(name, policy) {
+    try {
+        binding.release(name);
+    } catch(e) {}
+    var obj = new binding.Cache(name, 512 << 10, binding.SIZE_64, {policy: policy});
+
+    var hits = 0, start = Date.now();
+    for(var i = 0; i < trace.length; i++) {
+        var key = trace[i];
+        if(obj[key] !== undefined) {
+            hits++;
+        } else {
+            obj[key] = i;
+        }
+    }
+    console.log('%s: hit rate %s% (%d accesses, %dms)', name, (hits * 100 / trace.length).toFixed(2), trace.length, Date.now() - start);
+    binding.release(name);
+}
+
+replay('policy_lru', binding.POLICY_LRU);
+replay('policy_tinylfu', binding.POLICY_TINYLFU);
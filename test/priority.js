@@ -0,0 +1,133 @@
+var binding = require('../index.js');
+try {
+	binding.release('priority');
+} catch(e) {}
+
+var assert = require('assert');
+
+function str(n, c) {
+	return Array(n + 1).join(c || '-');
+}
+
+function check(obj) {
+	var obj = new binding.Cache("priority", 1048576, binding.SIZE_DEFAULT, arguments[1]);
+
+	// pinned entries survive floods of other keys
+	binding.set(obj, 'flag', true, {pinned: true});
+	binding.set(obj, 'routes', {a: str(500)}, {priority: binding.PRIORITY_PINNED});
+	var pinned = binding.stats(obj).pinnedBlocks;
+	assert(pinned > 8);
+	for(var i = 0; i < 20000; i++) {
+		obj['k' + i] = str(100);
+	}
+	assert(binding.stats(obj).evictions > 0);
+	assert.strictEqual(obj.flag, true);
+	assert.deepEqual(obj.routes, {a: str(500)});
+	assert.strictEqual(binding.stats(obj).pinnedBlocks, pinned);
+
+	// pins are kept by increase, sets without a priority and transactions, and dropped by a set of another priority
+	binding.set(obj, 'count', 1, {pinned: true});
+	assert.strictEqual(binding.increase(obj, 'count'), 2);
+	obj.flag = false;
+	binding.set(obj, 'routes', {a: str(500, 'b')}, {timeout: 10});
+	binding.transaction(obj, [['set', 'count', 3]]);
+	for(var i = 0; i < 20000; i++) {
+		obj['k' + i] = str(100);
+	}
+	assert.strictEqual(obj.count, 3);
+	assert.strictEqual(obj.flag, false);
+	assert.deepEqual(obj.routes, {a: str(500, 'b')});
+	assert.strictEqual(binding.stats(obj).pinnedBlocks, pinned + 1);
+	binding.set(obj, 'routes', 1, {priority: binding.PRIORITY_NORMAL});
+	assert(binding.stats(obj).pinnedBlocks < pinned);
+
+	// low priority entries are evicted first
+	binding.clear(obj);
+	assert.strictEqual(binding.stats(obj).pinnedBlocks, 0);
+	for(var i = 0; i < 100; i++) {
+		binding.set(obj, 'low' + i, str(100), {priority: binding.PRIORITY_LOW});
+	}
+	var evictions = binding.stats(obj).evictions;
+	for(var i = 0; binding.stats(obj).evictions - evictions < 50; i++) {
+		obj['k' + i] = str(100);
+	}
+	var normal = i;
+	for(var i = 0; i < normal; i++) {
+		assert.strictEqual(obj['k' + i], str(100));
+	}
+	var low = Object.keys(obj).filter(function(key) {
+		return key.slice(0, 3) === 'low';
+	});
+	assert.strictEqual(low.length, 50);
+
+	// all lists are enumerated, and cleared
+	evictions = binding.stats(obj).evictions;
+	binding.set(obj, 'pin', 1, {pinned: true});
+	assert('pin' in obj);
+	assert.strictEqual(Object.keys(obj).length, normal + 51 - (binding.stats(obj).evictions - evictions));
+	assert.strictEqual(binding.dump(obj).pin, 1);
+	var ns = binding.namespace(obj, 'ns');
+	binding.set(ns, 'pin', 2, {pinned: true});
+	binding.set(ns, 'low', 3, {priority: binding.PRIORITY_LOW});
+	assert.deepEqual(Object.keys(ns).sort(), ['low', 'pin']);
+	binding.clear(ns);
+	assert.deepEqual(Object.keys(ns), []);
+	assert.strictEqual(obj.pin, 1);
+
+	// pinned entries take at most half of the cache
+	assert.throws(function() {
+		var stats = binding.stats(obj);
+		binding.set(obj, 'big', str(stats.blocksAvailable * stats.blockSize * 0.3), {pinned: true}); // 2 bytes per char
+	}, /half/);
+	for(var i = 0; ; i++) {
+		try {
+			binding.set(obj, 'p' + i, str(1000), {pinned: true});
+		} catch(e) {
+			assert(/half/.test(e.message));
+			break;
+		}
+	}
+	var stats = binding.stats(obj);
+	assert(stats.pinnedBlocks <= stats.blocksAvailable / 2);
+	for(var i = 0; i < 20000; i++) {
+		obj['k' + i] = str(100);
+	}
+	assert.strictEqual(obj.k19999, str(100));
+	assert.strictEqual(obj.p0, str(1000));
+
+	assert.throws(function() {
+		binding.set(obj, 'x', 1, {priority: 3});
+	}, /priority/);
+
+	binding.release('priority');
+}
+
+check(null);
+check({policy: binding.POLICY_TINYLFU});
+check({slabs: true});
+check({smallSlots: 64});
+
+// hashes keep their priority when their fields are updated
+try {
+	binding.release('priority_log');
+} catch(e) {}
+var primary = new binding.Cache("priority_log", 1048576, binding.SIZE_DEFAULT, {changeLog: 64 << 10});
+var cursor = binding.readLog(primary).cursor;
+binding.hset(primary, 'h', 'a', str(100));
+var records = binding.readLog(primary, cursor).records;
+records[5] = binding.PRIORITY_PINNED; // a hash pinned on another cache
+var obj = new binding.Cache("priority", 1048576, binding.SIZE_DEFAULT, {smallSlots: 64});
+assert.strictEqual(binding.applyLog(obj, records), records.length);
+assert(binding.stats(obj).pinnedBlocks > 0);
+binding.hset(obj, 'h', 'b', str(200));
+binding.hset(obj, 'h', 'a', 1);
+assert.strictEqual(binding.hincr(obj, 'h', 'n'), 1);
+assert.strictEqual(binding.hdel(obj, 'h', 'a'), true);
+assert.strictEqual(binding.hdel(obj, 'h', 'b'), true); // small enough for a slot
+for(var i = 0; i < 20000; i++) {
+	obj['k' + i] = str(100);
+}
+assert.deepEqual(binding.hgetall(obj, 'h'), {n: 1});
+assert(binding.stats(obj).pinnedBlocks > 0);
+binding.release('priority');
+binding.release('priority_log');
@@ -0,0 +1,105 @@
+var binding = require('../index.js');
+var child_process = require('child_process');
+var assert = require('assert');
+
+if(process.argv[2] === 'producer') {
+	// pushes messages from another process
+	var queue = new binding.Queue('queue', 0);
+	var base = +process.argv[3];
+	for(var i = 0; i < 1000; ) {
+		if(binding.push(queue, {from: base, i: i})) i++;
+	}
+	return;
+}
+
+try {
+	binding.release('queue');
+} catch(e) {}
+
+var queue = new binding.Queue('queue', 5, 64);
+var stats = binding.queueStats(queue);
+assert.strictEqual(stats.capacity, 8); // a power of 2
+assert.strictEqual(stats.messageSize, 64);
+assert.strictEqual(stats.length, 0);
+
+// messages are popped in order
+assert.strictEqual(binding.pop(queue), undefined);
+assert.strictEqual(binding.push(queue, 'foo'), true);
+assert.strictEqual(binding.push(queue, {a: [1, 2]}), true);
+assert.strictEqual(binding.pop(queue), 'foo');
+assert.deepEqual(binding.pop(queue), {a: [1, 2]});
+assert.strictEqual(binding.pop(queue), undefined);
+
+// pushes stop when the queue is full
+assert.strictEqual(binding.pushMany(queue, [1, 2, 3, 4, 5, 6]), 6);
+assert.strictEqual(binding.pushMany(queue, [7, 8, 9, 10]), 2);
+assert.strictEqual(binding.push(queue, 11), false);
+assert.strictEqual(binding.queueStats(queue).length, 8);
+assert.deepEqual(binding.popMany(queue, 3), [1, 2, 3]);
+assert.deepEqual(binding.popMany(queue, 10), [4, 5, 6, 7, 8]);
+assert.deepEqual(binding.popMany(queue, 10), []);
+stats = binding.queueStats(queue);
+assert.strictEqual(stats.pushed, 10);
+assert.strictEqual(stats.popped, 10);
+
+// messages should fit in the message size
+assert.throws(function() {
+	binding.push(queue, Array(100).join('-'));
+}, /message size/);
+assert.throws(function() {
+	binding.pushMany(queue, [1, Array(100).join('-')]);
+}, /message size/);
+assert.strictEqual(binding.pop(queue), undefined); // nothing is pushed
+
+// pop waits for the timeout
+var begin = Date.now();
+assert.strictEqual(binding.pop(queue, 50), undefined);
+assert(Date.now() - begin >= 45);
+
+// all processes should open the queue with the same capacity and message size
+assert.throws(function() {
+	new binding.Queue('queue', 16, 64);
+}, /different/);
+assert.throws(function() {
+	new binding.Queue('queue', 8, 32);
+}, /different/);
+var same = new binding.Queue('queue', 0);
+binding.push(same, 'same');
+assert.strictEqual(binding.pop(queue), 'same');
+assert.throws(function() {
+	new binding.Queue('queue_absent', 0);
+}, /not found/);
+assert.throws(function() {
+	binding.push({}, 1);
+}, /queue/);
+
+// consumers waiting on the threadpool are woken by producers of other processes
+var producers = 4, received = {};
+function consume() {
+	return binding.popManyAsync(queue, 100, 5000).then(function(messages) {
+		assert(messages.length > 0);
+		messages.forEach(function(message) {
+			var last = received[message.from];
+			assert.strictEqual(message.i, last === undefined ? 0 : last + 1); // in order per producer
+			received[message.from] = message.i;
+		});
+		for(var i = 0; i < producers; i++) {
+			if(received[i] !== 999) return consume();
+		}
+	});
+}
+
+binding.popAsync(queue, 10).then(function(message) {
+	assert.strictEqual(message, undefined);
+	var waiting = consume();
+	for(var i = 0; i < producers; i++) {
+		child_process.fork(__filename, ['producer', i]);
+	}
+	return waiting;
+}).then(function() {
+	assert.strictEqual(binding.pop(queue), undefined);
+	binding.release('queue');
+}).catch(function(e) {
+	console.error(e);
+	process.exit(1);
+});
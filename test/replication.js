@@ -0,0 +1,173 @@
+var binding = require('../index.js');
+var net = require('net');
+var fs = require('fs');
+['primary', 'replica', 'mirror'].forEach(function(name) {
+	try {
+		binding.release(name);
+	} catch(e) {}
+});
+
+var assert = require('assert');
+
+var primary = new binding.Cache("primary", 4 << 20, binding.SIZE_DEFAULT, {changeLog: 64 << 10});
+var replica = new binding.Cache("replica", 4 << 20);
+assert.strictEqual(binding.stats(primary).changeLog, 64 << 10);
+assert.strictEqual(binding.stats(replica).changeLog, 0);
+assert.throws(function() {
+	binding.readLog(replica);
+}, /no change log/);
+
+function str(n, c) {
+	return Array(n + 1).join(c || '-');
+}
+
+// records are read from where the log is, and applied in order
+var part = binding.readLog(primary);
+assert.strictEqual(part.records.length, 0);
+var cursor = part.cursor;
+
+primary.a = 1;
+primary.b = {x: [1, 2], y: 'y'};
+primary.c = str(1000);
+delete primary.a;
+assert.strictEqual(binding.increase(primary, 'n', 5), 5);
+binding.hset(primary, 'h', 'f', 1);
+binding.hset(primary, 'h', 'g', 'abc');
+binding.hincr(primary, 'h', 'f', 2);
+binding.set(primary, 'p', 'pinned', {pinned: true});
+var ns = binding.namespace(primary, 'ns');
+ns.k = 'in ns';
+binding.transaction(primary, [['set', 't1', 1], ['increase', 'n', 1], ['unset', 'c']]);
+
+part = binding.readLog(primary, cursor);
+assert(part.records.length > 0);
+assert.strictEqual(part.cursor, binding.stats(primary).logPosition);
+assert.strictEqual(binding.applyLog(replica, part.records), part.records.length);
+assert.deepEqual(binding.dump(replica), binding.dump(primary));
+assert.strictEqual(binding.namespace(replica, 'ns').k, 'in ns');
+assert.strictEqual(binding.hget(replica, 'h', 'f'), 3);
+assert(binding.stats(replica).pinnedBlocks > 0); // priorities are kept
+
+// nothing is read twice
+part = binding.readLog(primary, part.cursor);
+assert.strictEqual(part.records.length, 0);
+
+// records are applied whole, a cut one is left for the next call
+cursor = part.cursor;
+primary.d = str(300);
+ns.k = 'changed';
+binding.clear(ns);
+part = binding.readLog(primary, cursor);
+var applied = binding.applyLog(replica, part.records.slice(0, part.records.length - 10));
+assert(applied < part.records.length - 10);
+assert.strictEqual(applied + binding.applyLog(replica, part.records.slice(applied)), part.records.length);
+assert.strictEqual(replica.d, str(300));
+assert.deepEqual(Object.keys(binding.namespace(replica, 'ns')), []);
+cursor = part.cursor;
+
+// reads are cut at maxBytes
+primary.e = 1;
+primary.f = 2;
+part = binding.readLog(primary, cursor, 20);
+assert.strictEqual(binding.applyLog(replica, part.records), part.records.length);
+assert.strictEqual(replica.e, 1);
+assert.strictEqual(replica.f, undefined);
+part = binding.readLog(primary, part.cursor, 20);
+binding.applyLog(replica, part.records);
+assert.strictEqual(replica.f, 2);
+cursor = part.cursor;
+
+// records which are overwritten before they are read are lost, and a snapshot is taken again
+for(var i = 0; i < 100; i++) {
+	primary['k' + i] = str(1000);
+}
+assert.strictEqual(binding.readLog(primary, cursor), null);
+
+// a snapshot clears the replica and sets all entries, with the cursor to follow the log from
+replica.stale = 1;
+var snapshot = binding.snapshot(primary);
+assert.strictEqual(snapshot.cursor, binding.stats(primary).logPosition);
+assert.strictEqual(binding.applyLog(replica, snapshot.records), snapshot.records.length);
+assert.strictEqual(replica.stale, undefined);
+assert.deepEqual(binding.dump(replica), binding.dump(primary));
+assert.strictEqual(binding.getPath(replica, 'b', ['x', 1]), 2);
+primary.g = 'after';
+binding.applyLog(replica, binding.readLog(primary, snapshot.cursor).records);
+assert.strictEqual(replica.g, 'after');
+
+// clearing the primary clears replicas
+binding.clear(primary);
+binding.applyLog(replica, binding.readLog(primary, snapshot.cursor).records);
+assert.deepEqual(Object.keys(replica), []);
+
+// entries are mirrored with the priority they keep
+cursor = binding.stats(primary).logPosition;
+binding.set(primary, 'pin', 1, {pinned: true});
+primary.pin = 2;
+binding.transaction(primary, [['set', 'pin', 3]]);
+binding.increase(primary, 'pin');
+binding.set(primary, 'low', 'x', {priority: binding.PRIORITY_LOW});
+primary.low = 'y';
+part = binding.readLog(primary, cursor);
+for(var offset = 0; offset < part.records.length; offset += part.records.readUInt32LE(offset)) {
+	assert.notStrictEqual(part.records[offset + 5], binding.PRIORITY_NORMAL);
+}
+binding.applyLog(replica, part.records);
+assert.strictEqual(replica.pin, 4);
+assert(binding.stats(primary).pinnedBlocks > 0);
+assert.strictEqual(binding.stats(replica).pinnedBlocks, binding.stats(primary).pinnedBlocks);
+binding.clear(primary);
+binding.applyLog(replica, binding.readLog(primary, part.cursor).records);
+
+assert.throws(function() {
+	binding.applyLog(replica, Buffer.from([12, 0, 0, 0, 9, 0, 0, 0, 0, 0, 0, 0]));
+}, /malformed/);
+// keys longer than those set are rejected, before any of them is read
+[257, 65536].forEach(function(keyLen) {
+	var record = Buffer.alloc(12 + keyLen * 2 + 2, 0x61);
+	record.writeUInt32LE(record.length, 0);
+	record.writeUInt32LE(0, 4); // set, of normal priority, in the default namespace
+	record.writeUInt32LE(keyLen, 8);
+	assert.throws(function() {
+		binding.applyLog(replica, record);
+	}, /malformed/);
+});
+
+// all processes should open the cache with the same change log
+assert.throws(function() {
+	new binding.Cache("primary", 4 << 20, binding.SIZE_DEFAULT);
+}, /change log/);
+
+// streams mirror a cache to another one over a unix socket
+var mirror = new binding.Cache("mirror", 4 << 20);
+mirror.stale = 1;
+primary.before = 'snapshot';
+var path = '/tmp/node-shared-cache-replication.sock';
+try {
+	fs.unlinkSync(path);
+} catch(e) {}
+
+var exported;
+var server = net.createServer(function(socket) {
+	exported = binding.exportStream(primary, {interval: 10});
+	exported.pipe(socket);
+});
+server.listen(path, function() {
+	var client = net.connect(path);
+	client.pipe(binding.importStream(mirror));
+	primary.after = str(5000, 'a');
+	binding.increase(primary, 'counter', 3);
+
+	var timer = setInterval(function() {
+		if(mirror.counter !== 3) return;
+		clearInterval(timer);
+		assert.strictEqual(mirror.stale, undefined);
+		assert.strictEqual(mirror.before, 'snapshot');
+		assert.strictEqual(mirror.after, str(5000, 'a'));
+		assert.deepEqual(binding.dump(mirror), binding.dump(primary));
+		exported.destroy();
+		client.destroy();
+		server.close();
+		['primary', 'replica', 'mirror'].forEach(binding.release);
+	}, 10);
+});
@@ -0,0 +1,60 @@
+var binding = require('../index.js');
+try {
+	binding.release('shapes');
+} catch(e) {}
+
+var assert = require('assert');
+
+var shaped = new binding.Cache("shapes", 4194304, binding.SIZE_DEFAULT, {shapes: true});
+var plain = new binding.Cache("shapes", 4194304);
+
+var records = [];
+for(var i = 0; i < 1000; i++) {
+	records.push({id: i, name: 'record' + i, tags: ['a', 'b'], 7: i % 2 === 0});
+}
+// records of another shape, nested ones, and an empty object
+records.push({name: 'other', id: -1});
+records.push({nested: {id: 1, name: 'x', tags: [], 7: false}, empty: {}});
+
+function blocks(obj, key, value) {
+	var before = binding.stats(obj).blocksUsed;
+	binding.set(obj, key, value);
+	return binding.stats(obj).blocksUsed - before;
+}
+
+// key lists are written once, so values are smaller
+var shapedBlocks = blocks(shaped, 'shaped', records);
+var plainBlocks = blocks(plain, 'plain', records);
+assert.ok(shapedBlocks * 3 < plainBlocks * 2, shapedBlocks + ' vs ' + plainBlocks);
+
+// and are read by every instance
+[shaped, plain].forEach(function(obj) {
+	assert.deepEqual(obj.shaped, records);
+	assert.deepEqual(obj.plain, records);
+	assert.deepEqual(Object.keys(obj.shaped[0]), Object.keys(records[0]));
+	assert.deepEqual(Object.keys(obj.shaped[1000]), ['name', 'id']);
+});
+
+// top level objects, primitives and references
+shaped.obj = {a: 1, b: {a: 2, b: null}};
+assert.deepEqual(shaped.obj, {a: 1, b: {a: 2, b: null}});
+shaped.str = 'foo';
+assert.strictEqual(shaped.str, 'foo');
+var cyclic = {a: 1, b: null};
+cyclic.b = cyclic;
+shaped.cyclic = [cyclic, {a: 2, b: cyclic}];
+var ret = shaped.cyclic;
+assert.strictEqual(ret[0].b, ret[0]);
+assert.strictEqual(ret[1].b, ret[0]);
+
+// exchange and getPath read shaped values
+assert.strictEqual(binding.exchange(shaped, 'obj', 1).b.a, 2);
+assert.strictEqual(binding.getPath(shaped, 'shaped', [999, 'name']), 'record999');
+
+// indexed instances keep keys in place
+var both = new binding.Cache("shapes", 4194304, binding.SIZE_DEFAULT, {shapes: true, indexed: true});
+binding.set(both, 'both', records);
+assert.deepEqual(plain.both, records);
+assert.strictEqual(binding.getPath(both, 'both', [500, 'id']), 500);
+
+binding.release('shapes');
@@ -0,0 +1,106 @@
+var binding = require('../index.js');
+try {
+	binding.release('slab');
+} catch(e) {}
+
+var assert = require('assert');
+
+var obj = new binding.Cache("slab", 4 << 20, binding.SIZE_DEFAULT, {slabs: true});
+var stats = binding.stats(obj);
+assert.strictEqual(stats.slabClasses, 9);
+assert.strictEqual(stats.slabPages, 256);
+var pages = stats.slabPagesFree;
+assert(pages > 200);
+assert.strictEqual(stats.blocksAvailable, pages * 256);
+
+function str(n, c) {
+	return Array(n + 1).join(c || '-');
+}
+
+// values take a chunk of the smallest class they fit in
+obj.a = 1;
+assert.strictEqual(binding.stats(obj).blocksUsed, 1);
+obj.b = str(100);
+assert.strictEqual(binding.stats(obj).blocksUsed, 1 + 4); // about 240 bytes in 256
+obj.c = str(3000);
+assert.strictEqual(binding.stats(obj).blocksUsed, 1 + 4 + 128); // 8KB
+assert.strictEqual(binding.stats(obj).slabPagesFree, pages - 3);
+assert.strictEqual(obj.a, 1);
+assert.strictEqual(obj.b, str(100));
+assert.strictEqual(obj.c, str(3000));
+
+// larger values are chained chunks of 16KB
+obj.d = str(20000);
+assert.strictEqual(obj.d, str(20000));
+assert.strictEqual(binding.stats(obj).blocksUsed, 1 + 4 + 128 + 3 * 256);
+
+// values move between classes as they grow or shrink
+assert.strictEqual(binding.exchange(obj, 'a', str(3000, 'a')), 1);
+assert.strictEqual(obj.a, str(3000, 'a'));
+assert.strictEqual(binding.exchange(obj, 'd', 'd'), str(20000));
+assert.strictEqual(obj.d, 'd');
+obj.c = str(5000);
+assert.strictEqual(obj.c, str(5000));
+obj.c = str(6000);
+assert.strictEqual(obj.c, str(6000));
+assert.strictEqual(binding.increase(obj, 'b'), 1);
+assert.strictEqual(binding.increase(obj, 'b', 2), 3);
+assert.deepEqual(Object.keys(obj).sort(), ['a', 'b', 'c', 'd']);
+
+// pages are given back when their chunks are all free
+binding.clear(obj);
+stats = binding.stats(obj);
+assert.strictEqual(stats.blocksUsed, 0);
+assert.strictEqual(stats.slabPagesFree, pages);
+
+// values of mixed sizes evict each other, and are read as they were written
+var sizes = [1, 10, 40, 100, 300, 1000, 3000, 7000, 20000];
+var written = {};
+var seed = 1;
+function random(n) {
+	seed = Math.imul(seed, 1103515245) + 12345 & 0x7fffffff;
+	return seed % n;
+}
+for(var i = 0; i < 10000; i++) {
+	var key = 'k' + random(2000);
+	var value = str(sizes[random(sizes.length)], String.fromCharCode(97 + i % 26));
+	obj[key] = value;
+	written[key] = value;
+	var other = 'k' + random(2000);
+	var read = obj[other];
+	assert(read === undefined || read === written[other]);
+}
+stats = binding.stats(obj);
+assert(stats.evictions > 0);
+assert(stats.blocksUsed <= stats.blocksAvailable);
+for(var key in written) {
+	var read = obj[key];
+	assert(read === undefined || read === written[key]);
+}
+var dumped = binding.dump(obj);
+for(var key in dumped) {
+	assert.strictEqual(dumped[key], written[key]);
+}
+
+// namespaces keep their quotas in blocks
+var ns = binding.namespace(obj, 'ns', 64 << 10);
+for(var i = 0; i < 100; i++) {
+	ns['k' + i] = str(1000);
+}
+assert.strictEqual(Object.keys(ns).length, 32); // in chunks of 2KB
+assert.strictEqual(ns.k99, str(1000));
+
+// all processes should open the cache with slabs
+assert.throws(function() {
+	new binding.Cache("slab", 4 << 20, binding.SIZE_DEFAULT);
+}, /slabs/);
+
+// a cache of 16KB blocks has a single class
+binding.release('slab');
+obj = new binding.Cache("slab", 4 << 20, binding.SIZE_16K, {slabs: true});
+assert.strictEqual(binding.stats(obj).slabClasses, 1);
+obj.foo = str(40000);
+assert.strictEqual(obj.foo, str(40000));
+assert.strictEqual(binding.stats(obj).blocksUsed, 5);
+
+binding.release('slab');
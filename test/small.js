@@ -0,0 +1,119 @@
+var binding = require('../index.js');
+try {
+	binding.release('small');
+} catch(e) {}
+
+var assert = require('assert');
+
+var obj = new binding.Cache("small", 1048576, binding.SIZE_DEFAULT, {smallSlots: 64});
+var stats = binding.stats(obj);
+assert.strictEqual(stats.smallSlots, 64);
+assert.strictEqual(stats.smallUsed, 0);
+
+// tiny values are kept in slots, and take no block
+obj.foo = 1;
+obj.bar = 'baz';
+obj.t = true;
+assert.strictEqual(obj.foo, 1);
+assert.strictEqual(obj.bar, 'baz');
+assert.strictEqual(obj.t, true);
+assert.strictEqual(binding.fastGet(obj, 'bar'), 'baz');
+assert('foo' in obj);
+stats = binding.stats(obj);
+assert.strictEqual(stats.smallUsed, 3);
+assert.strictEqual(stats.blocksUsed, 0);
+
+assert.strictEqual(binding.increase(obj, 'foo'), 2);
+assert.strictEqual(binding.increase(obj, 'n', 5), 5);
+assert.strictEqual(binding.increase(obj, 'bar'), 1); // not an integer
+assert.strictEqual(obj.bar, 1);
+assert.strictEqual(binding.exchange(obj, 'foo', 'x'), 2);
+assert.strictEqual(obj.foo, 'x');
+
+// values which outgrow their slots move to blocks, and back
+var long = Array(64).join('-');
+assert.strictEqual(binding.exchange(obj, 'foo', long), 'x');
+assert.strictEqual(obj.foo, long);
+assert.strictEqual(binding.stats(obj).smallUsed, 3);
+assert(binding.stats(obj).blocksUsed > 0);
+assert.strictEqual(binding.exchange(obj, 'foo', 3), long);
+assert.strictEqual(obj.foo, 3);
+assert.strictEqual(binding.stats(obj).blocksUsed, 0);
+obj.t = 'tt';
+assert.strictEqual(binding.increase(obj, 't'), 1);
+
+// keys above latin-1 take 2 bytes per unit
+obj['中文'] = 1;
+assert.strictEqual(obj['中文'], 1);
+obj['中文中文中文中文'] = 'abc';
+assert.strictEqual(obj['中文中文中文中文'], 'abc');
+obj['été'] = 2;
+assert.strictEqual(obj['été'], 2);
+
+// enumeration and dump cover slots as well as blocks
+obj.big = {a: long};
+var keys = Object.keys(obj).sort();
+assert.deepEqual(keys, ['été', 'bar', 'big', 'foo', 'n', 't', '中文', '中文中文中文中文'].sort());
+var dumped = binding.dump(obj);
+assert.strictEqual(dumped.foo, 3);
+assert.strictEqual(dumped.bar, 1);
+assert.deepEqual(dumped.big, {a: long});
+assert.strictEqual(dumped['中文'], 1);
+
+// getPath reads tiny values as well
+obj.arr = [1];
+assert.strictEqual(binding.getPath(obj, 'arr', [0]), 1);
+assert.strictEqual(binding.getPath(obj, 'arr', ['length']), 1);
+
+// handles see values in slots
+var foo = binding.key(obj, 'foo');
+assert.strictEqual(binding.fastGet(obj, foo), 3);
+assert.strictEqual(binding.increase(obj, foo), 4);
+obj.foo = long;
+assert.strictEqual(binding.fastGet(obj, foo), long);
+obj.foo = 5;
+assert.strictEqual(binding.fastGet(obj, foo), 5);
+delete obj.foo;
+assert.strictEqual(binding.fastGet(obj, foo), undefined);
+assert.strictEqual(obj.foo, undefined);
+
+// namespaces do not share slots
+var ns = binding.namespace(obj, 'ns');
+ns.bar = 'ns';
+assert.strictEqual(ns.bar, 'ns');
+assert.strictEqual(obj.bar, 1);
+assert.deepEqual(Object.keys(ns), ['bar']);
+binding.clear(ns);
+assert.strictEqual(ns.bar, undefined);
+assert.strictEqual(obj.bar, 1);
+
+// the clock evicts entries when all slots are taken
+binding.clear(obj);
+assert.strictEqual(binding.stats(obj).smallUsed, 0);
+var evictions = binding.stats(obj).evictions;
+for(var i = 0; i < 100; i++) {
+	obj['k' + i] = i;
+}
+stats = binding.stats(obj);
+assert.strictEqual(stats.smallUsed, 64);
+assert.strictEqual(stats.evictions - evictions, 36);
+assert.strictEqual(obj.k99, 99);
+assert.strictEqual(obj.k0, undefined);
+
+// entries read since the hand passed are kept
+for(var i = 36; i < 100; i++) {
+	obj['k' + i] = i;
+}
+obj.k36;
+obj.k_new = 1;
+assert.strictEqual(obj.k36, 36);
+assert.strictEqual(obj.k37, undefined);
+
+// all processes should open the cache with the same slots
+assert.throws(function() {
+	new binding.Cache("small", 1048576, binding.SIZE_DEFAULT, {smallSlots: 32});
+}, /small slots/);
+var same = new binding.Cache("small", 1048576, binding.SIZE_DEFAULT, {smallSlots: 64});
+assert.strictEqual(same.k36, 36);
+
+binding.release('small');
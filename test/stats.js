@@ -0,0 +1,51 @@
+var binding = require('../index.js');
+try {
+	binding.release('stats');
+} catch(e) {}
+
+var assert = require('assert');
+
+var obj = new binding.Cache("stats", 1048576);
+var stats = binding.stats(obj);
+assert.strictEqual(stats.gets, 0);
+assert.strictEqual(stats.blockSize, 64);
+assert.strictEqual(stats.blocksUsed, 0);
+
+obj.foo = 'bar';
+binding.set(obj, 'bar', 1);
+binding.increase(obj, 'bar');
+assert.strictEqual(obj.foo, 'bar');
+assert.strictEqual(binding.fastGet(obj, 'baz'), undefined);
+delete obj.foo;
+
+stats = binding.stats(obj);
+assert.strictEqual(stats.gets, 2);
+assert.strictEqual(stats.hits, 1);
+assert.strictEqual(stats.misses, 1);
+assert.strictEqual(stats.sets, 3);
+assert.strictEqual(stats.deletes, 1);
+assert.strictEqual(stats.evictions, 0);
+assert.strictEqual(stats.blocksUsed, 1);
+assert(stats.lookups >= 5);
+
+// counters are shared by namespaces and instances attached to the cache
+var ns = binding.namespace(obj, 'ns');
+ns.foo = 1;
+var attached = new binding.Cache("stats", 0);
+assert.strictEqual(binding.stats(attached).sets, 4);
+assert.strictEqual(attached.bar, 2);
+
+var data = Array(1024).join('-');
+for(var i = 0; i < 1024; i++) {
+	obj['k' + i] = data;
+}
+stats = binding.stats(obj);
+assert(stats.evictions > 0);
+assert.strictEqual(stats.evictedBytes % 64, 0);
+assert(stats.allocatedBlocks > stats.blocksUsed);
+
+assert.throws(function() {
+	new binding.Cache("stats_absent", 0);
+}, /not found/);
+
+binding.release('stats');
@@ -56,3 +56,31 @@ var longData = Array(8192).join('abcdefgh');
 
 obj.test = longData;
 assert.strictEqual(obj.test, longData);
+
+// every block size has its own specialization of get, fastGet and set
+for(var shift = binding.SIZE_64; shift <= binding.SIZE_16K; shift++) {
+    try {
+        binding.release('test3_' + shift);
+    } catch(e) {}
+    var sized = new binding.Cache('test3_' + shift, 1 << 20, shift);
+    [1, 'short', longData.slice(0, 100), longData.slice(0, 5000), longData].forEach(function(value, i) {
+        sized['k' + i] = value;
+        assert.strictEqual(sized['k' + i], value);
+        assert.strictEqual(binding.fastGet(sized, 'k' + i), value);
+    });
+    binding.release('test3_' + shift);
+}
+
+// the header of a large cache of small blocks takes more than 65535 blocks
+try {
+    binding.release('test3_large');
+} catch(e) {}
+var large = new binding.Cache('test3_large', 64 << 20, binding.SIZE_64);
+var value = longData.slice(0, 500);
+for(var i = 0; i < 100000; i++) {
+    large['k' + i % 30000] = value;
+}
+for(var i = 0; i < 30000; i++) {
+    assert.strictEqual(large['k' + i], value);
+}
+binding.release('test3_large');
@@ -0,0 +1,55 @@
+var binding = require('../index.js');
+var assert = require('assert');
+
+if(process.argv[2] === 'child') {
+	// holds the shared lock most of the time
+	var obj = new binding.Cache("timeout", 0);
+	process.send('ready');
+	for(var until = Date.now() + 2000; Date.now() < until; ) {
+		binding.dump(obj);
+	}
+	process.exit(0);
+}
+
+try {
+	binding.release('timeout');
+} catch(e) {}
+
+var obj = new binding.Cache("timeout", 4194304);
+for(var i = 0; i < 2000; i++) {
+	obj['k' + i] = {i: i, list: [1, 2, 3, 4, 5, 6, 7, 8], str: 'foobar'};
+}
+assert.strictEqual(binding.get(obj, 'k1', {timeout: 10}).i, 1);
+assert.strictEqual(binding.stats(obj).lockTimeouts, 0);
+
+var child = require('child_process').fork(__filename, ['child']);
+child.on('message', function() {
+	var timedOut = false;
+	for(var until = Date.now() + 1000; !timedOut && Date.now() < until; ) {
+		// readers share the lock
+		assert.strictEqual(binding.fastGet(obj, 'k2', {timeout: 0}).i, 2);
+		try {
+			binding.set(obj, 'foo', 1, {timeout: 0});
+		} catch(e) {
+			assert.strictEqual(e.code, 'ETIMEDOUT');
+			timedOut = true;
+		}
+	}
+	assert(timedOut);
+	assert.throws(function() {
+		while(true) binding.get(obj, 'k3', {timeout: 0});
+	}, /lock timeout/);
+	assert.throws(function() {
+		while(true) binding.hincr(obj, 'h', 'n', 1, {timeout: 0});
+	}, /lock timeout/);
+	assert.throws(function() {
+		while(true) binding.hdel(obj, 'h', 'n', {timeout: 0});
+	}, /lock timeout/);
+	assert(binding.stats(obj).lockTimeouts >= 4);
+
+	// waits without timeout
+	binding.set(obj, 'foo', 2);
+	assert.strictEqual(binding.get(obj, 'foo'), 2);
+	child.kill();
+	binding.release('timeout');
+});
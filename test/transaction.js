@@ -0,0 +1,94 @@
+var binding = require('../index.js');
+try {
+	binding.release('transaction');
+} catch(e) {}
+
+var assert = require('assert');
+
+var obj = new binding.Cache("transaction", 1048576);
+
+// ops are applied in order, and their results returned
+obj.from = [1, 2, 3];
+obj.to = [];
+var ret = binding.transaction(obj, [
+	['get', 'from'],
+	['set', 'from', [2, 3]],
+	['set', 'to', [1]],
+	['increase', 'moves'],
+	['increase', 'moves', 2],
+	['unset', 'absent'],
+	['get', 'from']
+]);
+assert.deepEqual(ret, [[1, 2, 3], true, true, 1, 3, false, [2, 3]]);
+assert.deepEqual(obj.from, [2, 3]);
+assert.deepEqual(obj.to, [1]);
+assert.strictEqual(obj.moves, 3);
+
+// nothing is applied if a check fails
+ret = binding.transaction(obj, [
+	['check', 'from', [2, 3]],
+	['unset', 'from'],
+	['check', 'moves', 4],
+	['increase', 'moves']
+]);
+assert.strictEqual(ret, null);
+assert.deepEqual(obj.from, [2, 3]);
+assert.strictEqual(obj.moves, 3);
+
+// checks compare serialized values, or find the key absent
+ret = binding.transaction(obj, [
+	['check', 'from', [2, 3]],
+	['check', 'moves', 3],
+	['check', 'absent'],
+	['unset', 'from'],
+	['set', 'absent', {a: 'b'}]
+]);
+assert.deepEqual(ret, [true, true, true, true, true]);
+assert.strictEqual(obj.from, undefined);
+assert.deepEqual(obj.absent, {a: 'b'});
+assert.strictEqual(binding.transaction(obj, [['check', 'absent'], ['set', 'x', 1]]), null);
+assert.strictEqual(obj.x, undefined);
+
+// checks see the values before the transaction
+assert.strictEqual(binding.transaction(obj, [['set', 'y', 1], ['check', 'y', 1]]), null);
+assert.strictEqual(obj.y, undefined);
+
+// large values are compared in full
+var long = Array(2000).join('-');
+obj.long = long;
+assert.strictEqual(binding.transaction(obj, [['check', 'long', long + '+']]), null);
+assert.deepEqual(binding.transaction(obj, [['check', 'long', long], ['get', 'long']]), [true, long]);
+
+// a value which can not be stored fails the transaction before anything is applied
+assert.throws(function() {
+	binding.transaction(obj, [['unset', 'long'], ['set', 'huge', Array(1 << 20).join('-')]]);
+}, /transaction/);
+assert.strictEqual(obj.long, long);
+
+assert.throws(function() {
+	binding.transaction(obj, [['swap', 'a']]);
+}, /unknown op/);
+assert.throws(function() {
+	binding.transaction(obj, [['set', 'a']]);
+}, /unknown op/);
+assert.throws(function() {
+	binding.transaction(obj, 'get');
+}, TypeError);
+assert.deepEqual(binding.transaction(obj, []), []);
+
+// transactions run in namespaces
+var ns = binding.namespace(obj, 'ns');
+ns.moves = 10;
+assert.deepEqual(binding.transaction(ns, [['check', 'moves', 10], ['increase', 'moves']]), [true, 11]);
+assert.strictEqual(obj.moves, 3);
+
+// tiny values in slots are read, compared and written as well
+binding.release('transaction');
+obj = new binding.Cache("transaction", 1048576, binding.SIZE_DEFAULT, {smallSlots: 16});
+obj.a = 1;
+assert.deepEqual(binding.transaction(obj, [['check', 'a', 1], ['set', 'a', 'x'], ['increase', 'b'], ['get', 'a']]), [true, true, 1, 'x']);
+assert.strictEqual(binding.transaction(obj, [['check', 'a', 'y'], ['unset', 'a']]), null);
+assert.deepEqual(binding.transaction(obj, [['check', 'a', 'x'], ['unset', 'a']]), [true, true]);
+assert.strictEqual(obj.a, undefined);
+
+binding.release('transaction');
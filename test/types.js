@@ -0,0 +1,91 @@
+var binding = require('../index.js');
+try {
+	binding.release('types');
+} catch(e) {}
+
+var assert = require('assert');
+
+var obj = new binding.Cache("types", 1048576);
+
+function roundtrip(value) {
+	obj.value = value;
+	return obj.value;
+}
+
+var date = new Date(1500000000000);
+assert.ok(roundtrip(date) instanceof Date);
+assert.strictEqual(roundtrip(date).getTime(), date.getTime());
+
+var buf = Buffer.from('hello world');
+assert.ok(Buffer.isBuffer(roundtrip(buf)));
+assert.ok(roundtrip(buf).equals(buf));
+
+// views keep their element type, and only the viewed range is copied
+var f64 = new Float64Array([1.5, -2.25, Math.PI, NaN]);
+assert.ok(roundtrip(f64) instanceof Float64Array);
+assert.deepEqual(Array.from(roundtrip(f64.subarray(1, 3))), [-2.25, Math.PI]);
+assert.ok(isNaN(roundtrip(f64)[3]));
+
+var types = [Int8Array, Uint8Array, Uint8ClampedArray, Int16Array, Uint16Array, Int32Array, Uint32Array, Float32Array];
+types.forEach(function(Type) {
+	var arr = new Type([1, 2, 3, 250]);
+	var ret = roundtrip(arr);
+	assert.ok(ret instanceof Type, Type.name);
+	assert.ok(!Buffer.isBuffer(ret), Type.name);
+	assert.deepEqual(Array.from(ret), Array.from(arr), Type.name);
+});
+
+var ab = new Uint8Array([9, 8, 7]).buffer;
+assert.ok(roundtrip(ab) instanceof ArrayBuffer);
+assert.deepEqual(Array.from(new Uint8Array(roundtrip(ab))), [9, 8, 7]);
+
+var dv = new DataView(new ArrayBuffer(8), 2, 4);
+dv.setInt32(0, -123456);
+assert.ok(roundtrip(dv) instanceof DataView);
+assert.strictEqual(roundtrip(dv).byteLength, 4);
+assert.strictEqual(roundtrip(dv).getInt32(0), -123456);
+
+var map = new Map([['a', 1], [2, {b: [3]}], [null, date]]);
+var ret = roundtrip(map);
+assert.ok(ret instanceof Map);
+assert.deepEqual(Array.from(ret.keys()), ['a', 2, null]);
+assert.deepEqual(ret.get(2), {b: [3]});
+assert.strictEqual(ret.get(null).getTime(), date.getTime());
+
+var set = new Set(['x', 1, 'x', 2.5]);
+ret = roundtrip(set);
+assert.ok(ret instanceof Set);
+assert.deepEqual(Array.from(ret), ['x', 1, 2.5]);
+
+// references are kept across the new types
+var shared = new Uint16Array([1, 2]);
+ret = roundtrip({a: shared, b: [shared], m: new Map([['self', shared]])});
+assert.strictEqual(ret.a, ret.b[0]);
+assert.strictEqual(ret.a, ret.m.get('self'));
+var cyclic = new Map();
+cyclic.set('me', cyclic);
+ret = roundtrip(cyclic);
+assert.strictEqual(ret.get('me'), ret);
+
+if(typeof BigInt === 'function') {
+	var values = ['0', '1', '-1', '18446744073709551615', '-340282366920938463463374607431768211457'];
+	values.forEach(function(v) {
+		var big = BigInt(v);
+		assert.strictEqual(roundtrip(big), big);
+	});
+	if(typeof BigInt64Array === 'function') {
+		var big64 = new BigInt64Array([BigInt(-1), BigInt('9007199254740993')]);
+		ret = roundtrip(big64);
+		assert.ok(ret instanceof BigInt64Array);
+		assert.deepEqual(Array.from(ret, String), ['-1', '9007199254740993']);
+	}
+}
+
+// values larger than the inline buffer of the serializer
+var large = new Float64Array(10000);
+for(var i = 0; i < large.length; i++) large[i] = i / 3;
+ret = roundtrip(large);
+assert.strictEqual(ret.length, large.length);
+assert.strictEqual(ret[9999], 9999 / 3);
+
+binding.release('types');
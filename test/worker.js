@@ -0,0 +1,68 @@
+var worker_threads;
+try {
+	worker_threads = require('worker_threads');
+} catch(e) {
+	return console.log('worker_threads is not available, skipped');
+}
+
+var binding = require('../index.js');
+var assert = require('assert');
+
+if(!worker_threads.isMainThread) {
+	var obj = new binding.Cache("worker", 1048576);
+	var id = worker_threads.workerData;
+	if(id === 'lease') { // waits for the lease held by the main thread
+		worker_threads.parentPort.postMessage('waiting');
+		var start = Date.now();
+		var value = binding.getOrLock(obj, 'leased', 5000);
+		worker_threads.parentPort.postMessage({value: value, waited: Date.now() - start});
+		return;
+	}
+	for(var i = 0; i < 2000; i++) {
+		binding.increase(obj, 'counter');
+		obj['w' + id] = {i: i};
+		assert.strictEqual(binding.fastGet(obj, 'w' + id).i, i);
+	}
+	binding.setAsync(obj, 'async' + id, id).then(function() {
+		worker_threads.parentPort.postMessage('done');
+	});
+	return;
+}
+
+try {
+	binding.release('worker');
+} catch(e) {}
+
+var obj = new binding.Cache("worker", 1048576);
+var workers = 4, done = 0;
+for(var i = 0; i < workers; i++) {
+	new worker_threads.Worker(__filename, {workerData: i}).on('message', function() {
+		if(++done < workers) return;
+		assert.strictEqual(obj.counter, workers * 2000);
+		for(var i = 0; i < workers; i++) {
+			assert.strictEqual(obj['w' + i].i, 1999);
+			assert.strictEqual(obj['async' + i], i);
+		}
+
+		// threads of a process hold leases of their own, so another thread waits for the value
+		assert.strictEqual(binding.getOrLock(obj, 'leased', 5000), undefined);
+		new worker_threads.Worker(__filename, {workerData: 'lease'}).on('message', function(message) {
+			if(message === 'waiting') {
+				return setTimeout(function() {
+					obj.leased = 'computed';
+				}, 300);
+			}
+			assert.strictEqual(message.value, 'computed');
+			assert(message.waited >= 200);
+			binding.release('worker');
+		});
+	});
+}
+for(var j = 0; j < 2000; j++) {
+	binding.increase(obj, 'main');
+}
+
+// caches of the same name share the mapping, and must be opened with the same size
+assert.throws(function() {
+	new binding.Cache("worker", 2097152);
+}, /different size/);